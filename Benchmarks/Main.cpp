@@ -0,0 +1,175 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Created: 19 Oct 2026 3:12:44pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+//times the songcode pipeline outside the plugin: evaluating songs (tree walker, bytecode, batches),
+//parsing and folding a big script, and editing a big script through the editors' token cache.
+//prints its numbers to stdout. build it in Release, debug builds are no use for timing
+#include <JuceHeader.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include "../Source/SongBytecode.h"
+#include "../Source/SongcodeTokenCache.h"
+
+
+//every allocation in the program goes through here, so a stretch of code can be counted
+static std::atomic<long long> allocations{ 0 };
+
+void* operator new(std::size_t size) {
+    allocations++;
+    if (void* memory = std::malloc(size != 0 ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+
+
+namespace {
+
+double secondsSince(juce::int64 startTicks) {
+    return juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+}
+
+
+//tree walker, bytecode cursor and SongBatch over the working test cases, and the songs they make checked against each other
+void benchmarkEvaluators() {
+    const auto result = benchmarkSongEvaluators();
+    std::printf("evaluators (%d scripts)\n", result.numScripts);
+    std::printf("  tree walker  %10.0f instances/s\n", result.treeWalkInstancesPerSecond);
+    std::printf("  bytecode     %10.0f instances/s\n", result.bytecodeInstancesPerSecond);
+    std::printf("  batch        %10.0f instances/s\n", result.batchInstancesPerSecond);
+    std::printf("  outputs match: %s\n\n", result.outputsMatch ? "yes" : "NO");
+}
+
+
+//songs with no rands, which folding turns into segments
+void benchmarkDeterministicSongs() {
+    const std::vector<std::string> corpus = {
+        "120 1000, 240 1000, 0 500",
+        "[120 500, 240 500] 4, 0 500",
+        "[120 250, [240 100, 360 100] 3] 2, 0 500",
+        "pattern(1 2 1), 120 500, 240 500, 360 500, 0 500",
+        "100 100, 200 100, 300 100, 400 100, 500 100, [600 50, 700 50, 800 50] 10, 900 100, 1000 100, 1100 100, 1200 100, 0 500",
+        "[100 100, [200 50, 300 50] 3, 400 100] 2, [500 200, [600 100, 700 100] 2] 3, 0 500"
+    };
+    std::vector<SongProgram::Ptr> programs;
+    for (auto songcode : corpus) {
+        ErrorInfo error = {};
+        programs.push_back(compileSongProgram(generateAST(songcode, &error), &error));
+    }
+
+    const int instancesPerScript = 20000;
+    SongCursor cursor;
+    SongElement element(0.0f, 0.0f, 0.0f);
+    size_t elements = 0;
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    for (auto& program : programs) {
+        for (int i = 0; i < instancesPerScript; i++) {
+            cursor.start(program.get(), CounterRng(1, (uint64_t)i));
+            while (cursor.next(element)) elements++;
+        }
+    }
+    const double seconds = secondsSince(startTicks);
+    cursor.start(nullptr, CounterRng());
+    std::printf("deterministic songs, streamed (%d scripts)\n", (int)programs.size());
+    std::printf("  %10.0f instances/s (%zu elements)\n\n", programs.size() * instancesPerScript / seconds, elements);
+}
+
+
+//a script with a bit of everything, at least this many characters long
+std::string makeBigScript(size_t characters) {
+    const std::string chunk = "let a = rand(100 200), [a 50, (a + 40) * 2 rand(20 40), pattern(1 0 2)] rand(2 4), "
+        "$a comment$ let b = 3 * (4 + 5) / 2, [b * 10 100, [a - b 25] 2] b, ";
+    std::string script;
+    while (script.size() < characters) script += chunk;
+    return script + "0 500";
+}
+
+
+void benchmarkParsing() {
+    std::string script = makeBigScript(36000);
+    const int runs = 50;
+    long long allocated = 0;
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    for (int i = 0; i < runs; i++) {
+        ErrorInfo error = {};
+        const long long before = allocations.load();
+        ScriptPtr ast = generateAST(script, &error);
+        allocated += allocations.load() - before;
+        if (ast == nullptr || error.message != "") std::printf("  parse failed: %s\n", error.message.c_str());
+    }
+    const double seconds = secondsSince(startTicks);
+    std::printf("parse and fold (%zu characters)\n", script.size());
+    std::printf("  %.2f ms, %lld allocations per parse\n\n", seconds * 1000.0 / runs, allocated / runs);
+}
+
+
+//random one-line edits to a big script through the token cache, checked every so often against lexing it all again
+void benchmarkTokenCache() {
+    const int numLines = 20000;
+    const int numEdits = 20000;
+    const int checkEvery = 1000;
+    const std::string insertable = "0123456789 [](),$+-*/=letrandpattern";
+
+    std::vector<std::string> lines;
+    for (int i = 0; i < numLines; i++) lines.push_back("[" + std::to_string(100 + i % 900) + " 50, pattern(1 0 2)] rand(1 3),\n");
+    SongcodeTokenCache cache;
+    cache.replaceLines(0, cache.getNumLines(), lines);
+
+    juce::Random random(1);
+    std::vector<double> editSeconds;
+    bool matched = true;
+    std::vector<Token> cached, full;
+    for (int edit = 0; edit < numEdits; edit++) {
+        const int line = random.nextInt(numLines);
+        std::string& text = lines[(size_t)line];
+        const int position = random.nextInt((int)text.size());     //before the line break
+        text.insert(text.begin() + position, insertable[(size_t)random.nextInt((int)insertable.size())]);
+
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+        cache.replaceLines(line, 1, { text });
+        editSeconds.push_back(secondsSince(startTicks));
+
+        if ((edit + 1) % checkEvery != 0) continue;
+        SongcodeTokenCache fresh;
+        fresh.replaceLines(0, fresh.getNumLines(), lines);
+        const bool cachedLexed = cache.getTokens(cached);
+        const bool fullLexed = fresh.getTokens(full);
+        bool same = cachedLexed == fullLexed && cached.size() == full.size();
+        for (size_t i = 0; same && i < cached.size(); i++) {
+            same = cached[i].type == full[i].type && cached[i].numValue == full[i].numValue
+                && cached[i].startPos == full[i].startPos && cached[i].endPos == full[i].endPos;
+        }
+        matched = matched && same;
+    }
+    std::printf("token cache (%d lines, %d random one-line edits)\n", numLines, numEdits);
+    //an edit that opens or closes a $comment$ relexes every line to the next $, so the mean is a lot worse than a typical edit
+    double total = 0.0;
+    for (double seconds : editSeconds) total += seconds;
+    std::sort(editSeconds.begin(), editSeconds.end());
+    std::printf("  %.2f us per edit (median), %.2f us (mean)\n", editSeconds[editSeconds.size() / 2] * 1.0e6, total * 1.0e6 / numEdits);
+    std::printf("  matches lexing it all again: %s\n\n", matched ? "yes" : "NO");
+}
+
+}
+
+
+int main(int, char**) {
+    benchmarkEvaluators();
+    benchmarkDeterministicSongs();
+    benchmarkParsing();
+    benchmarkTokenCache();
+    return 0;
+}
@@ -0,0 +1,253 @@
+/*
+  ==============================================================================
+
+    AmbisonicBus.h
+    Created: 19 Oct 2026 2:47:05pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <vector>
+#include "BinauralRenderer.h"
+
+
+
+//shared ambisonic bus for chorus mode. every voice is encoded into the bus with a handful of
+//gains (no filtering), and the whole bus gets decoded once per block. this moves the spatial
+//work from per-voice to per-bus, so the cost of a big chorus is mostly the encode, which is
+//just a vectorized multiply-add per channel.
+//
+//channel order is ACN, normalization is SN3D (AmbiX). voices sit on the horizontal plane,
+//so the components that are zero at 0 elevation are never written.
+class AmbisonicBus {
+public:
+	static constexpr int maxOrder = 3;
+	static constexpr int maxChannels = (maxOrder + 1) * (maxOrder + 1);
+	static constexpr int numVirtualSpeakers = 8;	//ring used for the binaural decode
+
+	enum class Decode {
+		Speakers = 0,	//stereo, or the host's multichannel layout
+		Binaural		//virtual speaker ring through the binaural renderer
+	};
+
+
+	//call from prepareToPlay, not from the audio thread
+	void prepare(int maximumBlockSize, const juce::AudioChannelSet& outputLayout) {
+		bus.setSize(maxChannels, maximumBlockSize);
+		bus.clear();
+		speakerFeed.assign(maximumBlockSize, 0.0f);
+		setOutputLayout(outputLayout);
+	}
+
+
+	//figures out where each output channel sits, so the speaker decode knows where to aim.
+	//channels without a direction (LFE, discrete) are left silent
+	void setOutputLayout(const juce::AudioChannelSet& layout) {
+		speakerAzimuths.clear();
+		for (int ch = 0; ch < layout.size(); ch++) {
+			speakerAzimuths.push_back(getSpeakerAzimuth(layout.getTypeOfChannel(ch)));
+		}
+		isStereoLayout = layout == juce::AudioChannelSet::stereo();
+	}
+
+
+	//clears the channels for this order. call once per block before encoding voices
+	void beginBlock(int newOrder, int numSamples) {
+		jassert(numSamples <= bus.getNumSamples());
+		order = juce::jlimit(1, maxOrder, newOrder);
+		for (int ch = 0; ch < getNumChannels(); ch++) bus.clear(ch, 0, numSamples);
+	}
+
+
+	int getNumChannels() const { return (order + 1) * (order + 1); }
+
+
+	//=====================================================================================
+
+
+	//encodes a mono voice into the bus. angle is in the spatializer's convention
+	//(cos is right, sin is front). normalizedDistance is 0 (close) to 1 (far)
+	void encode(const float* samples, float angle, float normalizedDistance, int numSamples) {
+		std::array<float, maxChannels> gains;
+		getEncodingGains(angle, normalizedDistance, gains);
+
+		for (int ch = 0; ch < getNumChannels(); ch++) {
+			if (gains[ch] == 0.0f) continue;
+			juce::FloatVectorOperations::addWithMultiply(bus.getWritePointer(ch), samples, gains[ch], numSamples);
+		}
+	}
+
+
+	//decodes the bus into outBuffer (added, not replaced)
+	void decode(juce::AudioBuffer<float>& outBuffer, int outputStartSample, int numSamples,
+		Decode mode, BinauralRenderer& binauralRenderer) {
+
+		if (mode == Decode::Binaural) {
+			decodeToBinaural(binauralRenderer, numSamples);
+			binauralRenderer.process(outBuffer, outputStartSample, numSamples);
+		}
+		else if (isStereoLayout || speakerAzimuths.size() < 3) {
+			decodeToStereo(outBuffer, outputStartSample, numSamples);
+		}
+		else {
+			decodeToSpeakers(outBuffer, outputStartSample, numSamples);
+		}
+	}
+
+
+	//raw bus access, for bouncing the b-format itself
+	const juce::AudioBuffer<float>& getBus() const { return bus; }
+
+
+private:
+
+	//ambisonic azimuth: 0 is front, positive is to the left
+	static float toAmbisonicAzimuth(float angle) {
+		return angle - juce::MathConstants<float>::halfPi;
+	}
+
+
+	//SN3D real spherical harmonics at 0 elevation, ACN order.
+	//closer voices get their higher orders pulled back a little so they sound wider
+	void getEncodingGains(float angle, float normalizedDistance, std::array<float, maxChannels>& gains) const {
+		const float phi = toAmbisonicAzimuth(angle);
+		const float spread = juce::jmap(juce::jlimit(0.0f, 1.0f, normalizedDistance), 0.7f, 1.0f);
+		gains.fill(0.0f);
+
+		//order 0
+		gains[0] = 1.0f;
+
+		//order 1: Y Z X
+		gains[1] = spread * std::sin(phi);
+		gains[3] = spread * std::cos(phi);
+		if (order < 2) return;
+
+		//order 2: V T R S U
+		const float spread2 = spread * spread;
+		gains[4] = spread2 * (std::sqrt(3.0f) / 2.0f) * std::sin(2.0f * phi);
+		gains[6] = spread2 * -0.5f;
+		gains[8] = spread2 * (std::sqrt(3.0f) / 2.0f) * std::cos(2.0f * phi);
+		if (order < 3) return;
+
+		//order 3: Q O M K L N P
+		const float spread3 = spread2 * spread;
+		gains[9] = spread3 * std::sqrt(5.0f / 8.0f) * std::sin(3.0f * phi);
+		gains[11] = spread3 * -std::sqrt(3.0f / 8.0f) * std::sin(phi);
+		gains[13] = spread3 * -std::sqrt(3.0f / 8.0f) * std::cos(phi);
+		gains[15] = spread3 * std::sqrt(5.0f / 8.0f) * std::cos(3.0f * phi);
+	}
+
+
+	//=====================================================================================
+
+
+	//horizontal decode to one speaker at azimuth phi. only the sectoral components carry
+	//horizontal information, so those get converted back to circular harmonics.
+	//max-rE weighting keeps the energy concentrated toward the source
+	void getDecodingGains(float phi, int numSpeakers, std::array<float, maxChannels>& gains) const {
+		gains.fill(0.0f);
+		const float norm = 1.0f / (float)numSpeakers;
+		auto maxRE = [this](int m) { return std::cos((float)m * juce::MathConstants<float>::pi / (float)(2 * order + 2)); };
+
+		gains[0] = norm;
+		gains[1] = norm * 2.0f * maxRE(1) * std::sin(phi);
+		gains[3] = norm * 2.0f * maxRE(1) * std::cos(phi);
+		if (order < 2) return;
+
+		const float sn3d2 = std::sqrt(3.0f) / 2.0f;
+		gains[4] = norm * 2.0f * maxRE(2) * std::sin(2.0f * phi) / sn3d2;
+		gains[8] = norm * 2.0f * maxRE(2) * std::cos(2.0f * phi) / sn3d2;
+		if (order < 3) return;
+
+		const float sn3d3 = std::sqrt(5.0f / 8.0f);
+		gains[9] = norm * 2.0f * maxRE(3) * std::sin(3.0f * phi) / sn3d3;
+		gains[15] = norm * 2.0f * maxRE(3) * std::cos(3.0f * phi) / sn3d3;
+	}
+
+
+	void decodeSpeakerFeed(float phi, int numSpeakers, float* dest, int numSamples) {
+		std::array<float, maxChannels> gains;
+		getDecodingGains(phi, numSpeakers, gains);
+		for (int ch = 0; ch < getNumChannels(); ch++) {
+			if (gains[ch] == 0.0f) continue;
+			juce::FloatVectorOperations::addWithMultiply(dest, bus.getReadPointer(ch), gains[ch], numSamples);
+		}
+	}
+
+
+	//stereo: a pair of back to back cardioids facing left and right. only needs W and Y
+	void decodeToStereo(juce::AudioBuffer<float>& outBuffer, int outputStartSample, int numSamples) {
+		const float gain = 0.5f * juce::MathConstants<float>::sqrt2;
+		auto* left = outBuffer.getWritePointer(0, outputStartSample);
+		auto* right = outBuffer.getWritePointer(1, outputStartSample);
+		const float* w = bus.getReadPointer(0);
+		const float* y = bus.getReadPointer(1);
+
+		juce::FloatVectorOperations::addWithMultiply(left, w, gain, numSamples);
+		juce::FloatVectorOperations::addWithMultiply(left, y, gain, numSamples);
+		juce::FloatVectorOperations::addWithMultiply(right, w, gain, numSamples);
+		juce::FloatVectorOperations::addWithMultiply(right, y, -gain, numSamples);
+	}
+
+
+	//multichannel: one feed per directional output channel
+	void decodeToSpeakers(juce::AudioBuffer<float>& outBuffer, int outputStartSample, int numSamples) {
+		int numDirectional = 0;
+		for (float azimuth : speakerAzimuths) if (azimuth != noDirection) numDirectional++;
+
+		const int numOutputs = juce::jmin((int)speakerAzimuths.size(), outBuffer.getNumChannels());
+		for (int ch = 0; ch < numOutputs; ch++) {
+			if (speakerAzimuths[ch] == noDirection) continue;
+			decodeSpeakerFeed(speakerAzimuths[ch], numDirectional, outBuffer.getWritePointer(ch, outputStartSample), numSamples);
+		}
+	}
+
+
+	//binaural: decode to a ring of virtual speakers, and hand each one to the binaural renderer
+	//as if it were a voice. the HRTF convolution cost is fixed at numVirtualSpeakers bins
+	void decodeToBinaural(BinauralRenderer& renderer, int numSamples) {
+		for (int s = 0; s < numVirtualSpeakers; s++) {
+			const int bin = (s * BinauralRenderer::numBins) / numVirtualSpeakers;
+			const float phi = toAmbisonicAzimuth(renderer.getBinAngle(bin));
+
+			juce::FloatVectorOperations::clear(speakerFeed.data(), numSamples);
+			decodeSpeakerFeed(phi, numVirtualSpeakers, speakerFeed.data(), numSamples);
+			renderer.addToBin(bin, speakerFeed.data(), numSamples);
+		}
+	}
+
+
+	//=====================================================================================
+
+
+	static constexpr float noDirection = -1000.0f;
+
+	//ambisonic azimuth (radians) of a speaker channel
+	static float getSpeakerAzimuth(juce::AudioChannelSet::ChannelType type) {
+		using CS = juce::AudioChannelSet;
+		switch (type) {
+			case CS::left:				return juce::degreesToRadians(30.0f);
+			case CS::right:				return juce::degreesToRadians(-30.0f);
+			case CS::centre:			return 0.0f;
+			case CS::leftSurround:		return juce::degreesToRadians(110.0f);
+			case CS::rightSurround:		return juce::degreesToRadians(-110.0f);
+			case CS::leftSurroundSide:	return juce::degreesToRadians(90.0f);
+			case CS::rightSurroundSide:	return juce::degreesToRadians(-90.0f);
+			case CS::leftSurroundRear:	return juce::degreesToRadians(150.0f);
+			case CS::rightSurroundRear:	return juce::degreesToRadians(-150.0f);
+			case CS::surround:			return juce::MathConstants<float>::pi;
+			default:					return noDirection;
+		}
+	}
+
+
+	juce::AudioBuffer<float> bus;
+	std::vector<float> speakerAzimuths;
+	std::vector<float> speakerFeed;
+	bool isStereoLayout = true;
+	int order = maxOrder;
+};
@@ -0,0 +1,315 @@
+/*
+  ==============================================================================
+
+    BinauralRenderer.h
+    Created: 19 Oct 2026 10:12:40am
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <complex>
+#include <vector>
+#include <array>
+
+
+
+//binaural output for chorus mode. convolving every voice with its own HRIR would be way too
+//expensive with a big chorus, so instead voices are summed into azimuth bins, and each bin
+//is convolved once with that direction's HRIR pair. cost scales with the number of occupied
+//directions, not the number of voices.
+//
+//convolution is uniformly partitioned (overlap-save): each bin keeps a frequency domain delay
+//line of its input partitions, and multiplies them into one shared spectral accumulator per ear.
+//this adds partitionSize samples of latency.
+class BinauralRenderer {
+public:
+	static constexpr int numBins = 36;					//10 degree azimuth resolution
+	static constexpr int partitionSize = 128;			//hop size of the convolution
+	static constexpr int numPartitions = 2;				//hrir length = partitionSize * numPartitions
+	static constexpr int fftSize = partitionSize * 2;
+	static constexpr int numSpectralBins = partitionSize + 1;
+	static constexpr int hrirLength = partitionSize * numPartitions;
+
+	BinauralRenderer() : fft((int)std::log2(fftSize)), hrirFft((int)std::log2(hrirLength)) {}
+
+
+	//builds the hrir set for this sample rate, and sizes the per-bin input buses
+	//call from prepareToPlay, not from the audio thread
+	void prepare(double newSampleRate, int maximumBlockSize) {
+		sampleRate = newSampleRate;
+		maxBlockSize = maximumBlockSize;
+
+		for (int b = 0; b < numBins; b++) {
+			auto& bin = bins[b];
+			bin.blockInput.assign(maxBlockSize, 0.0f);
+			for (auto& slot : bin.delayLine) slot.assign(numSpectralBins, {});
+			for (int ear = 0; ear < 2; ear++) {
+				buildHrir(b, ear);
+			}
+		}
+		reset();
+	}
+
+
+	void reset() {
+		for (auto& bin : bins) {
+			clearBin(bin);
+			bin.hasBlockInput = false;
+		}
+		for (int ear = 0; ear < 2; ear++) outputFifo[ear].fill(0.0f);
+		fifoPos = 0;
+	}
+
+
+	//=====================================================================================
+
+
+	//maps a voice angle (radians, same convention as the spatializer) to its azimuth bin
+	int getBinForAngle(float angle) const {
+		float wrapped = std::fmod(angle, juce::MathConstants<float>::twoPi);
+		if (wrapped < 0.0f) wrapped += juce::MathConstants<float>::twoPi;
+		int bin = (int)(wrapped / juce::MathConstants<float>::twoPi * numBins);
+		return juce::jlimit(0, numBins - 1, bin);
+	}
+
+	//center angle of a bin
+	float getBinAngle(int bin) const {
+		return ((float)bin + 0.5f) * juce::MathConstants<float>::twoPi / (float)numBins;
+	}
+
+
+	//sums a processed mono voice into its bin for this block
+	void addToBin(int bin, const float* samples, int numSamples) {
+		jassert(bin >= 0 && bin < numBins);
+		jassert(numSamples <= maxBlockSize);
+		auto& b = bins[bin];
+		if (!b.hasBlockInput) {
+			juce::FloatVectorOperations::copy(b.blockInput.data(), samples, numSamples);
+			b.hasBlockInput = true;
+		}
+		else {
+			juce::FloatVectorOperations::add(b.blockInput.data(), samples, numSamples);
+		}
+	}
+
+
+	//convolves every occupied bin and adds the stereo result to outBuffer
+	//call once per block, after all voices have been added
+	void process(juce::AudioBuffer<float>& outBuffer, int outputStartSample, int numSamples) {
+		jassert(outBuffer.getNumChannels() >= 2);
+		jassert(numSamples <= maxBlockSize);
+
+		int done = 0;
+		while (done < numSamples) {
+			const int chunk = juce::jmin(numSamples - done, partitionSize - fifoPos);
+
+			//move this chunk of each bin bus into its partition input
+			for (auto& bin : bins) {
+				float* dest = bin.currentInput.data() + fifoPos;
+				if (bin.hasBlockInput) {
+					juce::FloatVectorOperations::copy(dest, bin.blockInput.data() + done, chunk);
+					bin.partitionHasInput = true;
+				}
+				else {
+					juce::FloatVectorOperations::clear(dest, chunk);
+				}
+			}
+
+			//read out the previous partition's result
+			for (int ear = 0; ear < 2; ear++) {
+				outBuffer.addFrom(ear, outputStartSample + done, outputFifo[ear].data() + fifoPos, chunk);
+			}
+
+			fifoPos += chunk;
+			done += chunk;
+
+			if (fifoPos == partitionSize) {
+				processPartition();
+				fifoPos = 0;
+			}
+		}
+
+		for (auto& bin : bins) bin.hasBlockInput = false;
+	}
+
+
+	int getLatencySamples() const { return partitionSize; }
+
+	//number of bins that are currently being convolved
+	int getNumOccupiedBins() const {
+		int count = 0;
+		for (auto& bin : bins) if (bin.activePartitions > 0) count++;
+		return count;
+	}
+
+
+private:
+	using Spectrum = std::vector<std::complex<float>>;
+
+	struct Bin {
+		std::vector<float> blockInput;					//summed voices for the current host block
+		std::array<float, partitionSize> previousInput{};
+		std::array<float, partitionSize> currentInput{};
+		std::array<Spectrum, numPartitions> delayLine;	//frequency domain delay line, newest at delayHead
+		std::array<std::array<Spectrum, numPartitions>, 2> hrir;	//[ear][partition]
+		int delayHead = 0;
+		int activePartitions = 0;	//counts down once input stops, so the tail can ring out
+		bool hasBlockInput = false;
+		bool partitionHasInput = false;
+	};
+
+
+	void clearBin(Bin& bin) {
+		bin.previousInput.fill(0.0f);
+		bin.currentInput.fill(0.0f);
+		for (auto& slot : bin.delayLine) std::fill(slot.begin(), slot.end(), std::complex<float>{});
+		bin.delayHead = 0;
+		bin.activePartitions = 0;
+		bin.partitionHasInput = false;
+	}
+
+
+	//one overlap-save step. every occupied bin is multiplied into the two ear accumulators, then each ear
+	//takes a single inverse FFT, however many bins there are
+	void processPartition() {
+		for (auto& accumulator : accumulators) std::fill(accumulator.begin(), accumulator.end(), std::complex<float>{});
+		bool anyOccupied = false;
+
+		for (auto& bin : bins) {
+			if (bin.partitionHasInput) {
+				bin.activePartitions = numPartitions + 1;
+			}
+			else if (bin.activePartitions > 0 && --bin.activePartitions == 0) {
+				//tail has rung out. clear so the delay line is silent when it wakes back up
+				clearBin(bin);
+				continue;
+			}
+			if (bin.activePartitions == 0) continue;
+			bin.partitionHasInput = false;
+			anyOccupied = true;
+
+			//FFT [previous | current] into the newest delay line slot
+			std::copy(bin.previousInput.begin(), bin.previousInput.end(), fftBuffer.begin());
+			std::copy(bin.currentInput.begin(), bin.currentInput.end(), fftBuffer.begin() + partitionSize);
+			std::fill(fftBuffer.begin() + fftSize, fftBuffer.end(), 0.0f);
+			fft.performRealOnlyForwardTransform(fftBuffer.data(), true);
+
+			bin.delayHead = (bin.delayHead + 1) % numPartitions;
+			auto* spectrum = reinterpret_cast<std::complex<float>*>(fftBuffer.data());
+			std::copy(spectrum, spectrum + numSpectralBins, bin.delayLine[bin.delayHead].begin());
+			bin.previousInput = bin.currentInput;
+
+			//multiply-accumulate every partition into the shared accumulators
+			for (int ear = 0; ear < 2; ear++) {
+				auto& accumulator = accumulators[ear];
+				for (int p = 0; p < numPartitions; p++) {
+					const auto& input = bin.delayLine[(bin.delayHead - p + numPartitions) % numPartitions];
+					const auto& filter = bin.hrir[ear][p];
+					for (int k = 0; k < numSpectralBins; k++) {
+						accumulator[k] += input[k] * filter[k];
+					}
+				}
+			}
+		}
+
+		for (int ear = 0; ear < 2; ear++) {
+			if (!anyOccupied) {
+				outputFifo[ear].fill(0.0f);
+				continue;
+			}
+			std::fill(fftBuffer.begin(), fftBuffer.end(), 0.0f);
+			std::copy(accumulators[ear].begin(), accumulators[ear].end(), reinterpret_cast<std::complex<float>*>(fftBuffer.data()));
+			fft.performRealOnlyInverseTransform(fftBuffer.data());
+
+			//overlap-save: only the last half is valid
+			std::copy(fftBuffer.begin() + partitionSize, fftBuffer.begin() + fftSize, outputFifo[ear].begin());
+		}
+	}
+
+
+	//=====================================================================================
+
+
+	//there's no measured HRTF set in the project, so we bundle an analytic one instead:
+	//a rigid spherical head (Brown & Duda): woodworth ITD, plus a one pole/one zero head shadow
+	//filter per ear, and a gentle rolloff for sources behind the listener.
+	//angle convention matches the spatializer: cos(angle) is right, sin(angle) is front
+	void buildHrir(int binIndex, int ear) {
+		const float headRadius = 0.0875f;		//meters
+		const float speedOfSound = 343.0f;		//meters per second
+		const float alphaMin = 0.1f;
+		const float thetaMin = juce::degreesToRadians(150.0f);
+		const float baseDelaySamples = 8.0f;	//keep the onset away from the start of the ir
+
+		const float azimuth = getBinAngle(binIndex);
+		const float earAngle = (ear == 0) ? juce::MathConstants<float>::pi : 0.0f;	//left ear points to pi
+
+		//angle between the source and this ear's axis
+		const float theta = std::acos(juce::jlimit(-1.0f, 1.0f, std::cos(azimuth - earAngle)));
+
+		//woodworth ITD, relative to the center of the head
+		float itdSeconds = (theta < juce::MathConstants<float>::halfPi)
+			? (headRadius / speedOfSound) * (1.0f - std::cos(theta))
+			: (headRadius / speedOfSound) * (theta - juce::MathConstants<float>::halfPi + 1.0f);
+		const float delaySamples = baseDelaySamples + itdSeconds * (float)sampleRate;
+
+		//head shadow. alpha > 1 boosts highs facing the ear, alpha < 1 shadows them
+		const float alpha = (1.0f + alphaMin / 2.0f) + (1.0f - alphaMin / 2.0f) * std::cos(theta / thetaMin * juce::MathConstants<float>::pi);
+		const float omega0 = speedOfSound / headRadius;
+
+		//sources behind the listener get darker
+		const float backness = juce::jmax(0.0f, -std::sin(azimuth)) * 0.5f;
+		const float rearCutoff = juce::MathConstants<float>::twoPi * 4000.0f;
+
+		//design the response in the frequency domain, then inverse FFT it
+		std::vector<float> buffer(hrirLength * 2, 0.0f);
+		auto* spectrum = reinterpret_cast<std::complex<float>*>(buffer.data());
+		for (int k = 0; k <= hrirLength / 2; k++) {
+			const float omega = juce::MathConstants<float>::twoPi * (float)k * (float)sampleRate / (float)hrirLength;
+			const std::complex<float> j(0.0f, 1.0f);
+
+			std::complex<float> shadow = (1.0f + j * alpha * omega / (2.0f * omega0)) / (1.0f + j * omega / (2.0f * omega0));
+			std::complex<float> rear = 1.0f + backness * (1.0f / (1.0f + j * omega / rearCutoff) - 1.0f);
+			std::complex<float> delay = std::polar(1.0f, -juce::MathConstants<float>::twoPi * (float)k * delaySamples / (float)hrirLength);
+
+			spectrum[k] = shadow * rear * delay;
+		}
+		hrirFft.performRealOnlyInverseTransform(buffer.data());
+
+		//fade out the last quarter so nothing wraps around
+		const int fadeStart = hrirLength * 3 / 4;
+		for (int i = fadeStart; i < hrirLength; i++) {
+			float t = (float)(i - fadeStart) / (float)(hrirLength - fadeStart);
+			buffer[i] *= 0.5f * (1.0f + std::cos(t * juce::MathConstants<float>::pi));
+		}
+
+		//split into partitions and take each one into the frequency domain
+		for (int p = 0; p < numPartitions; p++) {
+			std::fill(fftBuffer.begin(), fftBuffer.end(), 0.0f);
+			std::copy(buffer.begin() + p * partitionSize, buffer.begin() + (p + 1) * partitionSize, fftBuffer.begin());
+			fft.performRealOnlyForwardTransform(fftBuffer.data(), true);
+
+			auto* partitionSpectrum = reinterpret_cast<std::complex<float>*>(fftBuffer.data());
+			bins[binIndex].hrir[ear][p].assign(partitionSpectrum, partitionSpectrum + numSpectralBins);
+		}
+	}
+
+
+	//=====================================================================================
+
+
+	juce::dsp::FFT fft, hrirFft;
+	std::array<Bin, numBins> bins;
+	std::array<float, fftSize * 2> fftBuffer{};
+	std::array<std::array<std::complex<float>, numSpectralBins>, 2> accumulators{};	//[ear]
+	std::array<std::array<float, partitionSize>, 2> outputFifo{};
+	int fifoPos = 0;
+
+	double sampleRate = 44100.0;
+	int maxBlockSize = 0;
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BinauralRenderer)
+};
@@ -35,6 +35,17 @@ ChorusKnobRack::ChorusKnobRack(BugsoundsAudioProcessor& processor, BugsoundsAudi
     powerButtonAttachment = std::make_unique<ButtonAttachment>(
         audioProcessor.apvts, "Chorus On", *powerButton);
 
+    //spatial mode selector. items have to exist before the attachment is made
+    spatialModeBox.addItemList(audioProcessor.apvts.getParameter("Chorus Spatial Mode")->getAllValueStrings(), 1);
+    addAndMakeVisible(spatialModeBox);
+    spatialModeAttachment = std::make_unique<ComboBoxAttachment>(
+        audioProcessor.apvts, "Chorus Spatial Mode", spatialModeBox);
+
+    motionBox.addItemList(audioProcessor.apvts.getParameter("Chorus Motion")->getAllValueStrings(), 1);
+    addAndMakeVisible(motionBox);
+    motionAttachment = std::make_unique<ComboBoxAttachment>(
+        audioProcessor.apvts, "Chorus Motion", motionBox);
+
     positionReadout = std::make_unique<ChorusPositionReadout>(processor);
     addAndMakeVisible(positionReadout.get());
 
@@ -108,6 +119,8 @@ void ChorusKnobRack::resized()
     powerButton->setBounds(powerButtonBounds);
     auto helpArea = titleBounds.removeFromRight(titleHeight).reduced(5);
     helpButton->setBounds(helpArea);
+    spatialModeBox.setBounds(titleBounds.removeFromRight(90).reduced(0, 5));
+    motionBox.setBounds(titleBounds.removeFromRight(75).reduced(2, 5));
     titleLabel.setBounds(titleBounds.reduced(5, 0));
     
 
@@ -32,6 +32,7 @@ public:
 private:
     using SliderAttachment = juce::AudioProcessorValueTreeState::SliderAttachment;
     using ButtonAttachment = juce::AudioProcessorValueTreeState::ButtonAttachment;
+    using ComboBoxAttachment = juce::AudioProcessorValueTreeState::ComboBoxAttachment;
 
     void initializeKnob(juce::Slider& slider, juce::Label& label,
         const juce::String& labelText,
@@ -55,6 +56,10 @@ private:
     std::unique_ptr<ButtonAttachment> powerButtonAttachment;
 
     juce::Label titleLabel;
+    juce::ComboBox spatialModeBox;
+    std::unique_ptr<ComboBoxAttachment> spatialModeAttachment;
+    juce::ComboBox motionBox;
+    std::unique_ptr<ComboBoxAttachment> motionAttachment;
 
     std::unique_ptr<ChorusPositionReadout> positionReadout;
 
@@ -45,6 +45,15 @@ public:
         g.fillEllipse(center.x - 5, center.y - 5, 10, 10);
         g.setColour(juce::Colours::skyblue);
 
+        //draw trails behind moving voices, fading out toward the oldest point
+        for (auto& trail : trails) {
+            for (size_t i = 1; i < trail.size(); i++) {
+                float alpha = 0.6f * (float)i / (float)trail.size();
+                g.setColour(juce::Colours::lightblue.withAlpha(alpha));
+                g.drawLine(juce::Line<float>(trail[i - 1], trail[i]), 1.5f);
+            }
+        }
+
         //draw voices
         for (auto& pos : currentPositions) {
             g.setColour(juce::Colours::lightblue);
@@ -81,6 +90,21 @@ private:
         auto bounds = getLocalBounds().toFloat();
         auto center = bounds.getCentre();
 
+        //record where moving voices have been
+        trails.resize(currentPositions.size());
+        for (size_t i = 0; i < currentPositions.size(); i++) {
+            auto& pos = currentPositions[i];
+            if (!pos.isMoving) {
+                trails[i].clear();
+                continue;
+            }
+            float normD = (pos.distance) / (15.0f - 5.0f);
+            float maxR = bounds.getWidth() * 0.5f - 10.0f;
+            float r0 = normD * maxR;
+            trails[i].push_back({ center.x + std::cos(pos.angle) * r0, center.y + std::sin(pos.angle) * r0 });
+            if (trails[i].size() > maxTrailLength) trails[i].erase(trails[i].begin());
+        }
+
         //spawn a ripple for each playing note
         if (++spawnCounter >= spawnIntervalTicks) {
             spawnCounter = 0;
@@ -120,4 +144,6 @@ private:
     BugsoundsAudioProcessor& processor;
     std::vector<BugsoundsAudioProcessor::ChorusVoicePosition>  currentPositions;
     std::vector<Wave> waves;
+    std::vector<std::vector<juce::Point<float>>> trails;  //one per voice, oldest point first
+    static constexpr size_t maxTrailLength = 24;
 };
\ No newline at end of file
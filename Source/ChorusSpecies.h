@@ -0,0 +1,110 @@
+/*
+  ==============================================================================
+
+    ChorusSpecies.h
+    Created: 21 Oct 2026 4:52:19pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <vector>
+#include "PipStructs.h"
+#include "Evaluator.h"
+#include "SongBytecode.h"
+#include "SongBounds.h"
+
+
+//one kind of insect in the chorus: its songs, its click, and how much of the chorus it makes up.
+//built on the message thread, and never changed after. every voice of a species reads the same one,
+//so ten crickets and ten cicadas cost two of these, not twenty
+struct ChorusSpecies {
+	ScriptPtr songScript;
+	ScriptPtr resScript;
+	SongProgram::Ptr songProgram;	//the scripts compiled, by whatever checked them. what the voices actually run, null for no song
+	SongProgram::Ptr resProgram;
+	SongBounds songBounds;			//the worst the song can do, from wherever the song was checked. sizes the voices' click lists
+	std::vector<Pip> pips;
+	float weight = 1.0f;		//relative share of the chorus
+	float gain = 1.0f;			//click level
+	bool resonatorOn = true;	//on top of the Resonator On param
+};
+
+
+//every species in the chorus, as one immutable, reference counted object. the audio thread swaps in
+//a new set instead of editing the old one, so a voice reading a species never sees it half changed.
+//the programs come already compiled (on the compile thread, or in compileExtraSpecies) and are only shared,
+//so rebuilding the set for new pips or weights costs next to nothing.
+//species 0 is the one the editors are showing, and the only one mono mode plays
+class ChorusSpeciesSet : public juce::ReferenceCountedObject {
+public:
+	using Ptr = juce::ReferenceCountedObjectPtr<ChorusSpeciesSet>;
+
+	explicit ChorusSpeciesSet(std::vector<ChorusSpecies> newSpecies) : species(std::move(newSpecies)) {
+		if (species.empty()) species.emplace_back();
+		float total = 0.0f;
+		for (auto& s : species) {
+			cursorSize.include(s.songProgram.get()).include(s.resProgram.get());
+			total += juce::jmax(0.0f, s.weight);
+			cumulativeWeights.push_back(total);
+		}
+		totalWeight = total;
+	}
+
+
+	//out of range indices get the last species. a voice can outlive the set it picked its species from
+	const ChorusSpecies& get(int index) const {
+		return species[(size_t)juce::jlimit(0, (int)species.size() - 1, index)];
+	}
+
+
+	//weighted pick. draw is 0 to 1
+	int pick(float draw) const {
+		if (totalWeight <= 0.0f) return 0;
+		const float target = draw * totalWeight;
+		for (size_t i = 0; i < cumulativeWeights.size(); i++) {
+			if (target < cumulativeWeights[i]) return (int)i;
+		}
+		return (int)species.size() - 1;
+	}
+
+
+	int getNumSpecies() const { return (int)species.size(); }
+
+
+	//what a voice needs to play any of the species
+	VoiceLoad getVoiceLoad(double sampleRate) const {
+		VoiceLoad load;
+		for (auto& s : species) load.include(VoiceLoad::forSong(s.songBounds, s.pips, sampleRate));
+		return load;
+	}
+
+	//what a voice's song cursors need to run any of the songs, the resonator songs included
+	const SongCursorSize& getCursorSize() const { return cursorSize; }
+
+
+private:
+	std::vector<ChorusSpecies> species;
+	std::vector<float> cumulativeWeights;
+	float totalWeight = 0.0f;
+	SongCursorSize cursorSize;
+};
+
+
+//the extra species as they're saved in presets: songcode text instead of compiled scripts.
+//the main species isn't in here, it's the editors' songs and the pip sequencer
+struct ChorusSpeciesDescription {
+	juce::String freqSong;
+	juce::String resSong;
+	std::vector<Pip> pips;
+	float weight = 1.0f;
+	float gain = 1.0f;
+	bool resonatorOn = true;
+};
+
+struct ChorusSpeciesList {
+	float mainWeight = 1.0f;
+	std::vector<ChorusSpeciesDescription> extraSpecies;
+};
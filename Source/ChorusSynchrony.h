@@ -0,0 +1,131 @@
+/*
+  ==============================================================================
+
+    ChorusSynchrony.h
+    Created: 21 Oct 2026 10:14:31am
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+
+//how chorus voices decide when to start singing again. matches the "Chorus Timing Model" choices
+enum class ChorusTimingModel {
+	Cooldown = 0,	//random cooldowns, sped up or slowed down by how many voices are singing (SynthVoice::getCooldownRate)
+	PhaseCoupled	//voices are coupled oscillators, see ChorusSynchrony
+};
+
+
+//phase coupled timing for the chorus ("Phase Coupled" timing model).
+//every voice's song plus the cooldown after it is one cycle of a phase oscillator: phase 0 is
+//when it starts singing, and it starts again when the phase gets back to 1.
+//voices couple kuramoto style, through the mean field: the weighted average of every voice's
+//phase, summed once per tick. so it's O(n) per tick instead of every pair listening to every
+//other pair, and hundreds of voices cost about nothing.
+//
+//positive coupling pulls cooling voices towards the mean phase, so the chorus phase-locks and
+//sings together. negative pushes them away from it, so voices spread out and take turns.
+//a singing voice can't change its song, so only cooling voices get pushed around
+class ChorusSynchrony {
+public:
+	//allocates for up to maxVoices. call off the audio thread
+	void prepare(int maxVoices) {
+		voices.assign((size_t)maxVoices, {});
+	}
+
+
+	//voice just started singing a song this long. the cooldown after isn't drawn yet, so guess the average
+	void startSong(int voiceIndex, double songSamples, double expectedCooldownSamples) {
+		auto& voice = voices[(size_t)voiceIndex];
+		voice.phase = 0.0;
+		voice.frequency = 1.0 / (juce::jmax(1.0, songSamples) + juce::jmax(0.0, expectedCooldownSamples));
+		voice.velocity = voice.frequency;
+		voice.cooling = false;
+	}
+
+
+	//voice finished its song (or is waiting for its first one). the cooldown sets its natural frequency,
+	//so voices with short cooldowns run fast and long ones slow, and the coupling has to pull them together
+	void startCooldown(int voiceIndex, double songSamples, double cooldownSamples) {
+		auto& voice = voices[(size_t)voiceIndex];
+		const double song = juce::jmax(1.0, songSamples);
+		const double period = song + juce::jmax(0.0, cooldownSamples);
+		voice.phase = song / period;
+		voice.frequency = 1.0 / period;
+		voice.velocity = voice.frequency;
+		voice.cooling = true;
+	}
+
+
+	//how much a voice counts towards the mean field. 1 for everyone, unless it's distance weighted
+	void setWeight(int voiceIndex, float weight) {
+		voices[(size_t)voiceIndex].weight = weight;
+	}
+
+
+	//one control tick for the first numVoices voices. coupling is -1 to 1 (the correlation param)
+	void tick(int numVoices, int numSamples, float coupling) {
+		using R = juce::MathConstants<double>;
+
+		//the mean field: where the chorus is in its cycle (meanPhase), and how bunched up it is (coherence, 0 to 1)
+		double re = 0.0, im = 0.0, totalWeight = 0.0;
+		for (int i = 0; i < numVoices; i++) {
+			const auto& voice = voices[(size_t)i];
+			re += voice.weight * std::cos(R::twoPi * voice.phase);
+			im += voice.weight * std::sin(R::twoPi * voice.phase);
+			totalWeight += voice.weight;
+		}
+		coherence = totalWeight > 0.0 ? std::sqrt(re * re + im * im) / totalWeight : 0.0;
+		meanPhase = std::atan2(im, re) / R::twoPi;
+
+		const double strength = (double)coupling * couplingWeight * coherence;
+		for (int i = 0; i < numVoices; i++) {
+			auto& voice = voices[(size_t)i];
+			voice.velocity = voice.frequency;
+			if (voice.cooling) {
+				//behind the mean speeds up, ahead of it slows down (or the other way around, for negative coupling)
+				const double pull = std::sin(R::twoPi * (meanPhase - voice.phase));
+				voice.velocity *= juce::jmax(minSpeed, 1.0 + strength * pull);
+			}
+			voice.phase += voice.velocity * numSamples;
+			//a cooling voice stops at 1 and waits for the wake scheduler to start it
+			if (voice.cooling) voice.phase = juce::jmin(voice.phase, 1.0);
+			else voice.phase -= std::floor(voice.phase);
+		}
+	}
+
+
+	//samples until a cooling voice's phase comes back around to 1, at its speed from the last tick
+	double getSamplesUntilWake(int voiceIndex) const {
+		const auto& voice = voices[(size_t)voiceIndex];
+		if (voice.velocity <= 0.0) return std::numeric_limits<double>::max();
+		return juce::jmax(0.0, (1.0 - voice.phase) / voice.velocity);
+	}
+
+
+	double getCoherence() const { return coherence; }
+
+
+private:
+	//kept small and together, since tick walks all of them
+	struct Oscillator {
+		double phase = 0.0;			//0 to 1 over one song plus cooldown
+		double frequency = 0.0;		//cycles per sample, uncoupled
+		double velocity = 0.0;		//cycles per sample, after coupling
+		float weight = 1.0f;
+		bool cooling = false;
+	};
+
+	static constexpr double couplingWeight = 3.0;	//same scale as SynthVoice::correlationWeight
+	static constexpr double minSpeed = 0.1;			//pushed back voices still come around eventually
+
+	std::vector<Oscillator> voices;
+	double coherence = 0.0;
+	double meanPhase = 0.0;
+};
@@ -0,0 +1,145 @@
+/*
+  ==============================================================================
+
+    ChorusTrajectory.h
+    Created: 19 Oct 2026 5:21:48pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+
+
+//how the chorus voices move around. matches the "Chorus Motion" choices
+enum class ChorusMotion {
+	Static = 0,	//voices stay where they were placed
+	Drift,		//slow wander around their spot
+	Circle,		//orbit the listener
+	FlyBy,		//straight line past the listener, then come back from somewhere else
+	Mixed		//each voice picks one of the moving ones
+};
+
+
+//movement of a single chorus voice. the voice's placed position (from the distance/angle scalars)
+//is the anchor, and the trajectory moves the voice relative to that anchor.
+//advance() gets called at control rate, getPosition() turns the current state into a distance/angle
+class ChorusTrajectory {
+public:
+	static constexpr float minDistance = 5.0f;
+	static constexpr float maxDistance = 15.0f;
+
+
+	//per voice randomization, so voices sharing a motion type don't all move in lockstep.
+	//the three values should be uniform 0 to 1
+	void randomize(float r1, float r2, float r3) {
+		using R = juce::MathConstants<float>;
+		phaseA = r1 * R::twoPi;
+		phaseB = r2 * R::twoPi;
+		direction = r3 < 0.5f ? -1.0f : 1.0f;
+		mixedMotion = static_cast<ChorusMotion>(1 + juce::jlimit(0, 2, (int)(r2 * 3.0f)));
+		orbit = 0.0f;
+		pathPosition = 0.0f;
+		hasPath = false;
+	}
+
+
+	//moves the trajectory forward by deltaSeconds. speed is in meters per second
+	void advance(ChorusMotion motion, float deltaSeconds, float speed, float anchorDistance) {
+		using R = juce::MathConstants<float>;
+		switch (resolve(motion)) {
+			case ChorusMotion::Drift:
+				//two slow, unrelated wobbles so the path doesn't repeat too obviously
+				phaseA = std::fmod(phaseA + deltaSeconds * speed * driftRateA, R::twoPi);
+				phaseB = std::fmod(phaseB + deltaSeconds * speed * driftRateB, R::twoPi);
+				break;
+
+			case ChorusMotion::Circle:
+				//angular speed from linear speed, so close voices orbit faster
+				orbit = std::fmod(orbit + direction * deltaSeconds * speed / anchorDistance, R::twoPi);
+				break;
+
+			case ChorusMotion::FlyBy: {
+				const float halfLength = getFlyByHalfLength(anchorDistance);
+				if (!hasPath) {
+					//start somewhere along the path, so the first pass isn't the same for every voice
+					pathPosition = (phaseA / R::twoPi * 2.0f - 1.0f) * halfLength;
+					hasPath = true;
+				}
+				pathPosition += deltaSeconds * speed;
+				if (pathPosition > halfLength) {
+					//flew out of range, come back the other way
+					pathPosition = -halfLength;
+					direction = -direction;
+				}
+				break;
+			}
+
+			default:
+				break;
+		}
+	}
+
+
+	//where the voice is right now, given where it was placed
+	void getPosition(ChorusMotion motion, float anchorDistance, float anchorAngle, float& distance, float& angle) const {
+		distance = anchorDistance;
+		angle = anchorAngle;
+
+		switch (resolve(motion)) {
+			case ChorusMotion::Drift:
+				distance = anchorDistance + driftDistance * std::sin(phaseA);
+				angle = anchorAngle + driftAngle * std::sin(phaseB);
+				break;
+
+			case ChorusMotion::Circle:
+				angle = anchorAngle + orbit;
+				break;
+
+			case ChorusMotion::FlyBy: {
+				//the anchor is the closest point of the path. the path runs perpendicular to it
+				const float x = anchorDistance * std::cos(anchorAngle) - direction * pathPosition * std::sin(anchorAngle);
+				const float y = anchorDistance * std::sin(anchorAngle) + direction * pathPosition * std::cos(anchorAngle);
+				distance = std::sqrt(x * x + y * y);
+				angle = std::atan2(y, x);
+				break;
+			}
+
+			default:
+				break;
+		}
+
+		distance = juce::jlimit(minDistance, maxDistance, distance);
+		angle = std::fmod(angle, juce::MathConstants<float>::twoPi);
+		if (angle < 0.0f) angle += juce::MathConstants<float>::twoPi;
+	}
+
+
+	//true if this voice actually moves
+	static bool isMoving(ChorusMotion motion) { return motion != ChorusMotion::Static; }
+
+
+private:
+	ChorusMotion resolve(ChorusMotion motion) const {
+		return motion == ChorusMotion::Mixed ? mixedMotion : motion;
+	}
+
+	//half the length of a fly-by path, so that both ends sit at maxDistance
+	static float getFlyByHalfLength(float anchorDistance) {
+		return std::sqrt(juce::jmax(0.0f, maxDistance * maxDistance - anchorDistance * anchorDistance));
+	}
+
+
+	float phaseA = 0.0f, phaseB = 0.0f;	//drift wobbles
+	float orbit = 0.0f;					//circle, radians travelled
+	float pathPosition = 0.0f;			//fly-by, meters along the path
+	bool hasPath = false;
+	float direction = 1.0f;
+	ChorusMotion mixedMotion = ChorusMotion::Drift;
+
+	static constexpr float driftRateA = 0.31f;	//radians per meter travelled
+	static constexpr float driftRateB = 0.23f;
+	static constexpr float driftDistance = 1.5f;	//meters
+	static constexpr float driftAngle = 0.4f;		//radians
+};
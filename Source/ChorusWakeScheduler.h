@@ -0,0 +1,134 @@
+/*
+  ==============================================================================
+
+    ChorusWakeScheduler.h
+    Created: 20 Oct 2026 3:26:54pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+
+//keeps track of when cooling down chorus voices should start singing again.
+//
+//every cooling voice burns through its cooldown at the same rate, and that rate only depends on
+//how many voices are playing (and the correlation). so instead of counting each voice down every
+//block, there's one shared "cooldown clock" that runs at that rate, and each voice just remembers
+//what the clock will read when it wakes up. those wake times never change, so they sit in a
+//min-heap: scheduling or waking a voice is O(log n), and when the playing set changes only the
+//clock's rate changes, nothing per voice.
+class ChorusWakeScheduler {
+public:
+	//allocates for up to maxVoices. call off the audio thread
+	void prepare(int maxVoices) {
+		heap.reserve((size_t)maxVoices * 2 + 1);
+		generations.assign((size_t)maxVoices, 0);
+		isScheduled.assign((size_t)maxVoices, false);
+		reset();
+	}
+
+
+	//forgets every scheduled voice, and restarts the clock. doesn't allocate
+	void reset() {
+		heap.clear();
+		std::fill(isScheduled.begin(), isScheduled.end(), false);
+		numScheduled = 0;
+		clock = 0.0;
+	}
+
+
+	//voice starts cooling down for this many samples (at a rate of 1). replaces any earlier wake
+	void schedule(int voiceIndex, double cooldownSamples) {
+		cancel(voiceIndex);
+		if (heap.size() == heap.capacity()) compact();
+		heap.push_back({ clock + cooldownSamples, voiceIndex, ++generations[voiceIndex] });
+		std::push_heap(heap.begin(), heap.end(), later);
+		isScheduled[voiceIndex] = true;
+		numScheduled++;
+	}
+
+
+	//voice won't be woken up. its heap entry is left behind and skipped when it reaches the top
+	void cancel(int voiceIndex) {
+		if (!isScheduled[voiceIndex]) return;
+		generations[voiceIndex]++;
+		isScheduled[voiceIndex] = false;
+		numScheduled--;
+	}
+
+
+	//runs the cooldown clock forward. rate is how many cooldown samples pass per real sample
+	void advance(int numSamples, double rate) {
+		clock += (double)numSamples * rate;
+	}
+
+
+	//real samples until the next voice wakes, if the rate stays the same.
+	//0 means something is due now, and a huge number means nothing is coming
+	int getSamplesUntilNextWake(double rate) {
+		dropStaleEntries();
+		if (heap.empty() || rate <= 0.0) return std::numeric_limits<int>::max();
+		const double remaining = heap.front().wakeTime - clock;
+		if (remaining <= epsilon) return 0;
+		return (int)juce::jmin(std::ceil(remaining / rate), (double)std::numeric_limits<int>::max());
+	}
+
+
+	//pops the next voice that's due, if there is one
+	bool popDue(int& voiceIndex) {
+		dropStaleEntries();
+		if (heap.empty() || heap.front().wakeTime > clock + epsilon) return false;
+		voiceIndex = heap.front().voiceIndex;
+		std::pop_heap(heap.begin(), heap.end(), later);
+		heap.pop_back();
+		isScheduled[voiceIndex] = false;
+		numScheduled--;
+		return true;
+	}
+
+
+	//how many voices are waiting to wake up (the ones cooling down)
+	int getNumScheduled() const { return numScheduled; }
+
+
+private:
+	struct Entry {
+		double wakeTime;	//on the cooldown clock
+		int voiceIndex;
+		unsigned int generation;
+	};
+
+	static bool later(const Entry& a, const Entry& b) { return a.wakeTime > b.wakeTime; }
+
+	bool isStale(const Entry& entry) const {
+		return !isScheduled[entry.voiceIndex] || entry.generation != generations[entry.voiceIndex];
+	}
+
+	void dropStaleEntries() {
+		while (!heap.empty() && isStale(heap.front())) {
+			std::pop_heap(heap.begin(), heap.end(), later);
+			heap.pop_back();
+		}
+	}
+
+	//gets rid of cancelled entries buried in the heap. only needed when it fills up
+	void compact() {
+		heap.erase(std::remove_if(heap.begin(), heap.end(), [this](const Entry& e) { return isStale(e); }), heap.end());
+		std::make_heap(heap.begin(), heap.end(), later);
+	}
+
+
+	static constexpr double epsilon = 1.0e-6;
+
+	std::vector<Entry> heap;
+	std::vector<unsigned int> generations;	//per voice. bumped to invalidate its old entry
+	std::vector<bool> isScheduled;
+	int numScheduled = 0;
+	double clock = 0.0;
+};
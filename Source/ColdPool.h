@@ -0,0 +1,96 @@
+/*
+  ==============================================================================
+
+    ColdPool.h
+    Created: 20 Oct 2026 9:03:55pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <memory>
+#include <vector>
+
+
+//pool for the big per voice objects (resonators, spatializers) that most voices don't need
+//most of the time. voices borrow one while they need it and hand it back after, so there are
+//only ever as many as are actually in use, instead of one baked into every voice.
+//
+//the message thread builds the objects and passes them over (see SynthVoice::timerCallback),
+//everything else happens on the audio thread and never allocates. the pool remembers how many
+//were borrowed at once, so spares nobody has needed in a while can be handed back and freed
+//(see SynthVoice::trimIdleSlots)
+template <typename T>
+class ColdPool {
+public:
+	//call off the audio thread. the pool never holds more than this
+	void reserve(int capacity) {
+		objects.reserve((size_t)capacity);
+		freeList.reserve((size_t)capacity);
+	}
+
+
+	//audio thread. takes ownership of an object built on the message thread
+	void add(T* object) {
+		jassert(objects.size() < objects.capacity());
+		objects.emplace_back(object);
+		freeList.push_back(object);
+	}
+
+
+	//audio thread. nullptr if every object is already borrowed
+	T* acquire() {
+		if (freeList.empty()) return nullptr;
+		T* object = freeList.back();
+		freeList.pop_back();
+		highWaterMark = juce::jmax(highWaterMark, getNumInUse());
+		return object;
+	}
+
+
+	//audio thread. hands an object back. nullptr is ignored
+	void release(T* object) {
+		if (object != nullptr) freeList.push_back(object);
+	}
+
+
+	//audio thread. takes one unborrowed object back out of the pool, for trimming.
+	//the caller owns it after this (and should free it off the audio thread). nullptr if none are free
+	T* removeSpare() {
+		if (freeList.empty()) return nullptr;
+		T* object = freeList.back();
+		freeList.pop_back();
+		for (auto it = objects.begin(); it != objects.end(); ++it) {
+			if (it->get() != object) continue;
+			it->release();
+			objects.erase(it);	//never reallocates, so still fine on the audio thread
+			break;
+		}
+		return object;
+	}
+
+
+	//the most objects borrowed at once since the last resetHighWaterMark
+	int getHighWaterMark() const { return highWaterMark; }
+	void resetHighWaterMark() { highWaterMark = getNumInUse(); }
+
+
+	//for when the audio thread isn't running (prepareToPlay)
+	template <typename Function>
+	void forEach(Function&& function) {
+		for (auto& object : objects) function(*object);
+	}
+
+
+	int getNumCreated() const { return (int)objects.size(); }
+	int getNumFree() const { return (int)freeList.size(); }
+	int getNumInUse() const { return getNumCreated() - getNumFree(); }
+
+
+private:
+	std::vector<std::unique_ptr<T>> objects;
+	std::vector<T*> freeList;
+	int highWaterMark = 0;
+};
@@ -0,0 +1,120 @@
+/*
+  ==============================================================================
+
+    CounterRng.h
+    Created: 20 Oct 2026 7:12:40pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <cstdint>
+
+
+//counter based random numbers (philox 4x32-10).
+//the nth number of a stream is just a hash of (seed, stream, n), so there's no hidden state
+//shared between callers: every voice and every song instance gets its own stream from the same
+//seed, they never affect each other, and the same seed always gives the same numbers.
+//that's what makes renders reproducible, and lets streams be used from different threads
+//without locks. it's also cheap to copy, and fills blocks of values 4 at a time
+class CounterRng {
+public:
+	CounterRng() { reset(0, 0); }
+	CounterRng(uint64_t seed, uint64_t stream) { reset(seed, stream); }
+
+
+	//restarts at the beginning of this seed's stream
+	void reset(uint64_t seed, uint64_t stream) {
+		key = { (uint32_t)seed, (uint32_t)(seed >> 32) };
+		counter = { 0, 0, (uint32_t)stream, (uint32_t)(stream >> 32) };
+		outputIndex = 4;
+	}
+
+
+	//streams are 64 bits. the top byte says what the stream is for (see SynthVoice::RngStream),
+	//the next three bytes who it's for, and the low half which instance
+	static uint64_t makeStream(uint8_t kind, uint32_t owner, uint32_t instance) {
+		return ((uint64_t)kind << 56) | ((uint64_t)(owner & 0xFFFFFF) << 32) | instance;
+	}
+
+
+	uint32_t nextUInt32() {
+		if (outputIndex >= 4) refill();
+		return output[(size_t)outputIndex++];
+	}
+
+
+	//0 to 1, never 1
+	float nextFloat() {
+		return (float)(nextUInt32() >> 8) * (1.0f / 16777216.0f);
+	}
+
+
+	//0 to maxExclusive - 1
+	int nextInt(int maxExclusive) {
+		jassert(maxExclusive > 0);
+		return (int)(((uint64_t)nextUInt32() * (uint64_t)maxExclusive) >> 32);
+	}
+
+
+	//min to max, both included
+	int nextInt(int min, int max) {
+		const uint64_t range = (uint64_t)((int64_t)max - (int64_t)min + 1);
+		return (int)((int64_t)min + (int64_t)(((uint64_t)nextUInt32() * range) >> 32));
+	}
+
+
+	//batch version of nextFloat. runs whole philox blocks straight into dest
+	void fillFloats(float* dest, int numValues) {
+		int i = 0;
+		while (i < numValues && outputIndex < 4) dest[i++] = nextFloat();
+		for (; i + 4 <= numValues; i += 4) {
+			refill();
+			for (int j = 0; j < 4; j++) dest[i + j] = (float)(output[(size_t)j] >> 8) * (1.0f / 16777216.0f);
+			outputIndex = 4;
+		}
+		while (i < numValues) dest[i++] = nextFloat();
+	}
+
+
+private:
+	static void mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo) {
+		const uint64_t product = (uint64_t)a * (uint64_t)b;
+		hi = (uint32_t)(product >> 32);
+		lo = (uint32_t)product;
+	}
+
+
+	//hashes the current counter into the next four outputs, then steps the counter
+	void refill() {
+		std::array<uint32_t, 4> c = counter;
+		std::array<uint32_t, 2> k = key;
+		for (int round = 0; round < 10; round++) {
+			uint32_t hi0, lo0, hi1, lo1;
+			mulhilo(multiplier0, c[0], hi0, lo0);
+			mulhilo(multiplier1, c[2], hi1, lo1);
+			c = { hi1 ^ c[1] ^ k[0], lo1, hi0 ^ c[3] ^ k[1], lo0 };
+			k[0] += weyl0;
+			k[1] += weyl1;
+		}
+		output = c;
+		outputIndex = 0;
+
+		//the low 64 bits are the position in the stream
+		if (++counter[0] == 0) ++counter[1];
+	}
+
+
+	static constexpr uint32_t multiplier0 = 0xD2511F53;
+	static constexpr uint32_t multiplier1 = 0xCD9E8D57;
+	static constexpr uint32_t weyl0 = 0x9E3779B9;
+	static constexpr uint32_t weyl1 = 0xBB67AE85;
+
+	std::array<uint32_t, 4> counter{};	//position (low half) and stream (high half)
+	std::array<uint32_t, 2> key{};		//the seed
+	std::array<uint32_t, 4> output{};
+	int outputIndex = 4;
+};
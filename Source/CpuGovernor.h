@@ -0,0 +1,117 @@
+/*
+  ==============================================================================
+
+    CpuGovernor.h
+    Created: 21 Oct 2026 8:21:45pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+
+
+//watches how long each block takes to render, against how long the host gives us (the block's
+//length in real time). when it gets close, quality steps down a tier at a time, and steps back up
+//once there's been plenty of room for a while. the gap between the two thresholds, and waiting
+//longer to recover than to degrade, keeps it from flapping between tiers.
+//
+//the processor times the blocks, SynthVoice reads the tier, and the header shows it
+class CpuGovernor {
+public:
+	//each tier keeps everything the ones before it did
+	enum class Tier {
+		Full = 0,
+		CullQuiet,				//the farthest (quietest) chorus voices stop starting new songs
+		NoDistantResonators,	//far voices skip their resonator
+		SparseReverb,			//fewer early reflection taps
+		PanOnly					//spatializers only pan and attenuate. no shelf filter, no HRTF
+	};
+	static constexpr int numTiers = 5;
+
+
+	void prepare(double newSampleRate) {
+		sampleRate = newSampleRate;
+		smoothedLoad = 0.0f;
+		blocksOver = 0;
+		samplesUnder = 0;
+		tier = 0;
+		headroom = 1.0f;
+	}
+
+
+	//audio thread. call around the whole block
+	void beginBlock() {
+		blockStartTicks = juce::Time::getHighResolutionTicks();
+	}
+
+
+	void endBlock(int numSamples) {
+		if (numSamples <= 0 || sampleRate <= 0.0) return;
+		const double elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - blockStartTicks);
+		const float load = (float)(elapsed * sampleRate / (double)numSamples);
+
+		//rises fast, falls slow. one slow block shouldn't drop a tier, a run of them should
+		smoothedLoad += (load - smoothedLoad) * (load > smoothedLoad ? riseSmoothing : fallSmoothing);
+		headroom = juce::jmax(0.0f, 1.0f - smoothedLoad);
+
+		int current = tier.load(std::memory_order_relaxed);
+		if (smoothedLoad > degradeLoad) {
+			samplesUnder = 0;
+			if (++blocksOver >= blocksBeforeDegrade && current < numTiers - 1) {
+				current++;
+				blocksOver = 0;
+			}
+		}
+		else if (smoothedLoad < recoverLoad) {
+			blocksOver = 0;
+			samplesUnder += numSamples;
+			if (samplesUnder >= (int)(sampleRate * secondsBeforeRecover) && current > 0) {
+				current--;
+				samplesUnder = 0;
+			}
+		}
+		else {
+			blocksOver = 0;
+			samplesUnder = 0;
+		}
+		tier.store(current, std::memory_order_relaxed);
+	}
+
+
+	//any thread
+	Tier getTier() const { return static_cast<Tier>(tier.load(std::memory_order_relaxed)); }
+	bool isAtLeast(Tier t) const { return tier.load(std::memory_order_relaxed) >= (int)t; }
+	float getHeadroom() const { return headroom.load(std::memory_order_relaxed); }	//0 to 1, of the block's real time
+
+
+	static juce::String getTierName(Tier t) {
+		switch (t) {
+			case Tier::Full: return "Full";
+			case Tier::CullQuiet: return "Culling";
+			case Tier::NoDistantResonators: return "No far resonators";
+			case Tier::SparseReverb: return "Sparse reverb";
+			case Tier::PanOnly: return "Pan only";
+		}
+		return {};
+	}
+
+
+private:
+	static constexpr float degradeLoad = 0.75f;		//of the real time budget
+	static constexpr float recoverLoad = 0.45f;
+	static constexpr int blocksBeforeDegrade = 3;
+	static constexpr double secondsBeforeRecover = 2.0;
+	static constexpr float riseSmoothing = 0.5f;
+	static constexpr float fallSmoothing = 0.05f;
+
+	double sampleRate = 44100.0;
+	juce::int64 blockStartTicks = 0;
+	float smoothedLoad = 0.0f;
+	int blocksOver = 0;
+	int samplesUnder = 0;
+	std::atomic<int> tier{ 0 };
+	std::atomic<float> headroom{ 1.0f };
+};
@@ -0,0 +1,137 @@
+/*
+  ==============================================================================
+
+    DopplerDelayBank.h
+    Created: 19 Oct 2026 6:05:31pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <vector>
+
+
+
+//propagation delay for every chorus voice, in one object. each voice (lane) has its own
+//fractional delay line, and its delay follows its distance from the listener. when the
+//distance changes the delay gets ramped until the next target, which is what makes the doppler shift.
+//
+//all lanes are processed together: the delay lines are stored side by side, and each sample
+//gathers the four taps for every lane first, then runs the cubic lagrange interpolation across
+//the lanes in one tight loop over contiguous arrays, so the compiler can vectorize it.
+class DopplerDelayBank {
+public:
+	static constexpr int maxLanes = 64;
+	static constexpr float speedOfSound = 343.0f;	//meters per second. chorus distances are in meters
+
+	//call from prepareToPlay, not from the audio thread
+	void prepare(double newSampleRate, float maxDistanceMeters) {
+		sampleRate = newSampleRate;
+		const int maxDelaySamples = (int)std::ceil(maxDistanceMeters / speedOfSound * sampleRate) + 4;
+		lineLength = juce::nextPowerOfTwo(maxDelaySamples);
+		lineMask = lineLength - 1;
+		lines.assign((size_t)maxLanes * lineLength, 0.0f);
+		reset();
+	}
+
+
+	void reset() {
+		std::fill(lines.begin(), lines.end(), 0.0f);
+		currentDelay.fill(0.0f);
+		delayStep.fill(0.0f);
+		primed.fill(false);
+		writePos = 0;
+	}
+
+
+	//delay (in samples) that a voice at this distance should have
+	float getDelayForDistance(float distanceMeters) const {
+		return distanceMeters / speedOfSound * (float)sampleRate;
+	}
+
+
+	//sets where a lane's delay should be after rampSamples more samples have been processed.
+	//the first time a lane is used it jumps straight there, so voices don't swoop in
+	void setTargetDelay(int lane, float delaySamples, int rampSamples) {
+		jassert(lane >= 0 && lane < maxLanes);
+		const float target = juce::jlimit(1.0f, (float)(lineLength - 3), delaySamples);
+		if (!primed[lane]) {
+			currentDelay[lane] = target;
+			primed[lane] = true;
+		}
+		delayStep[lane] = (target - currentDelay[lane]) / (float)juce::jmax(1, rampSamples);
+	}
+
+
+	//forgets a lane's delay, so the next setTargetDelay jumps instead of ramping
+	void releaseLane(int lane) {
+		primed[lane] = false;
+	}
+
+
+	//=====================================================================================
+
+
+	//delays every lane in place. laneBuffers[v] is voice v's mono buffer.
+	//each lane's delay moves linearly toward its target, at the rate set by setTargetDelay
+	void process(float* const* laneBuffers, int numLanes, int numSamples) {
+		jassert(numLanes <= maxLanes);
+		if (numSamples <= 0) return;
+
+		for (int s = 0; s < numSamples; s++) {
+			//write, advance the delay, and gather the four taps around each read position
+			for (int v = 0; v < numLanes; v++) {
+				float* line = lines.data() + (size_t)v * lineLength;
+				line[writePos] = laneBuffers[v][s];
+
+				currentDelay[v] += delayStep[v];
+				const float readPos = (float)writePos - currentDelay[v];
+				const float readFloor = std::floor(readPos);
+				const int index = (int)readFloor;
+				frac[v] = readPos - readFloor;
+
+				tapM1[v] = line[(index - 1) & lineMask];
+				tap0[v] = line[index & lineMask];
+				tap1[v] = line[(index + 1) & lineMask];
+				tap2[v] = line[(index + 2) & lineMask];
+			}
+
+			//third order lagrange interpolation, across all lanes at once
+			for (int v = 0; v < numLanes; v++) {
+				const float d = frac[v];
+				const float dm1 = d - 1.0f;
+				const float dm2 = d - 2.0f;
+				const float dp1 = d + 1.0f;
+				out[v] = -tapM1[v] * d * dm1 * dm2 * (1.0f / 6.0f)
+					+ tap0[v] * dp1 * dm1 * dm2 * 0.5f
+					- tap1[v] * dp1 * d * dm2 * 0.5f
+					+ tap2[v] * dp1 * d * dm1 * (1.0f / 6.0f);
+			}
+
+			for (int v = 0; v < numLanes; v++) {
+				laneBuffers[v][s] = out[v];
+			}
+
+			writePos = (writePos + 1) & lineMask;
+		}
+	}
+
+
+private:
+	std::vector<float> lines;	//maxLanes delay lines, back to back
+	int lineLength = 0;
+	int lineMask = 0;
+	int writePos = 0;
+	double sampleRate = 44100.0;
+
+	//per lane state. kept as separate contiguous arrays so the lane loops vectorize
+	std::array<float, maxLanes> currentDelay{};
+	std::array<float, maxLanes> delayStep{};
+	std::array<bool, maxLanes> primed{};
+
+	//scratch lanes for the interpolation
+	std::array<float, maxLanes> frac{}, tapM1{}, tap0{}, tap1{}, tap2{}, out{};
+};
@@ -0,0 +1,393 @@
+/*
+  ==============================================================================
+
+    EarlyReflections.h
+    Created: 19 Oct 2026 8:40:12pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <vector>
+
+
+
+//shared environment for the chorus. instead of every voice owning a reverb (which puts each insect
+//in its own identical room), voices are summed into azimuth/distance bins, and each bin gets the
+//early reflections for a source at its center. reflection taps are found with the image source
+//method when the environment changes, and applied with one tapped delay line per bin.
+//a single late reverb is fed from all the bins, more for farther ones.
+//
+//cost is per occupied bin, not per voice, and bins that have been silent longer than the
+//longest tap are skipped.
+class EarlyReflections {
+public:
+	//matches the "Chorus Environment" choices
+	enum class Environment {
+		ForestFloor = 0,	//soft ground, scattered tree trunks
+		Field,				//open ground, a far off treeline
+		Room				//big hard walled room (barn, greenhouse)
+	};
+
+	static constexpr int numAzimuthBins = 16;
+	static constexpr int numDistanceBins = 4;
+	static constexpr int numBins = numAzimuthBins * numDistanceBins;
+	static constexpr int maxTaps = 16;
+	static constexpr float maxReflectionDelaySeconds = 0.15f;
+	static constexpr float minDistance = 5.0f;	//same range as the spatializer
+	static constexpr float maxDistance = 15.0f;
+
+
+	//call from prepareToPlay, not from the audio thread
+	void prepare(double newSampleRate, int maximumBlockSize) {
+		sampleRate = newSampleRate;
+		maxBlockSize = maximumBlockSize;
+
+		lineLength = juce::nextPowerOfTwo((int)std::ceil(maxReflectionDelaySeconds * sampleRate) + maxBlockSize);
+		lineMask = lineLength - 1;
+		for (auto& bin : bins) {
+			bin.line.assign(lineLength, 0.0f);
+			bin.blockInput.assign(maxBlockSize, 0.0f);
+		}
+		reflectionBus.setSize(2, maxBlockSize);
+		lateBus.setSize(2, maxBlockSize);
+
+		lateReverb.prepare({ sampleRate, (juce::uint32)maxBlockSize, 2 });
+		buildTaps();
+		reset();
+	}
+
+
+	void reset() {
+		for (auto& bin : bins) {
+			std::fill(bin.line.begin(), bin.line.end(), 0.0f);
+			bin.hasBlockInput = false;
+			bin.samplesSinceInput = lineLength;
+		}
+		writePos = 0;
+		lateTailSamples = (int)(sampleRate * lateTailSeconds);
+		lowpassState.fill(0.0f);
+		lateReverb.reset();
+	}
+
+
+	//rebuilds the taps if the environment changed. cheap enough to call every block
+	void setEnvironment(Environment newEnvironment) {
+		if (newEnvironment == environment) return;
+		environment = newEnvironment;
+		buildTaps();
+	}
+
+
+	//=====================================================================================
+
+
+	//bin for a voice at this angle (spatializer convention) and normalized distance (0 to 1)
+	int getBin(float angle, float normalizedDistance) const {
+		float wrapped = std::fmod(angle, juce::MathConstants<float>::twoPi);
+		if (wrapped < 0.0f) wrapped += juce::MathConstants<float>::twoPi;
+		const int azimuthBin = juce::jlimit(0, numAzimuthBins - 1, (int)(wrapped / juce::MathConstants<float>::twoPi * numAzimuthBins));
+		const int distanceBin = juce::jlimit(0, numDistanceBins - 1, (int)(normalizedDistance * numDistanceBins));
+		return distanceBin * numAzimuthBins + azimuthBin;
+	}
+
+
+	//sums a voice into a bin. call for every voice, then process() once
+	void addToBin(int binIndex, const float* samples, int numSamples) {
+		jassert(numSamples <= maxBlockSize);
+		auto& bin = bins[binIndex];
+		if (!bin.hasBlockInput) {
+			juce::FloatVectorOperations::copy(bin.blockInput.data(), samples, numSamples);
+			bin.hasBlockInput = true;
+		}
+		else {
+			juce::FloatVectorOperations::add(bin.blockInput.data(), samples, numSamples);
+		}
+	}
+
+
+	//0 to 1. how many of each bin's taps get read. turned down by the cpu governor
+	void setTapDensity(float density) {
+		tapDensity = juce::jlimit(0.0f, 1.0f, density);
+	}
+
+
+	//runs every bin's taps, and the late reverb, and adds the result to outBuffer's first two channels
+	void process(juce::AudioBuffer<float>& outBuffer, int outputStartSample, int numSamples) {
+		jassert(numSamples <= maxBlockSize);
+		reflectionBus.clear(0, 0, numSamples);
+		reflectionBus.clear(1, 0, numSamples);
+		lateBus.clear(0, 0, numSamples);
+		bool anyLateInput = false;
+
+		for (int b = 0; b < numBins; b++) {
+			auto& bin = bins[b];
+
+			//write this block into the bin's line
+			if (bin.hasBlockInput) {
+				writeToLine(bin, bin.blockInput.data(), numSamples);
+				juce::FloatVectorOperations::addWithMultiply(lateBus.getWritePointer(0), bin.blockInput.data(), bin.lateSend, numSamples);
+				bin.samplesSinceInput = 0;
+				bin.hasBlockInput = false;
+				anyLateInput = true;
+			}
+			else if (bin.samplesSinceInput < lineLength) {
+				writeSilenceToLine(bin, numSamples);
+				bin.samplesSinceInput += numSamples;
+			}
+			else {
+				continue;	//nothing left in the line that a tap could reach
+			}
+
+			//read each tap as a contiguous (maybe wrapped) run, and pan it into the reflection bus.
+			//the floor is always the first tap, so thinning keeps it
+			const int tapsToRead = juce::jmax(1, (int)std::ceil((float)bin.numTaps * tapDensity));
+			for (int t = 0; t < juce::jmin(tapsToRead, bin.numTaps); t++) {
+				const auto& tap = bin.taps[t];
+				readTap(bin, tap.delaySamples, tap.gainLeft, reflectionBus.getWritePointer(0), numSamples);
+				readTap(bin, tap.delaySamples, tap.gainRight, reflectionBus.getWritePointer(1), numSamples);
+			}
+		}
+		writePos = (writePos + numSamples) & lineMask;
+
+		//surfaces soak up the highs. one pole lowpass on the summed reflections
+		for (int ch = 0; ch < 2; ch++) {
+			auto* data = reflectionBus.getWritePointer(ch);
+			float z = lowpassState[ch];
+			for (int s = 0; s < numSamples; s++) {
+				z += lowpassCoefficient * (data[s] - z);
+				data[s] = z;
+			}
+			lowpassState[ch] = z;
+		}
+
+		//late reverb. fed in mono, comes out stereo
+		lateBus.copyFrom(1, 0, lateBus, 0, 0, numSamples);
+		if (anyLateInput || lateTailSamples < (int)(sampleRate * lateTailSeconds)) {
+			lateTailSamples = anyLateInput ? 0 : lateTailSamples + numSamples;
+			juce::dsp::AudioBlock<float> block(lateBus.getArrayOfWritePointers(), 2, (size_t)numSamples);
+			juce::dsp::ProcessContextReplacing<float> context(block);
+			lateReverb.process(context);
+			reflectionBus.addFrom(0, 0, lateBus, 0, 0, numSamples);
+			reflectionBus.addFrom(1, 0, lateBus, 1, 0, numSamples);
+		}
+
+		const int numOutputs = juce::jmin(2, outBuffer.getNumChannels());
+		for (int ch = 0; ch < numOutputs; ch++) {
+			outBuffer.addFrom(ch, outputStartSample, reflectionBus, ch, 0, numSamples);
+		}
+	}
+
+
+private:
+	struct Tap {
+		int delaySamples = 1;	//relative to the direct sound
+		float gainLeft = 0.0f;
+		float gainRight = 0.0f;
+	};
+
+	struct Bin {
+		std::vector<float> line;
+		std::vector<float> blockInput;
+		bool hasBlockInput = false;
+		int samplesSinceInput = 0;
+		std::array<Tap, maxTaps> taps;
+		int numTaps = 0;
+		float lateSend = 0.0f;
+	};
+
+	//a point in meters. x is right, y is front, z is up (listener's ears at listenerHeight)
+	struct Point3 { float x, y, z; };
+
+
+	void writeToLine(Bin& bin, const float* samples, int numSamples) {
+		const int firstRun = juce::jmin(numSamples, lineLength - writePos);
+		juce::FloatVectorOperations::copy(bin.line.data() + writePos, samples, firstRun);
+		if (firstRun < numSamples) juce::FloatVectorOperations::copy(bin.line.data(), samples + firstRun, numSamples - firstRun);
+	}
+
+	//the line is still being read by the taps, so the old samples we pass over have to be cleared
+	void writeSilenceToLine(Bin& bin, int numSamples) {
+		const int firstRun = juce::jmin(numSamples, lineLength - writePos);
+		juce::FloatVectorOperations::clear(bin.line.data() + writePos, firstRun);
+		if (firstRun < numSamples) juce::FloatVectorOperations::clear(bin.line.data(), numSamples - firstRun);
+	}
+
+
+	void readTap(const Bin& bin, int delaySamples, float gain, float* dest, int numSamples) const {
+		if (gain == 0.0f) return;
+		const int readPos = (writePos - delaySamples) & lineMask;
+		const int firstRun = juce::jmin(numSamples, lineLength - readPos);
+		juce::FloatVectorOperations::addWithMultiply(dest, bin.line.data() + readPos, gain, firstRun);
+		if (firstRun < numSamples) juce::FloatVectorOperations::addWithMultiply(dest + firstRun, bin.line.data(), gain, numSamples - firstRun);
+	}
+
+
+	//=====================================================================================
+
+
+	//image source reflections for a source at every bin center
+	void buildTaps() {
+		if (sampleRate <= 0.0) return;
+
+		for (int b = 0; b < numBins; b++) {
+			auto& bin = bins[b];
+			const int azimuthBin = b % numAzimuthBins;
+			const int distanceBin = b / numAzimuthBins;
+			const float angle = ((float)azimuthBin + 0.5f) * juce::MathConstants<float>::twoPi / (float)numAzimuthBins;
+			const float normalizedDistance = ((float)distanceBin + 0.5f) / (float)numDistanceBins;
+			const float distance = juce::jmap(normalizedDistance, minDistance, maxDistance);
+			const Point3 source{ distance * std::cos(angle), distance * std::sin(angle), sourceHeight };
+
+			bin.numTaps = 0;
+			//same curve the per-voice reverb used: farther voices are wetter
+			bin.lateSend = juce::jmap(normalizedDistance, 0.1f, 0.8f) * getLateLevel();
+
+			//every environment has a floor
+			addImage(bin, source, { source.x, source.y, -source.z }, getFloorReflectivity());
+
+			switch (environment) {
+				case Environment::ForestFloor:
+					//trunks scatter a little energy back from wherever they stand
+					for (const auto& trunk : treePositions) {
+						addScatterer(bin, source, { trunk.x, trunk.y, listenerHeight }, trunkReflectivity);
+					}
+					break;
+
+				case Environment::Field:
+					//a treeline way out in front, for a faint slapback
+					addImage(bin, source, { source.x, 2.0f * treelineDistance - source.y, source.z }, treelineReflectivity);
+					break;
+
+				case Environment::Room: {
+					//first order walls and ceiling, plus each wall bounced off the floor
+					const std::array<Point3, 5> images = {
+						Point3{ 2.0f * roomRight - source.x, source.y, source.z },
+						Point3{ 2.0f * roomLeft - source.x, source.y, source.z },
+						Point3{ source.x, 2.0f * roomFront - source.y, source.z },
+						Point3{ source.x, 2.0f * roomBack - source.y, source.z },
+						Point3{ source.x, source.y, 2.0f * roomHeight - source.z }
+					};
+					for (const auto& image : images) {
+						addImage(bin, source, image, wallReflectivity);
+						addImage(bin, source, { image.x, image.y, -image.z }, wallReflectivity * getFloorReflectivity());
+					}
+					break;
+				}
+			}
+		}
+
+		//absorption gets darker in the softer environments
+		const float cutoff = environment == Environment::ForestFloor ? 2500.0f
+			: environment == Environment::Field ? 5000.0f : 7000.0f;
+		lowpassCoefficient = 1.0f - std::exp(-juce::MathConstants<float>::twoPi * cutoff / (float)sampleRate);
+
+		juce::Reverb::Parameters params;
+		params.roomSize = environment == Environment::Room ? 0.75f : environment == Environment::ForestFloor ? 0.55f : 0.3f;
+		params.damping = environment == Environment::Room ? 0.4f : 0.8f;
+		params.wetLevel = 1.0f;		//the bins' sends already set the level
+		params.dryLevel = 0.0f;
+		params.width = 1.0f;
+		lateReverb.setParameters(params);
+	}
+
+
+	//adds the tap for a mirrored image of the source
+	void addImage(Bin& bin, const Point3& source, const Point3& image, float reflectivity) {
+		const float direct = getDistanceToListener(source);
+		const float path = getDistanceToListener(image);
+		addTap(bin, direct, path, reflectivity, std::atan2(image.y, image.x));
+	}
+
+
+	//adds the tap for sound bouncing off something small (a trunk) on its way to the listener
+	void addScatterer(Bin& bin, const Point3& source, const Point3& scatterer, float reflectivity) {
+		const float dx = source.x - scatterer.x, dy = source.y - scatterer.y, dz = source.z - scatterer.z;
+		const float path = std::sqrt(dx * dx + dy * dy + dz * dz) + getDistanceToListener(scatterer);
+		addTap(bin, getDistanceToListener(source), path, reflectivity, std::atan2(scatterer.y, scatterer.x));
+	}
+
+
+	void addTap(Bin& bin, float directLength, float pathLength, float reflectivity, float angle) {
+		if (bin.numTaps >= maxTaps) return;
+		const float delaySeconds = (pathLength - directLength) / speedOfSound;
+		if (delaySeconds <= 0.0f || delaySeconds >= maxReflectionDelaySeconds) return;
+
+		//spherical spreading relative to the direct path
+		const float gain = reflectivity * directLength / pathLength;
+
+		//constant power pan from the direction the reflection arrives from
+		const float pan = juce::jlimit(-1.0f, 1.0f, std::cos(angle));
+		const float panAngle = (pan + 1.0f) * juce::MathConstants<float>::pi * 0.25f;
+
+		auto& tap = bin.taps[bin.numTaps++];
+		tap.delaySamples = juce::jmax(1, (int)std::round(delaySeconds * sampleRate));
+		tap.gainLeft = gain * std::cos(panAngle);
+		tap.gainRight = gain * std::sin(panAngle);
+	}
+
+
+	float getDistanceToListener(const Point3& p) const {
+		const float dz = p.z - listenerHeight;
+		return std::sqrt(p.x * p.x + p.y * p.y + dz * dz);
+	}
+
+	float getFloorReflectivity() const {
+		switch (environment) {
+			case Environment::ForestFloor:	return 0.3f;	//leaf litter
+			case Environment::Field:		return 0.5f;	//grass
+			case Environment::Room:			return 0.8f;	//concrete
+		}
+		return 0.5f;
+	}
+
+	float getLateLevel() const {
+		switch (environment) {
+			case Environment::ForestFloor:	return 0.5f;
+			case Environment::Field:		return 0.2f;
+			case Environment::Room:			return 0.7f;
+		}
+		return 0.5f;
+	}
+
+
+	//=====================================================================================
+
+
+	static constexpr float speedOfSound = 343.0f;
+	static constexpr float listenerHeight = 1.6f;
+	static constexpr float sourceHeight = 0.3f;		//bugs in the grass
+	static constexpr float trunkReflectivity = 0.25f;
+	static constexpr float treelineDistance = 45.0f;
+	static constexpr float treelineReflectivity = 0.35f;
+	static constexpr float wallReflectivity = 0.7f;
+	static constexpr float roomLeft = -17.0f, roomRight = 21.0f;	//off center, so left and right don't arrive together
+	static constexpr float roomBack = -18.0f, roomFront = 16.0f;
+	static constexpr float roomHeight = 6.0f;
+	static constexpr float lateTailSeconds = 4.0f;	//how long the late reverb keeps running after the last input
+
+	//fixed trunk positions, so the forest is the same forest every time
+	static constexpr std::array<Point3, 7> treePositions = { {
+		{ 4.0f, 9.0f, 0.0f }, { -7.5f, 5.0f, 0.0f }, { 11.0f, -3.0f, 0.0f }, { -3.0f, -12.0f, 0.0f },
+		{ 16.0f, 12.0f, 0.0f }, { -14.0f, -6.0f, 0.0f }, { 6.0f, -17.0f, 0.0f }
+	} };
+
+	std::array<Bin, numBins> bins;
+	Environment environment = Environment::ForestFloor;
+	double sampleRate = 0.0;
+	int maxBlockSize = 0;
+	int lineLength = 0;
+	int lineMask = 0;
+	int writePos = 0;
+	int lateTailSamples = 0;
+
+	juce::AudioBuffer<float> reflectionBus;
+	juce::AudioBuffer<float> lateBus;
+	juce::dsp::Reverb lateReverb;
+	float lowpassCoefficient = 1.0f;
+	std::array<float, 2> lowpassState{};
+	float tapDensity = 1.0f;
+};
@@ -13,13 +13,17 @@
 #include <JuceHeader.h>
 #include "Evaluator.h"
 #include "SongCodeCompiler.h"
+#include "SongBounds.h"
 
 #include <vector>
 #include <string>
 #include <sstream>
 #include <algorithm>
-#include <random>
 #include <map>
+#include <set>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
 
 
 using namespace std;
@@ -27,6 +31,53 @@ using namespace std;
 
 
 
+/*
+-------------------============ NODE ARENA ============-------------------
+*/
+
+void* SongCodeArena::allocate(size_t size) {
+    constexpr size_t alignment = alignof(std::max_align_t);
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    bytesUsed += size;
+
+    //anything too big for a block gets one of its own, at the front, out of the way of the current block
+    if (size > blockSize) {
+        blocks.emplace(blocks.begin(), new char[size]);
+        return blocks.front().get();
+    }
+    if (size > blockSize - blockUsed) {
+        blocks.emplace_back(new char[blockSize]);
+        blockUsed = 0;
+    }
+
+    void* memory = blocks.back().get() + blockUsed;
+    blockUsed += size;
+    return memory;
+}
+
+
+//each node is preceded by the arena it came from (or nullptr for the heap), so delete knows what to do
+namespace {
+    constexpr size_t nodeHeaderSize = alignof(std::max_align_t);
+}
+
+void* SongCodeNode::operator new(size_t size) {
+    SongCodeArena* arena = SongCodeArena::getCurrent();
+    char* memory = static_cast<char*>(arena != nullptr ? arena->allocate(size + nodeHeaderSize) : ::operator new(size + nodeHeaderSize));
+    *reinterpret_cast<SongCodeArena**>(memory) = arena;
+    return memory + nodeHeaderSize;
+}
+
+void SongCodeNode::operator delete(void* node) noexcept {
+    if (node == nullptr) return;
+    char* memory = static_cast<char*>(node) - nodeHeaderSize;
+    if (*reinterpret_cast<SongCodeArena**>(memory) == nullptr) ::operator delete(memory);
+}
+
+
+
+
 
 /*
 -------------------============ LEXER CLASS ============-------------------
@@ -34,14 +85,16 @@ Turns the raw songcode string into a vector of tokens for the parser
 */
 
 class SongCodeLexer {
-    std::string input;
+    std::string_view input;
     size_t pos = 0;
+    size_t end = 0;
+    size_t commentStart = 0;   //the $ that opened the comment we're in
 
 
     bool parseNumber(std::vector<Token>& tokens, ErrorInfo* errorInfo) {
         size_t start = pos;
         //consume consecutive nums
-        while (pos < input.size() && std::isdigit(input[pos])) pos++;
+        while (pos < end && std::isdigit(input[pos])) pos++;
 
         //should never occur
         if (pos == start) {
@@ -49,87 +102,108 @@ class SongCodeLexer {
             return false;
         }
         
-        std::string numStr = input.substr(start, pos - start);
-        try {
-            int num = std::stoi(numStr);
-            tokens.emplace_back(TokenType::Num, num, start, pos - 1, numStr);
-            return true;
+        std::string_view numStr = input.substr(start, pos - start);
+        int64_t num = 0;
+        for (char digit : numStr) {
+            num = num * 10 + (digit - '0');
+            if (num > std::numeric_limits<int>::max()) {
+                setErrorInfo(errorInfo, "Error: Invalid number format " + std::string(numStr), start, pos - 1, std::string(numStr));
+                return false;
+            }
         }
-        catch (...) {
-            setErrorInfo(errorInfo, "Error: Invalid number format " + numStr, start, pos - 1, numStr);
-            return false;
+        tokens.emplace_back(TokenType::Num, (int)num, start, pos - 1, numStr);
+        return true;
+    }
+
+
+    //from inside a comment to just past its closing $, or the end. true if it closed. start is where its token starts
+    bool skipComment(size_t start, std::vector<Token>& tokens, bool keepComments) {
+        bool closed = false;
+        while (pos < end) {
+            if (input[pos++] == '$') {
+                closed = true;
+                break;
+            }
         }
+        if (keepComments && pos > start) tokens.emplace_back(TokenType::Comment, start, pos - 1, input.substr(start, pos - start));
+        return closed;
     }
 
 
 public:
 
 
-    explicit SongCodeLexer(const std::string& input) : input(input) {}
+    explicit SongCodeLexer(std::string_view input) : input(input), end(input.size()) {}
 
     std::vector<Token> tokenize(ErrorInfo* errorInfo) {
         std::vector<Token> tokens;
+        tokens.reserve(input.size() / 2 + 1);
+
+        bool inComment = false;
+        if (!lexRange(0, input.size(), inComment, tokens, errorInfo, false)) return {};
+        if (inComment) {
+            setErrorInfo(errorInfo, "Error: Unclosed comment", commentStart, input.size() - 1, "");
+            return {};
+        }
+        return tokens;
+    }
+
+
+    //lexes input[start, rangeEnd). inComment is whether that starts inside a $comment$, and is left at whether it
+    //ends inside one, so a piece of the songcode (a line) can be lexed on its own. comments are only tokens
+    //if keepComments. stops at the first error, keeping the tokens before it
+    bool lexRange(size_t start, size_t rangeEnd, bool& inComment, std::vector<Token>& tokens, ErrorInfo* errorInfo, bool keepComments) {
+        pos = start;
+        end = std::min(rangeEnd, input.size());
 
-        while (pos < input.size()) {
+        if (inComment) {
+            commentStart = pos;
+            inComment = !skipComment(pos, tokens, keepComments);
+        }
+
+        while (pos < end) {
             //skip whitespace
-            while (pos < input.size() && std::isspace(input[pos])) pos++;
-            if (pos >= input.size()) break;
+            while (pos < end && std::isspace(input[pos])) pos++;
+            if (pos >= end) break;
 
-            const size_t tokenStart = pos;
             char current = input[pos];
 
-            //handle comments
+            //handle comments. they never reach the parser
             if (current == '$') {
-                size_t start = pos++;
-                bool closed = false;
-
-                while (pos < input.size()) {
-                    if (input[pos] == '$') {
-                        closed = true;
-                        pos++;
-                        break;
-                    }
-                    pos++;
-                }
-
-                if (!closed) {
-                    setErrorInfo(errorInfo, "Error: Unclosed comment", tokenStart, input.size() - 1, "");
-                    return {};
-                }
-                std::string commentText = input.substr(start, pos - start);
-                tokens.emplace_back(TokenType::Comment, start, pos - 1, commentText);
+                commentStart = pos++;
+                inComment = !skipComment(commentStart, tokens, keepComments);
                 continue;
             }
 
             //handle numbers
             if (std::isdigit(current)) {
-                if (!parseNumber(tokens, errorInfo)) return {};
+                if (!parseNumber(tokens, errorInfo)) return false;
                 continue; //parseNumber implicitly advances pos, so you must skip
             }
 
             //handle keywords/variables
             else if (std::isalpha(current)) {
-                size_t start = pos;
+                size_t wordStart = pos;
 
                 //gobble up chars
-                while (pos < input.size() && std::isalnum(input[pos])) pos++;
+                while (pos < end && std::isalnum(input[pos])) pos++;
 
-                std::string word = input.substr(start, pos - start);
+                std::string_view word = input.substr(wordStart, pos - wordStart);
                 const size_t tokenEnd = pos - 1;
 
                 //match keyword strings
                 if (word == "pattern") {
-                    tokens.emplace_back(TokenType::Pattern, start, tokenEnd, word);
+                    tokens.emplace_back(TokenType::Pattern, wordStart, tokenEnd, word);
                 }
                 else if (word == "rand") {
-                    tokens.emplace_back(TokenType::Rand, start, tokenEnd, word);
+                    tokens.emplace_back(TokenType::Rand, wordStart, tokenEnd, word);
                 }
                 else if (word == "let") {
-                    tokens.emplace_back(TokenType::Let, start, tokenEnd, word);
+                    tokens.emplace_back(TokenType::Let, wordStart, tokenEnd, word);
                 }
                 else {
                     //no match, must be var
-                    tokens.emplace_back(TokenType::Id, word, start, tokenEnd, word);
+                    tokens.emplace_back(TokenType::Id, word, wordStart, tokenEnd, word);
                 }
 
                 continue;
@@ -151,18 +225,14 @@ public:
                     default: {
                         std::string charStr(1, current);
                         setErrorInfo(errorInfo, "Error: Unexpected character: " + charStr, pos, pos, charStr);
-                        return {};
+                        return false;
                     }
                 }
             }
             pos++;
         }
 
-        //remove comments from the final token stream
-        tokens.erase(std::remove_if(tokens.begin(), tokens.end(),
-            [](const Token& t) {return t.type == TokenType::Comment;  }), tokens.end());
-
-        return tokens;
+        return true;
     }
 
 
@@ -196,13 +266,13 @@ public:
                 str += "(" + std::to_string(token.numValue) + ")";
                 break;
             case TokenType::Id:
-                str += "('" + token.idValue + "')";
+                str += "('" + std::string(token.idValue) + "')";
                 break;
             default:
                 break;
             }
             //add in start/end indices
-            str += "Orig: " + token.text + " ";
+            str += "Orig: " + std::string(token.text) + " ";
             str += "(" + std::to_string(token.startPos) + ", " + std::to_string(token.endPos) + ").";
             juce::Logger::writeToLog(str);
         }
@@ -232,6 +302,16 @@ of arguments I have to pass over and over
 
 //--------------------------------- HELPERS ---------------------------------
 
+//sets a new node's span, from the token at start to the last one consumed
+template <typename Node>
+Node* Parser::spanned(Node* node, std::vector<Token>::const_iterator start) const {
+    if (start != end && it != tokens.begin()) {
+        node->startPos = start->startPos;
+        node->endPos = (it - 1)->endPos;
+    }
+    return node;
+}
+
 //returns next token in the stream. 
 //optional offset argument for checking tokens past the next one
 std::optional<Token> Parser::lookahead(int offset) const {
@@ -309,6 +389,8 @@ bool Parser::parse_statement() {
 //then do the rest of the expressions
 //then do the evaluator
 bool Parser::parse_note() {
+    const auto start = it;
+
     //match frequency
     ExprPtr freqExpr = parse_additive_expr();
 	if (!freqExpr) return false;
@@ -316,12 +398,14 @@ bool Parser::parse_note() {
     //match duration
     ExprPtr durExpr = parse_additive_expr();
     if (!durExpr) return false;
-	AST->statements.push_back(new NoteNode(freqExpr, durExpr));
+	AST->statements.push_back(spanned(new NoteNode(freqExpr, durExpr), start));
     return true;
 }
 
 
 bool Parser::parse_pattern() {
+    const auto start = it;
+
 	//match pattern keyword
     if (!match_token(TokenType::Pattern)) {
         if (lookahead().has_value()) return false;
@@ -356,12 +440,14 @@ bool Parser::parse_pattern() {
 		return false;
 	}
 
-    AST->statements.push_back(new PatternNode(subBeats));
+    AST->statements.push_back(spanned(new PatternNode(subBeats), start));
     return true;
 }
 
 
 bool Parser::parse_let() {
+    const auto start = it;
+
     //match let
 	if (!match_token(TokenType::Let)) {
 		if (lookahead().has_value()) return false;
@@ -384,12 +470,14 @@ bool Parser::parse_let() {
 	ExprPtr value = parse_additive_expr();
 	if (!value) return false;   //error set by recursive call
 
-	AST->statements.push_back(new LetNode(idToken->idValue, value));
+	AST->statements.push_back(spanned(new LetNode(std::string(idToken->idValue), value), start));
 	return true;
 }
 
 
 bool Parser::parse_loop() {
+    const auto start = it;
+
     //match open bracket [
     if (!match_token(TokenType::LStart)) {
         setErrorInfo(errorInfo, "Error: expected loop open bracket", lookahead(-1)->startPos, lookahead(-1)->endPos, "");
@@ -437,12 +525,13 @@ bool Parser::parse_loop() {
     }
 
     std::reverse(loopBody.begin(), loopBody.end());
-	AST->statements.push_back(new LoopNode(loopBody, iterations));
+	AST->statements.push_back(spanned(new LoopNode(loopBody, iterations), start));
     return true;
 }
 
 
 ExprPtr Parser::parse_additive_expr() {
+    const auto start = it;
 	ExprPtr left = parse_multiplicative_expr();
     ExprPtr right = nullptr;
 	if (!left) return nullptr;
@@ -459,7 +548,7 @@ ExprPtr Parser::parse_additive_expr() {
 			setErrorInfo(errorInfo, "Error: expected an expression after +/-", lookahead()->startPos, lookahead()->endPos, "");
 			return nullptr;
         }
-        left = new AdditiveExprNode(left, right, opType == TokenType::Add ? AdditiveExprNode::Op::Add : AdditiveExprNode::Op::Subtract);
+        left = spanned(new AdditiveExprNode(left, right, opType == TokenType::Add ? AdditiveExprNode::Op::Add : AdditiveExprNode::Op::Subtract), start);
 	}
 
     return left;
@@ -467,6 +556,7 @@ ExprPtr Parser::parse_additive_expr() {
 
 
 ExprPtr Parser::parse_multiplicative_expr() {
+    const auto start = it;
     ExprPtr left = parse_primary_expr();
     ExprPtr right = nullptr;
     if (!left) return nullptr;
@@ -482,7 +572,7 @@ ExprPtr Parser::parse_multiplicative_expr() {
             setErrorInfo(errorInfo, "Error: expected an expression after operation", lookahead()->startPos, lookahead()->endPos, "");
             return nullptr;
         }
-        left = new MultiplicativeExprNode(left, right, opType == TokenType::Mul ? MultiplicativeExprNode::Op::Multiply : MultiplicativeExprNode::Op::Divide);
+        left = spanned(new MultiplicativeExprNode(left, right, opType == TokenType::Mul ? MultiplicativeExprNode::Op::Multiply : MultiplicativeExprNode::Op::Divide), start);
     }
 
     return left;
@@ -490,18 +580,19 @@ ExprPtr Parser::parse_multiplicative_expr() {
 
 
 ExprPtr Parser::parse_primary_expr() {
+    const auto start = it;
     auto next = lookahead();
     //parse ints
     if (next.has_value() && next->type == TokenType::Num) {
         int value = next->numValue; 
         match_token(TokenType::Num);
-        return new PrimaryExprNode(value);
+        return spanned(new PrimaryExprNode(value), start);
     }
     //parse variables
 	else if (next.has_value() && next->type == TokenType::Id) {
-		std::string varName = next->idValue;
+		std::string varName(next->idValue);
 		match_token(TokenType::Id);
-		return new PrimaryExprNode(varName);
+		return spanned(new PrimaryExprNode(varName), start);
 	}
     //parse rands
     else if (next.has_value() && next->type == TokenType::Rand) {
@@ -528,7 +619,7 @@ ExprPtr Parser::parse_primary_expr() {
             return nullptr;
         }
 
-		return new RandomNode(min, max);
+		return spanned(new RandomNode(min, max), start);
     }
 	//parse grouped expressions
 	else if (next.has_value() && next->type == TokenType::ParStart) {
@@ -545,7 +636,7 @@ ExprPtr Parser::parse_primary_expr() {
 			return nullptr;
 		}
 
-		return new PrimaryExprNode(grouped);
+		return spanned(new PrimaryExprNode(grouped), start);
 	}
     else {
         if (!next.has_value() && lookahead(-1).has_value()) {
@@ -713,7 +804,7 @@ ScriptPtr createRandomAST() {
 * Parses a scriptnode into a list of song elements (notes, patterns)
 */
 
-int evaluateExpr(const ExprPtr expr, std::map<std::string, float>* env, ErrorInfo* errorInfo) {
+int evaluateExpr(const ExprPtr expr, std::map<std::string, float>* env, ErrorInfo* errorInfo, CounterRng* rng) {
     if (!expr) {
         setErrorInfo(errorInfo, "Error: null expression node encountered", 0, 0, "");
         return -1;
@@ -721,14 +812,14 @@ int evaluateExpr(const ExprPtr expr, std::map<std::string, float>* env, ErrorInf
 
     //evaluate additive expression
     if (auto* additive = dynamic_cast<AdditiveExprNode*>(expr.get())) {
-        int left_val = evaluateExpr(additive->left, env, errorInfo);
+        int left_val = evaluateExpr(additive->left, env, errorInfo, rng);
         if (errorInfo->message != "") return -1;
-        int right_val = evaluateExpr(additive->right, env, errorInfo);
+        int right_val = evaluateExpr(additive->right, env, errorInfo, rng);
         if (errorInfo->message != "") return -1;
 
         switch (additive->op) {
-        case AdditiveExprNode::Add: return left_val + right_val;
-        case AdditiveExprNode::Subtract: return left_val - right_val;
+        case AdditiveExprNode::Add: return songAdd(left_val, right_val);
+        case AdditiveExprNode::Subtract: return songSubtract(left_val, right_val);
         default:
             setErrorInfo(errorInfo, "Error: unknown additive operator", 0, 0, "");
             return -1;
@@ -737,14 +828,19 @@ int evaluateExpr(const ExprPtr expr, std::map<std::string, float>* env, ErrorInf
 
 	//evaluate multiplicative expressions
 	else if (auto* multiplicative = dynamic_cast<MultiplicativeExprNode*>(expr.get())) {
-		int left_val = evaluateExpr(multiplicative->left, env, errorInfo);
+		int left_val = evaluateExpr(multiplicative->left, env, errorInfo, rng);
 		if (errorInfo->message != "") return -1;
-		int right_val = evaluateExpr(multiplicative->right, env, errorInfo);
+		int right_val = evaluateExpr(multiplicative->right, env, errorInfo, rng);
 		if (errorInfo->message != "") return -1;
 
 		switch (multiplicative->op) {
-		case MultiplicativeExprNode::Multiply: return left_val * right_val;
-		case MultiplicativeExprNode::Divide: return left_val / right_val;
+		case MultiplicativeExprNode::Multiply: return songMultiply(left_val, right_val);
+		case MultiplicativeExprNode::Divide:
+			if (right_val == 0) {
+				setErrorInfo(errorInfo, "Error: division by zero", 0, 0, "");
+				return -1;
+			}
+			return songDivide(left_val, right_val);
 		default:
 			setErrorInfo(errorInfo, "Error: unknown multiplicative operator", 0, 0, "");
 			return -1;
@@ -768,7 +864,7 @@ int evaluateExpr(const ExprPtr expr, std::map<std::string, float>* env, ErrorInf
             return it->second;
         }
         if (inty->kind == PrimaryExprNode::Grouped) {
-            return evaluateExpr(inty->groupedExpr, env, errorInfo);
+            return evaluateExpr(inty->groupedExpr, env, errorInfo, rng);
         }
         setErrorInfo(errorInfo, "Error: can't parse primary expression", 0, 0, "");
         return -1;
@@ -776,13 +872,13 @@ int evaluateExpr(const ExprPtr expr, std::map<std::string, float>* env, ErrorInf
 
 	//evaluate random expressions
 	 else if (auto* rand = dynamic_cast<RandomNode*>(expr.get())) {
-		int min = evaluateExpr(rand->min, env, errorInfo);
+		int min = evaluateExpr(rand->min, env, errorInfo, rng);
 		if (errorInfo->message != "") return -1;
-		int max = evaluateExpr(rand->max, env, errorInfo);
+		int max = evaluateExpr(rand->max, env, errorInfo, rng);
 		if (errorInfo->message != "") return -1;
-        static std::mt19937 gen(std::time(nullptr));
-        static std::uniform_int_distribution<> dis(0, std::numeric_limits<int>::max());
-        return min + dis(gen) % (max - min + 1);
+        //every caller passes its own stream, so there's nothing shared between evaluations
+        if (max < min) std::swap(min, max);
+        return rng->nextInt(min, max);
 	}
 	 else {
 		setErrorInfo(errorInfo, "Error: unknown expression type", 0, 0, "");
@@ -792,12 +888,12 @@ int evaluateExpr(const ExprPtr expr, std::map<std::string, float>* env, ErrorInf
 }
 
 //usually returns 1 statement, but can return 0 to more than 1 statements (for loops)
-std::vector<SongElement> evaluateStatement(StatementPtr statement, std::map<std::string, float>* env, ErrorInfo* errorInfo, float* lastFreq) {
+std::vector<SongElement> evaluateStatement(StatementPtr statement, std::map<std::string, float>* env, ErrorInfo* errorInfo, float* lastFreq, CounterRng* rng) {
     //notes
     if (auto note = dynamic_cast<NoteNode*>(statement.get())) {
-        int freq = evaluateExpr(note->frequency, env, errorInfo);
+        int freq = evaluateExpr(note->frequency, env, errorInfo, rng);
         if (errorInfo->message != "") return {};
-        int dur = evaluateExpr(note->duration, env, errorInfo);
+        int dur = evaluateExpr(note->duration, env, errorInfo, rng);
         if (errorInfo->message != "") return {};
         float oldLastFreq = *lastFreq;
         *lastFreq = freq;
@@ -808,7 +904,7 @@ std::vector<SongElement> evaluateStatement(StatementPtr statement, std::map<std:
     else if (auto pattern = dynamic_cast<PatternNode*>(statement.get())) {
         std::vector<uint8_t> patternVec;
         for (auto& subBeat : pattern->subBeats) {
-            int subBeatVal = evaluateExpr(subBeat, env, errorInfo);
+            int subBeatVal = evaluateExpr(subBeat, env, errorInfo, rng);
             if (errorInfo->message != "") return {};
             patternVec.push_back(subBeatVal);
         }
@@ -816,7 +912,7 @@ std::vector<SongElement> evaluateStatement(StatementPtr statement, std::map<std:
     }
     //lets
     else if (auto let = dynamic_cast<LetNode*>(statement.get())) {
-        float val = evaluateExpr(let->value, env, errorInfo);
+        float val = evaluateExpr(let->value, env, errorInfo, rng);
         //bind val to the variable name in the env
         if (errorInfo->message == "") {
 			(*env)[let->id] = val;      
@@ -826,12 +922,12 @@ std::vector<SongElement> evaluateStatement(StatementPtr statement, std::map<std:
     }
     //loops
     else if (auto loop = dynamic_cast<LoopNode*>(statement.get())) {
-        int iterations = evaluateExpr(loop->iterations, env, errorInfo);
+        int iterations = evaluateExpr(loop->iterations, env, errorInfo, rng);
         if (errorInfo->message != "") return {};
 		std::vector<SongElement> loopContents;
         for (int i = 0; i < iterations; i++) {
 			for (auto& stmt : loop->body) {
-				auto res = evaluateStatement(stmt, env, errorInfo, lastFreq);
+				auto res = evaluateStatement(stmt, env, errorInfo, lastFreq, rng);
 				if (errorInfo->message != "") return {};
                 //append the results into the AST in the correct order
 				loopContents.insert(loopContents.end(), res.begin(), res.end());
@@ -842,7 +938,7 @@ std::vector<SongElement> evaluateStatement(StatementPtr statement, std::map<std:
 }
 
 
-std::vector<SongElement> evaluateScript(const ScriptPtr script, std::map<std::string, float>* initialEnv, ErrorInfo* errorInfo) {
+std::vector<SongElement> evaluateScript(const ScriptPtr script, std::map<std::string, float>* initialEnv, ErrorInfo* errorInfo, CounterRng* rng) {
     if (!script) return {};
     std::vector<SongElement> song;
     std::map<std::string, float> env;
@@ -858,7 +954,7 @@ std::vector<SongElement> evaluateScript(const ScriptPtr script, std::map<std::st
 
     //go through each statement and evaluate it recursively
     for (auto cur : script->statements) {
-		auto res = evaluateStatement(cur, &env, errorInfo, &lastFreq);
+		auto res = evaluateStatement(cur, &env, errorInfo, &lastFreq, rng);
 		if (errorInfo->message != "") return {};
 		song.insert(song.end(), res.begin(), res.end());
     }
@@ -879,25 +975,301 @@ std::vector<SongElement> evaluateScript(const ScriptPtr script, std::map<std::st
 
 
 
+/*
+-------------------============ CONSTANT FOLDING ============-------------------
+Runs once, right after parsing. Anything that comes out the same for every instance
+of the song gets worked out here: arithmetic on numbers, and variables whose value
+is already known at that point in the script. Every instance after that only has
+the rands left to do.
+
+lets stay in (the resonator song can read them), and rands always stay, even
+rand(5 5), so instances draw the same numbers whether they were folded or not.
+Dividing by 0 is left for the evaluator to report.
+*/
+
+namespace {
+
+struct ConstantFolder {
+    std::map<std::string, int> known;   //variables with a known value at this point in the script
+
+    static bool isInteger(const ExprPtr& expr, int* value = nullptr) {
+        auto* primary = dynamic_cast<PrimaryExprNode*>(expr.get());
+        if (primary == nullptr || primary->kind != PrimaryExprNode::Integer) return false;
+        if (value != nullptr) *value = primary->integerValue;
+        return true;
+    }
+
+    //a folded number, keeping the span of the expression it replaces so errors still point at the songcode
+    static ExprPtr integer(int value, const ExprPtr& replaced) {
+        auto* node = new PrimaryExprNode(value);
+        node->startPos = replaced->startPos;
+        node->endPos = replaced->endPos;
+        return node;
+    }
+
+    //returns the folded expression. nodes are edited in place, so this is only for fresh ASTs
+    ExprPtr fold(const ExprPtr& expr) {
+        if (!expr) return expr;
+        int left, right;
+
+        if (auto* additive = dynamic_cast<AdditiveExprNode*>(expr.get())) {
+            additive->left = fold(additive->left);
+            additive->right = fold(additive->right);
+            if (!isInteger(additive->left, &left) || !isInteger(additive->right, &right)) return expr;
+            return integer(additive->op == AdditiveExprNode::Add ? songAdd(left, right) : songSubtract(left, right), expr);
+        }
+        if (auto* multiplicative = dynamic_cast<MultiplicativeExprNode*>(expr.get())) {
+            multiplicative->left = fold(multiplicative->left);
+            multiplicative->right = fold(multiplicative->right);
+            if (!isInteger(multiplicative->left, &left) || !isInteger(multiplicative->right, &right)) return expr;
+            if (multiplicative->op == MultiplicativeExprNode::Multiply) return integer(songMultiply(left, right), expr);
+            if (right == 0) return expr;
+            return integer(songDivide(left, right), expr);
+        }
+        if (auto* primary = dynamic_cast<PrimaryExprNode*>(expr.get())) {
+            if (primary->kind == PrimaryExprNode::Grouped) return fold(primary->groupedExpr);
+            if (primary->kind == PrimaryExprNode::Variable) {
+                auto it = known.find(primary->variableName);
+                if (it != known.end()) return integer(it->second, expr);
+            }
+            return expr;
+        }
+        if (auto* rand = dynamic_cast<RandomNode*>(expr.get())) {
+            rand->min = fold(rand->min);
+            rand->max = fold(rand->max);
+        }
+        return expr;
+    }
+
+    //every variable a list of statements might set, loops inside it included
+    static void collectAssigned(const std::vector<StatementPtr>& statements, std::set<std::string>& assigned) {
+        for (auto& statement : statements) {
+            if (auto* let = dynamic_cast<LetNode*>(statement.get())) assigned.insert(let->id);
+            else if (auto* loop = dynamic_cast<LoopNode*>(statement.get())) collectAssigned(loop->body, assigned);
+        }
+    }
+
+    void foldStatements(std::vector<StatementPtr>& statements) {
+        for (auto& statement : statements) {
+            if (auto* note = dynamic_cast<NoteNode*>(statement.get())) {
+                note->frequency = fold(note->frequency);
+                note->duration = fold(note->duration);
+            }
+            else if (auto* pattern = dynamic_cast<PatternNode*>(statement.get())) {
+                for (auto& subBeat : pattern->subBeats) subBeat = fold(subBeat);
+            }
+            else if (auto* let = dynamic_cast<LetNode*>(statement.get())) {
+                let->value = fold(let->value);
+                int value;
+                if (isInteger(let->value, &value)) known[let->id] = value;
+                else known.erase(let->id);
+            }
+            else if (auto* loop = dynamic_cast<LoopNode*>(statement.get())) {
+                loop->iterations = fold(loop->iterations);
+                //anything the body sets could hold last time round's value (or not be set, with 0 iterations),
+                //so it's unknown going in and coming out
+                std::set<std::string> assigned;
+                collectAssigned(loop->body, assigned);
+                for (auto& id : assigned) known.erase(id);
+                foldStatements(loop->body);
+                for (auto& id : assigned) known.erase(id);
+            }
+        }
+    }
+};
+
+}
+
+
+void foldConstants(ScriptPtr script) {
+    if (!script) return;
+    SongCodeArena::Scope scope(script->arena.get());
+    ConstantFolder folder;
+    folder.foldStatements(script->statements);
+}
+
+
+
+
+
+
+/*
+-------------------============ STATIC CHECKS ============-------------------
+Catches what would otherwise only turn up when the song is played, from the folded
+AST alone: variables read before they're definitely set, dividing by a constant 0,
+and pattern sub-beats that can't fit in a uint8_t. Rands whose numbers are the wrong
+way round only get a warning, since the evaluator swaps them and they play fine. Loops are looked at once rather than run, so it's linear in the
+length of the songcode however long the song it plays.
+
+The checks are conservative. Division by zero and sub-beats are only reported when
+they're wrong every time the song is played. But a variable only counts as set after
+a loop if the loop is sure to run at least once, and "sure" is whatever the bounds
+analysis can prove about the count (findLoopsThatAlwaysRun). So a song that always
+sets a variable, in a way the ranges can't show, can still be rejected. Errors that
+depend on the draws are left for the test run and the evaluator.
+*/
+
+namespace {
+
+struct StaticChecker {
+    std::set<std::string> assigned;     //variables definitely set at this point in the script
+    std::set<const LoopNode*> alwaysRun;    //loops sure to go round at least once, see findLoopsThatAlwaysRun
+    ErrorInfo* errorInfo;
+    std::string* warning = nullptr;     //the first one
+
+    bool fail(const std::string& message, const SongCodeNode& node) {
+        setErrorInfo(errorInfo, message, node.startPos, node.endPos, "");
+        return false;
+    }
+
+    static bool isSubBeat(int value) { return value >= 0 && value <= 255; }
+
+    bool runsAtLeastOnce(const LoopNode& loop) const { return alwaysRun.count(&loop) != 0; }
+
+    bool checkExpr(const ExprPtr& expr) {
+        if (!expr) return true;
+        int value;
+
+        if (auto* additive = dynamic_cast<AdditiveExprNode*>(expr.get())) {
+            return checkExpr(additive->left) && checkExpr(additive->right);
+        }
+        if (auto* multiplicative = dynamic_cast<MultiplicativeExprNode*>(expr.get())) {
+            if (!checkExpr(multiplicative->left) || !checkExpr(multiplicative->right)) return false;
+            if (multiplicative->op == MultiplicativeExprNode::Divide && ConstantFolder::isInteger(multiplicative->right, &value) && value == 0) {
+                return fail("Error: division by zero", *multiplicative->right);
+            }
+            return true;
+        }
+        if (auto* primary = dynamic_cast<PrimaryExprNode*>(expr.get())) {
+            if (primary->kind == PrimaryExprNode::Grouped) return checkExpr(primary->groupedExpr);
+            if (primary->kind == PrimaryExprNode::Variable && assigned.count(primary->variableName) == 0) {
+                return fail("Error: variable used before initialization: " + primary->variableName, *primary);
+            }
+            return true;
+        }
+        if (auto* rand = dynamic_cast<RandomNode*>(expr.get())) {
+            if (!checkExpr(rand->min) || !checkExpr(rand->max)) return false;
+            int min, max;
+            if (ConstantFolder::isInteger(rand->min, &min) && ConstantFolder::isInteger(rand->max, &max) && min > max
+                && warning != nullptr && warning->empty()) {
+                *warning = "Warning: rand's minimum is bigger than its maximum, so they'll be swapped";
+            }
+        }
+        return true;
+    }
+
+    //a sub-beat that's a number, or a rand between numbers, has to fit. anything else is up to the evaluator
+    bool checkSubBeat(const ExprPtr& subBeat) {
+        int value;
+        if (ConstantFolder::isInteger(subBeat, &value) && !isSubBeat(value)) {
+            return fail("Error: pattern values have to be from 0 to 255", *subBeat);
+        }
+        if (auto* rand = dynamic_cast<RandomNode*>(subBeat.get())) {
+            for (auto* bound : { &rand->min, &rand->max }) {
+                if (ConstantFolder::isInteger(*bound, &value) && !isSubBeat(value)) {
+                    return fail("Error: pattern values have to be from 0 to 255", **bound);
+                }
+            }
+        }
+        return true;
+    }
+
+    bool checkStatements(const std::vector<StatementPtr>& statements) {
+        for (auto& statement : statements) {
+            if (auto* note = dynamic_cast<NoteNode*>(statement.get())) {
+                if (!checkExpr(note->frequency) || !checkExpr(note->duration)) return false;
+            }
+            else if (auto* pattern = dynamic_cast<PatternNode*>(statement.get())) {
+                for (auto& subBeat : pattern->subBeats) {
+                    if (!checkExpr(subBeat) || !checkSubBeat(subBeat)) return false;
+                }
+            }
+            else if (auto* let = dynamic_cast<LetNode*>(statement.get())) {
+                if (!checkExpr(let->value)) return false;
+                assigned.insert(let->id);
+            }
+            else if (auto* loop = dynamic_cast<LoopNode*>(statement.get())) {
+                if (!checkExpr(loop->iterations)) return false;
+                //a loop that never runs can't go wrong. one that might not run doesn't definitely set anything
+                int iterations = 1;
+                if (ConstantFolder::isInteger(loop->iterations, &iterations) && iterations <= 0) continue;
+
+                const std::set<std::string> before = assigned;
+                if (!checkStatements(loop->body)) return false;
+                if (!runsAtLeastOnce(*loop)) assigned = before;
+            }
+        }
+        return true;
+    }
+};
+
+}
+
+
+bool checkSongcode(ScriptPtr script, ErrorInfo* errorInfo, const ScriptNode* variablesFrom, std::string* warning) {
+    if (!script) return false;
+    StaticChecker checker;
+    checker.errorInfo = errorInfo;
+    checker.warning = warning;
+    checker.alwaysRun = findLoopsThatAlwaysRun(script);
+    //the resonator song can read any of the main song's variables, as long as the main song got to setting them
+    if (variablesFrom != nullptr) ConstantFolder::collectAssigned(variablesFrom->statements, checker.assigned);
+    return checker.checkStatements(script->statements);
+}
+
+
+
+
+
+
 /*
 -------------------============ MAIN FUNCTIONS ============-------------------
 */
 
 
+static ScriptPtr parseTokens(const std::vector<Token>& tokens, std::unique_ptr<SongCodeArena> arena, ErrorInfo* errorInfo) {
+    SongCodeArena::Scope scope(arena.get());
+    Parser parser(tokens, errorInfo);
+    ScriptPtr ast = parser.parse();
+    if (ast == nullptr) return ast;     //whatever the parser made goes with the arena
+
+    ast->arena = std::move(arena);
+    if (errorInfo->message == "") foldConstants(ast);
+    return ast;
+}
+
+
 ScriptPtr generateAST(std::string& songcode, ErrorInfo *errorInfo) {
     SongCodeLexer lexer(songcode);
     auto lexerToks = lexer.tokenize(errorInfo);
-    Parser parser(lexerToks, errorInfo);
-    ScriptPtr ast = parser.parse();
+    return parseTokens(lexerToks, std::make_unique<SongCodeArena>(), errorInfo);
+}
 
-    juce::Logger::writeToLog("-------------AST-------------" + juce::String(lexerToks.size()));
-    juce::Logger::writeToLog(juce::String(astToString(ast)));
-    return ast;
+
+ScriptPtr generateAST(std::string& songcode, std::vector<Token>& tokens, ErrorInfo* errorInfo) {
+    const std::string_view text(songcode);
+    for (auto& token : tokens) {
+        if (token.endPos >= text.size() || token.startPos > token.endPos) {
+            setErrorInfo(errorInfo, "Error: tokens don't match the songcode", 0, 0, "");
+            return nullptr;
+        }
+        token.text = text.substr(token.startPos, token.endPos - token.startPos + 1);
+        if (token.type == TokenType::Id) token.idValue = token.text;
+    }
+    return parseTokens(tokens, std::make_unique<SongCodeArena>(), errorInfo);
+}
+
+
+bool lexSongcodeRange(std::string_view input, size_t start, size_t end, bool& inComment, std::vector<Token>& tokens, ErrorInfo* errorInfo, bool keepComments) {
+    SongCodeLexer lexer(input);
+    return lexer.lexRange(start, end, inComment, tokens, errorInfo, keepComments);
 }
 
 
-std::vector<SongElement> evaluateAST(ScriptPtr ast, ErrorInfo* errorInfo, std::map<std::string, float>* vars) {
-	auto song = evaluateScript(ast, vars, errorInfo);
+std::vector<SongElement> evaluateAST(ScriptPtr ast, ErrorInfo* errorInfo, std::map<std::string, float>* vars, CounterRng* rng) {
+	//no stream given (the editor previews), so use a one-off one
+	CounterRng fallbackRng((uint64_t)juce::Time::getHighResolutionTicks(), 0);
+	auto song = evaluateScript(ast, vars, errorInfo, rng != nullptr ? rng : &fallbackRng);
 	/*for (auto& elem : song) {
 		juce::Logger::writeToLog(elem.toString());
 	}*/
@@ -11,10 +11,13 @@
 #pragma once
 
 #include "SongCodeCompiler.h"
+#include "CounterRng.h"
 #include <JuceHeader.h>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <map>
+#include <memory>
 
 
 struct StatementNode;
@@ -48,6 +51,19 @@ inline void setErrorInfo(ErrorInfo* errorInfo, const std::string& message,
 }
 
 
+/*
+Songcode arithmetic
+Ints wrap round on overflow instead of being undefined, and INT_MIN / -1 wraps back to INT_MIN
+instead of trapping (which would take the host down with it). The tree walker, the constant folder
+and both bytecode machines all go through these, so they all get the same answers.
+Dividing by 0 is still the caller's to report
+*/
+inline int songAdd(int a, int b) { return (int)((unsigned)a + (unsigned)b); }
+inline int songSubtract(int a, int b) { return (int)((unsigned)a - (unsigned)b); }
+inline int songMultiply(int a, int b) { return (int)((unsigned)a * (unsigned)b); }
+inline int songDivide(int a, int b) { return b == -1 ? (int)(0u - (unsigned)a) : a / b; }
+
+
 
 /* -------------------============ LEXER TOKENS ============-------------------*/
 enum class TokenType {
@@ -70,20 +86,76 @@ enum class TokenType {
 };
 
 
+//the strings are views into the songcode being lexed, so tokens only live as long as it does
 struct Token {
     TokenType type;
     int numValue;
-    std::string idValue;    //variable name, if a var
-    std::string text;       //exact text of the token
+    std::string_view idValue;    //variable name, if a var
+    std::string_view text;       //exact text of the token
     size_t startPos;
     size_t endPos;
 
-    explicit Token(TokenType t, size_t s, size_t e, const std::string& txt) :
-        type(t), numValue(0), idValue(""), startPos(s), endPos(e), text(txt) {}
-    Token(TokenType t, int num, size_t s, size_t e, const std::string& txt) :
-        type(t), numValue(num), idValue(""), startPos(s), endPos(e), text(txt) {}
-    Token(TokenType t, const std::string& id, size_t s, size_t e, const std::string& txt) :
-        type(t), numValue(0), idValue(id), startPos(s), endPos(e), text(txt) {}
+    explicit Token(TokenType t, size_t s, size_t e, std::string_view txt) :
+        type(t), numValue(0), text(txt), startPos(s), endPos(e) {}
+    Token(TokenType t, int num, size_t s, size_t e, std::string_view txt) :
+        type(t), numValue(num), text(txt), startPos(s), endPos(e) {}
+    Token(TokenType t, std::string_view id, size_t s, size_t e, std::string_view txt) :
+        type(t), numValue(0), idValue(id), text(txt), startPos(s), endPos(e) {}
+};
+
+
+
+/*
+-------------------============ NODE ARENA ============-------------------
+
+The editor reparses on every keystroke, so the nodes of a script don't each get their
+own heap allocation. While a scope is open, new nodes are bumped out of its arena, and
+the script keeps the arena and frees the lot at once when it goes. Deleting a single
+arena node just runs its destructor.
+
+Nodes made with no scope open (createRandomAST) go on the heap like normal. Node
+refcounts aren't atomic: only the script's own count is, so scripts can still be
+passed between threads, but one script's nodes should only be touched by one thread at a time.
+*/
+class SongCodeArena {
+public:
+    SongCodeArena() = default;
+    SongCodeArena(const SongCodeArena&) = delete;
+    SongCodeArena& operator=(const SongCodeArena&) = delete;
+
+    void* allocate(size_t size);
+    size_t getBytesUsed() const { return bytesUsed; }
+
+    //nodes made on this thread while one of these is alive go in its arena. a null arena means the heap
+    class Scope {
+    public:
+        explicit Scope(SongCodeArena* arena) : previous(current) { current = arena; }
+        ~Scope() { current = previous; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        SongCodeArena* previous;
+    };
+
+    static SongCodeArena* getCurrent() { return current; }
+
+private:
+    static constexpr size_t blockSize = 16384;
+
+    static inline thread_local SongCodeArena* current = nullptr;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    size_t blockUsed = blockSize;
+    size_t bytesUsed = 0;
+};
+
+
+//every AST node. allocates from the current arena, if there is one
+struct SongCodeNode : public juce::SingleThreadedReferenceCountedObject {
+    size_t startPos = 0;    //the songcode it was parsed from, first to last character. for error spans
+    size_t endPos = 0;
+
+    static void* operator new(size_t size);
+    static void operator delete(void* node) noexcept;
 };
 
 
@@ -106,13 +178,13 @@ example.
 
 
 
-struct StatementNode : public juce::ReferenceCountedObject {
+struct StatementNode : public SongCodeNode {
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StatementNode)
     StatementNode() = default;
     virtual ~StatementNode() = default;
 };
 
-struct ExprNode : public juce::ReferenceCountedObject{
+struct ExprNode : public SongCodeNode {
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ExprNode)
     ExprNode() = default;
     virtual ~ExprNode() = default;
@@ -121,6 +193,8 @@ struct ExprNode : public juce::ReferenceCountedObject{
 //scriptnode is the main one. keeps track of the context
 struct ScriptNode : public juce::ReferenceCountedObject {
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ScriptNode)
+    //where the nodes live. declared first so it goes last, after the statements are released
+    std::unique_ptr<SongCodeArena> arena;
     //using a vector of statements instead of a statement list for simplicity here
     std::vector<StatementPtr> statements;
     ScriptNode() = default;
@@ -227,6 +301,7 @@ private:
     //parsing helpers
     bool match_token(TokenType expected);
     std::optional<Token> lookahead(int offset = 0) const;
+    template <typename Node> Node* spanned(Node* node, std::vector<Token>::const_iterator start) const;
 
     // Parsing methods
     bool parse_statement();
@@ -245,4 +320,24 @@ private:
 //implied nullptr for vars. If you don't provide a pointer to already-initialized variables, then they will be null
 ScriptPtr                generateAST(std::string& songcode, ErrorInfo* errorInfo);
 
-std::vector<SongElement> evaluateAST(ScriptPtr ast, ErrorInfo* errorInfo, std::map<std::string, float>* vars);
\ No newline at end of file
+//same, from tokens that were already lexed from songcode (the editors' token caches). only their types, values
+//and positions are used: their views get pointed into songcode here, so they can come from a copy of it
+ScriptPtr                generateAST(std::string& songcode, std::vector<Token>& tokens, ErrorInfo* errorInfo);
+
+//lexes input[start, end), for lexing a bit of songcode at a time. inComment is whether it starts inside a
+//$comment$, and comes back as whether it ends in one (an unclosed comment isn't an error here). comments
+//are only tokens if keepComments. false on an error, with the tokens before it
+bool                     lexSongcodeRange(std::string_view input, size_t start, size_t end, bool& inComment,
+                                          std::vector<Token>& tokens, ErrorInfo* errorInfo, bool keepComments);
+
+//works out everything that's the same for every instance of the song, in place. generateAST already does it
+void                     foldConstants(ScriptPtr script);
+
+//checks a folded script for errors that don't need it played to find (see STATIC CHECKS). false with errorInfo set
+//if there's one. the resonator song passes the main song as variablesFrom, since it can read its variables.
+//things that play but probably aren't what was meant go in warning, if it's given
+bool                     checkSongcode(ScriptPtr script, ErrorInfo* errorInfo, const ScriptNode* variablesFrom = nullptr, std::string* warning = nullptr);
+
+//rng is the stream that rand() draws from. pass one per voice/song instance for reproducible songs,
+//or leave it out for a fresh random one
+std::vector<SongElement> evaluateAST(ScriptPtr ast, ErrorInfo* errorInfo, std::map<std::string, float>* vars, CounterRng* rng = nullptr);
\ No newline at end of file
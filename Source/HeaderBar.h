@@ -14,7 +14,7 @@
 #include "PluginProcessor.h"
 #include "presetPanel.h"
 
-class HeaderBar : public juce::Component
+class HeaderBar : public juce::Component, private juce::Timer
 {
 public:
 	HeaderBar(BugsoundsAudioProcessor& p) : audioProcessor(p), presetPanel(p.getPresetManager())
@@ -42,8 +42,16 @@ public:
 
         //preset selector
         addAndMakeVisible(presetPanel);
+
+        //cpu readout. how much of each block's time is left, and what the governor has turned off
+        cpuLabel.setJustificationType(juce::Justification::centredRight);
+        cpuLabel.setFont(juce::Font(12.0f));
+        addAndMakeVisible(cpuLabel);
+        startTimerHz(4);
     }
 
+    ~HeaderBar() override { stopTimer(); }
+
     void resized() override
     {
         const auto container = getLocalBounds().reduced(4);
@@ -61,6 +69,9 @@ public:
 		//preset panel (middle)
         presetPanel.setBounds(container.withSizeKeepingCentre(350, getHeight() * (0.9f)));
 
+        //cpu readout (right)
+        cpuLabel.setBounds(bounds.removeFromRight(150).reduced(5));
+
     }
 
     void paint(juce::Graphics& g) override
@@ -70,8 +81,18 @@ public:
     }
 
 private:
+    void timerCallback() override {
+        const auto& governor = audioProcessor.getCpuGovernor();
+        const auto tier = governor.getTier();
+        juce::String text = "CPU headroom " + juce::String(juce::roundToInt(governor.getHeadroom() * 100.0f)) + "%";
+        if (tier != CpuGovernor::Tier::Full) text += "\n" + CpuGovernor::getTierName(tier);
+        cpuLabel.setText(text, juce::dontSendNotification);
+        cpuLabel.setColour(juce::Label::textColourId, tier == CpuGovernor::Tier::Full ? juce::Colours::white : juce::Colours::orange);
+    }
+
     BugsoundsAudioProcessor& audioProcessor;
     juce::ImageComponent logoComponent;
     juce::Label title;
+    juce::Label cpuLabel;
     PresetPanel presetPanel;
 };
\ No newline at end of file
@@ -0,0 +1,46 @@
+/*
+  ==============================================================================
+
+    LockFreeQueue.h
+    Created: 20 Oct 2026 11:02:17am
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+
+
+//fixed size single producer, single consumer queue. one thread pushes, one other thread pops,
+//and neither ever blocks or allocates. used to pass things between the message thread and the
+//audio thread. items are copied in and out, so keep them small (pointers, numbers)
+template <typename T, int capacity>
+class LockFreeQueue {
+public:
+	//returns false if the queue is full. the item is not added in that case
+	bool push(const T& item) {
+		auto scope = fifo.write(1);
+		if (scope.blockSize1 + scope.blockSize2 < 1) return false;
+		items[(size_t)(scope.blockSize1 > 0 ? scope.startIndex1 : scope.startIndex2)] = item;
+		return true;
+	}
+
+
+	//returns false if there was nothing to pop
+	bool pop(T& item) {
+		auto scope = fifo.read(1);
+		if (scope.blockSize1 + scope.blockSize2 < 1) return false;
+		item = items[(size_t)(scope.blockSize1 > 0 ? scope.startIndex1 : scope.startIndex2)];
+		return true;
+	}
+
+
+	int getNumReady() const { return fifo.getNumReady(); }
+
+
+private:
+	juce::AbstractFifo fifo{ capacity };
+	std::array<T, capacity> items{};
+};
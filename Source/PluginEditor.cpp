@@ -34,6 +34,8 @@ BugsoundsAudioProcessorEditor::BugsoundsAudioProcessorEditor(BugsoundsAudioProce
 
     addAndMakeVisible(helpCompendium);
     helpCompendium.setVisible(false);
+
+    songCompiler.onCompiled = [this](const SongcodeCompileThread::Result& result) { songsCompiled(result); };
 }
 
 BugsoundsAudioProcessorEditor::~BugsoundsAudioProcessorEditor()
@@ -104,51 +106,60 @@ void BugsoundsAudioProcessorEditor::resized()
 }
 
 
-//if this doesn't work implement a fifo queue for transferring the string w/out locks
+//compiles happen on the compile thread, from the editors' text and the tokens they already have for it
 void BugsoundsAudioProcessorEditor::freqCodeEditorHasChanged() {
-    juce::String freqSongCode = frequencyEditor.getText();
-    ErrorInfo errorInfo = {};
-	std::map<std::string, float> env;
-    std::vector<SongElement> songElements;
-
-    //compile check freq songcode 
-    juce::ReferenceCountedObjectPtr<ScriptNode> parsedSong = generateAST(freqSongCode.toStdString(), &errorInfo);
-    if (errorInfo.message != "") goto freqError;
-    //need to evaluate so we can report errors that only show up when you eval
-    songElements = evaluateAST(parsedSong, &errorInfo, &env);
-	if (errorInfo.message != "") goto freqError;
-
-
-    //compile check res songcode
-    if (*audioProcessor.apvts.getRawParameterValue("Resonator On")) {
-        juce::String resSongCode = resonatorEditor.getText();
-        juce::ReferenceCountedObjectPtr<ScriptNode> parsedResSong = generateAST(resSongCode.toStdString(), &errorInfo);
-        if (errorInfo.message != "") goto resError;
-		songElements = evaluateAST(parsedResSong, &errorInfo, &env);
-        if (errorInfo.message != "") goto resError;
-        //set resonator AST/error message
-        audioProcessor.setResAST(parsedResSong);
-        resonatorEditor.setError(nullptr);
+    const bool resonatorOn = audioProcessor.apvts.getRawParameterValue("Resonator On")->load() > 0.5f;
+    SongcodeCompileThread::Songcode song, res;
+    song.text = frequencyEditor.getText().toStdString();
+    song.lexed = frequencyEditor.getTokens(song.tokens);
+    if (resonatorOn) {
+        res.text = resonatorEditor.getText().toStdString();
+        res.lexed = resonatorEditor.getTokens(res.tokens);
+    }
+    songCompiler.compile(std::move(song), std::move(res), resonatorOn);
+}
+
+
+//the editors only call this once typing stops
+void BugsoundsAudioProcessorEditor::songcodeHasChanged() {
+    freqCodeEditorHasChanged();
+}
+
+
+//back on the message thread, for the latest edit only
+void BugsoundsAudioProcessorEditor::songsCompiled(const SongcodeCompileThread::Result& result) {
+    //freq song failed
+    if (result.songError.message != "") {
+        ErrorInfo errorInfo = result.songError;
+        frequencyEditor.setError(&errorInfo);
+        audioProcessor.setSongASTs(nullptr, nullptr);
+        return;
     }
-    
-	//now we can send the freq song, since res compiled
     frequencyEditor.setError(nullptr);
-    audioProcessor.setSongAST(parsedSong);
-    return;
-    
-    //two failure states. mostly the same, besides error message handling
-freqError:
-    frequencyEditor.setError(&errorInfo);
-    audioProcessor.setSongAST(nullptr);
-	audioProcessor.setResAST(nullptr);
-    return;
-
-resError:
-	frequencyEditor.setError(nullptr);
-	resonatorEditor.setError(&errorInfo);
-	audioProcessor.setSongAST(nullptr);
-    audioProcessor.setResAST(nullptr);
-	return;
+
+    //it compiled, but might ask for more than the voices can play in real time
+    const auto load = VoiceLoad::forSong(result.songBounds, audioProcessor.getPips(), audioProcessor.getSampleRate());
+    const auto warning = load.getBudgetWarning();
+    if (warning != "") frequencyEditor.setWarning(warning);
+    else if (result.songWarning != "") frequencyEditor.setWarning(result.songWarning);
+
+    //res song failed
+    if (result.resError.message != "") {
+        ErrorInfo errorInfo = result.resError;
+        resonatorEditor.setError(&errorInfo);
+        audioProcessor.setSongASTs(nullptr, nullptr);
+        return;
+    }
+
+    //both together, so the voices never get one new song and one old one. the res song is left alone while the resonator's off
+    if (result.resChecked) {
+        resonatorEditor.setError(nullptr);
+        if (result.resWarning != "") resonatorEditor.setWarning(result.resWarning);
+        audioProcessor.setSongASTs(result.songScript, result.resScript, result.songProgram, result.resProgram, result.songBounds);
+    }
+    else {
+        audioProcessor.setSongAST(result.songScript, result.songProgram, result.songBounds);
+    }
 }
 
 
@@ -19,6 +19,7 @@
 #include "HeaderBar.h"
 #include "ChorusKnobRack.h"
 #include "HelpCompendium.h"
+#include "SongcodeCompileThread.h"
 
 //==============================================================================
 /**
@@ -36,6 +37,7 @@ public:
     void disableResonatorEditor();
     void enableResonatorEditor();
     void toggleHelpCompendium(juce::String pageId);
+    void songcodeHasChanged();     //from the songcode editors, once an edit's settled
 
 private:
 
@@ -59,6 +61,10 @@ private:
 
     void freqCodeEditorHasChanged();
     void resonatorCodeEditorHasChanged();
+    void songsCompiled(const SongcodeCompileThread::Result& result);
+
+    //last, so it stops before anything its results go to
+    SongcodeCompileThread songCompiler;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BugsoundsAudioProcessorEditor)
 };
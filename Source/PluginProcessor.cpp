@@ -22,13 +22,15 @@ BugsoundsAudioProcessor::BugsoundsAudioProcessor()
 	 ) 
 #endif
 {
-    presetManager = std::make_unique<PresetManager>(apvts, freqSong, resSong, pips, *this);
+    presetManager = std::make_unique<PresetManager>(apvts, freqSong, resSong, pips, masterSeed, speciesList, *this);
     clickPreviewer = std::make_unique<ClickPreviewer>(apvts);
     mySynth.clearVoices();
-    myVoice = new SynthVoice();
+    //chorus voice 0 is the mono voice too, so the biggest chorus is all the slots it needs
+    myVoice = new SynthVoice((int)apvts.getParameterRange("Chorus Count").end);
     mySynth.addVoice(myVoice);
     myVoice->setAPVTS(&apvts);
     myVoice->setOwner(*this);
+    myVoice->setGovernor(&cpuGovernor);
     myVoice->beginPeriodicChorusUpdates();
     mySynth.clearSounds();
     mySynth.addSound(new SynthSound());
@@ -109,7 +111,10 @@ void BugsoundsAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBl
     // initialisation that you need..
     juce::ignoreUnused(samplesPerBlock);    //clears out unused samples from last key press
     lastSampleRate = sampleRate;
+    cpuGovernor.prepare(sampleRate);
     mySynth.setCurrentPlaybackSampleRate(lastSampleRate);
+    myVoice->prepareToPlay(sampleRate, samplesPerBlock, getBusesLayout().getMainOutputChannelSet());
+    setLatencySamples(myVoice->getLatencySamples());    //the voice's timer keeps it up to date after this
 
     if (clickPreviewer != nullptr) {
         clickPreviewer->prepareToPlay(samplesPerBlock, sampleRate);
@@ -131,11 +136,17 @@ bool BugsoundsAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts
     return true;
   #else
     // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
+    // Stereo is the normal case. The surround layouts are only really used by
+    // chorus mode's ambisonic decode, everything else just writes to L/R.
     // Some plugin hosts, such as certain GarageBand versions, will only
     // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    const auto& output = layouts.getMainOutputChannelSet();
+    if (output != juce::AudioChannelSet::mono()
+     && output != juce::AudioChannelSet::stereo()
+     && output != juce::AudioChannelSet::quadraphonic()
+     && output != juce::AudioChannelSet::create5point0()
+     && output != juce::AudioChannelSet::create5point1()
+     && output != juce::AudioChannelSet::create7point1())
         return false;
 
     // This checks if the input layout matches the output layout
@@ -152,6 +163,7 @@ bool BugsoundsAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts
 void BugsoundsAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
+    cpuGovernor.beginBlock();
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
@@ -172,6 +184,8 @@ void BugsoundsAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, ju
     for (int channel = 0; channel < buffer.getNumChannels(); channel++) {
         buffer.addFrom(channel, 0, previewBuffer, channel, 0, buffer.getNumSamples());
     }
+
+    cpuGovernor.endBlock(buffer.getNumSamples());
 }
 
 //==============================================================================
@@ -320,10 +334,116 @@ juce::AudioProcessorValueTreeState::ParameterLayout BugsoundsAudioProcessor::cre
         juce::NormalisableRange<float> { -1.0f, 1.0f, 0.01f },
         0.0f  // -1 is dispersed, 0 is random, 1 is correlated
     ));
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        "Chorus Spatial Mode",
+        "Chorus Spatial Mode",
+        juce::StringArray{ "Stereo", "Binaural", "Ambisonic" },
+        0));
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        "Chorus Ambisonic Order",
+        "Chorus Ambisonic Order",
+        juce::StringArray{ "First", "Third" },
+        1));
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        "Chorus Ambisonic Decode",
+        "Chorus Ambisonic Decode",
+        juce::StringArray{ "Speakers", "Binaural" },
+        0));
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        "Chorus Motion",
+        "Chorus Motion",
+        juce::StringArray{ "Static", "Drift", "Circle", "Fly-by", "Mixed" },
+        0));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        "Chorus Motion Speed",
+        "Chorus Motion Speed",
+        juce::NormalisableRange<float>(0.0f, 20.0f, 0.01f, 0.5f),
+        2.0f    //meters per second
+    ));
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        "Chorus Environment",
+        "Chorus Environment",
+        juce::StringArray{ "Forest Floor", "Field", "Room" },
+        0));
+    layout.add(std::make_unique<juce::AudioParameterInt>(
+        "Chorus Swarm Population",
+        "Chorus Swarm Population",
+        0,
+        5000,
+        0));    //total insects, counting the chorus voices. the rest are rendered as the far field
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        "Chorus Swarm Falloff",
+        "Chorus Swarm Falloff",
+        juce::NormalisableRange<float>(0.0f, 3.0f, 0.01f),
+        1.0f    //how fast the far field thins out with distance. 0 is even everywhere
+    ));
+    layout.add(std::make_unique<juce::AudioParameterChoice>(
+        "Chorus Timing Model",
+        "Chorus Timing Model",
+        juce::StringArray{ "Cooldown", "Phase Coupled" },
+        0));
+    layout.add(std::make_unique<juce::AudioParameterBool>(
+        "Chorus Distance Coupling",
+        "Chorus Distance Coupling",
+        false));    //phase coupled model: nearer voices pull harder
+    layout.add(std::make_unique<juce::AudioParameterFloat>(
+        "Chorus Hearing Range",
+        "Chorus Hearing Range",
+        juce::NormalisableRange<float>(0.0f, 30.0f, 0.1f),
+        0.0f    //meters. cooldown model: voices only react to others this close. 0 is everyone hears everyone
+    ));
 
     return layout;
 }
 
+//compiles the preset's extra species. one that doesn't compile, or fails the same test run the editors'
+//songs get, is left out of the chorus
+void BugsoundsAudioProcessor::compileExtraSpecies() {
+    extraSpecies.clear();
+    SongBatch testBatch;
+    for (const auto& description : speciesList.extraSpecies) {
+        ErrorInfo error = {};
+        std::string songCode = description.freqSong.toStdString();
+        ChorusSpecies species;
+        species.songScript = generateAST(songCode, &error);
+        if (error.message != "" || species.songScript == nullptr) continue;
+        if (!checkSongcode(species.songScript, &error)) continue;
+        species.songProgram = compileSongProgram(species.songScript, &error);
+        if (species.songProgram == nullptr || !testRunSong(testBatch, species.songProgram.get(), (uint64_t)masterSeed, error)) continue;
+        species.songBounds = analyzeSongBounds(species.songScript);
+        if (description.resSong.isNotEmpty()) {
+            std::string resCode = description.resSong.toStdString();
+            species.resScript = generateAST(resCode, &error);
+            if (error.message == "" && checkSongcode(species.resScript, &error, species.songScript.get()))
+                species.resProgram = compileSongProgram(species.resScript, &error);
+            if (species.resProgram == nullptr) species.resScript = nullptr;
+        }
+        species.pips = description.pips;
+        species.weight = description.weight;
+        species.gain = description.gain;
+        species.resonatorOn = description.resonatorOn && species.resScript != nullptr;
+        extraSpecies.push_back(std::move(species));
+    }
+}
+
+
+//builds a fresh species set and hands it to the voice. the old one is freed once the audio thread lets go
+void BugsoundsAudioProcessor::updateSpecies() {
+    std::vector<ChorusSpecies> species;
+    ChorusSpecies main;
+    main.songScript = mainSongAST;
+    main.resScript = mainResAST;
+    main.songProgram = mainSongProgram;
+    main.resProgram = mainResProgram;
+    main.songBounds = mainSongBounds;
+    main.pips = mainPips;
+    main.weight = speciesList.mainWeight;
+    species.push_back(std::move(main));
+    for (const auto& extra : extraSpecies) species.push_back(extra);
+    myVoice->setSpecies(new ChorusSpeciesSet(std::move(species)));
+}
+
+
 const juce::String& BugsoundsAudioProcessor::getUserSongcode(const juce::String& editorTitle){
 	if (editorTitle == "Frequency Editor") {
         return freqSong;
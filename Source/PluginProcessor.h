@@ -17,6 +17,7 @@
 #include "PresetManager.h"
 #include "PipStructs.h"
 #include "ClickPreviewer.h"
+#include "CpuGovernor.h"
 
 
 
@@ -70,16 +71,36 @@ public:
     //==============================================================================
     
     //MY FUNCTIONS
-    void setSongAST(juce::ReferenceCountedObjectPtr<ScriptNode> scriptAST) {
-		myVoice->setSongScript(scriptAST);
+    //the editors' songs and the pip sequencer are the main species. any change rebuilds the species set.
+    //the programs and songBounds are what the compile thread made of the scripts (null and {} for no song),
+    //so the message thread never compiles or analyzes anything
+    void setSongAST(ScriptPtr scriptAST, SongProgram::Ptr program = nullptr, SongBounds songBounds = {}) {
+        mainSongAST = scriptAST;
+        mainSongProgram = program;
+        mainSongBounds = songBounds;
+        updateSpecies();
     }
 
-	void setResAST(juce::ReferenceCountedObjectPtr<ScriptNode> scriptAST) {
-		myVoice->setResScript(scriptAST);
+	void setResAST(ScriptPtr scriptAST, SongProgram::Ptr program = nullptr) {
+        mainResAST = scriptAST;
+        mainResProgram = program;
+        updateSpecies();
 	}
+
+    //both in one species set
+    void setSongASTs(ScriptPtr songAST, ScriptPtr resAST, SongProgram::Ptr songProgram = nullptr, SongProgram::Ptr resProgram = nullptr,
+        SongBounds songBounds = {}) {
+        mainSongAST = songAST;
+        mainResAST = resAST;
+        mainSongProgram = songProgram;
+        mainResProgram = resProgram;
+        mainSongBounds = songBounds;
+        updateSpecies();
+    }
     
     void setPipSequence(std::vector<Pip> pips) {
-        myVoice->setPipSequence(pips);
+        mainPips = pips;
+        updateSpecies();
     }
 
 
@@ -98,23 +119,34 @@ public:
     juce::AudioProcessorValueTreeState& getAPVTS() { return apvts; }
     void setPips(std::vector<Pip> pips) { 
         this->pips = pips; 
-        myVoice->setPipSequence(pips);
+        setPipSequence(pips);
         clickPreviewer->setPips(pips);
     }
     void updatePipBarModes(EditingMode newMode) { pipMode = newMode; }
     void getPips(std::vector<Pip>& pips, EditingMode& mode) { pips = this->pips;  mode = pipMode;  }
     
-    void propogatePresetLoad(juce::String fs, juce::String rs, std::vector<Pip> pipi) {
+    void propogatePresetLoad(juce::String fs, juce::String rs, std::vector<Pip> pipi, juce::int64 seed, ChorusSpeciesList species) {
         freqSong = fs;
         resSong = rs;
+        speciesList = std::move(species);
+        compileExtraSpecies();
         setPips(pipi);
+        setMasterSeed(seed);
+    }
+
+    //every random choice the synth makes comes from this seed. saved with presets
+    void setMasterSeed(juce::int64 seed) {
+        masterSeed = seed;
+        myVoice->setMasterSeed((uint64_t)seed);
     }
+    juce::int64 getMasterSeed() const { return masterSeed; }
 
 
     //for updating the chorus position readout in chorusKnobRack
     struct ChorusVoicePosition {
         float distance, angle;
         bool isPlaying;
+        bool isMoving;
     };
 
     std::vector<ChorusVoicePosition> getChorusVoicePositions() {
@@ -132,6 +164,9 @@ public:
     const juce::String& getResSong() const { return resSong; }
     
     void triggerPreviewClick();
+
+    //how the render is keeping up with the host. for the header's cpu readout
+    const CpuGovernor& getCpuGovernor() const { return cpuGovernor; }
 	
 private:
 
@@ -140,11 +175,25 @@ private:
     juce::String freqSong = "";
     juce::String resSong = "";
     std::vector<Pip> pips;
+    juce::int64 masterSeed = 1;
     enum EditingMode pipMode = EditingMode::FREQUENCY;
 
+    //chorus species. the main one comes from the editors, the rest from the preset
+    void compileExtraSpecies();
+    void updateSpecies();
+    ChorusSpeciesList speciesList;
+    std::vector<ChorusSpecies> extraSpecies;    //speciesList.extraSpecies, compiled
+    ScriptPtr mainSongAST;
+    ScriptPtr mainResAST;
+    SongProgram::Ptr mainSongProgram;
+    SongProgram::Ptr mainResProgram;
+    SongBounds mainSongBounds;
+    std::vector<Pip> mainPips;
+
     juce::Synthesiser mySynth;
     SynthVoice* myVoice;
     double lastSampleRate;
+    CpuGovernor cpuGovernor;
     std::unique_ptr<PresetManager> presetManager;
     std::unique_ptr<ClickPreviewer> clickPreviewer;
 
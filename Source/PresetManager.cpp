@@ -32,20 +32,33 @@ const juce::String PresetManager::defaultPresetXml = R"(
     <PARAM id="Chorus Cooldown Max" value="10.03200054168701"/>
     <PARAM id="Chorus Correlation"/>
     <PARAM id="Chorus Count" value="5.0"/>
+    <PARAM id="Chorus Distance Coupling" value="0.0"/>
+    <PARAM id="Chorus Environment" value="0.0"/>
+    <PARAM id="Chorus Hearing Range" value="0.0"/>
     <PARAM id="Chorus Max Distance" value="7.399999618530273"/>
+    <PARAM id="Chorus Motion" value="0.0"/>
+    <PARAM id="Chorus Motion Speed" value="2.0"/>
     <PARAM id="Chorus On" value="0.0"/>
+    <PARAM id="Chorus Spatial Mode" value="0.0"/>
+    <PARAM id="Chorus Ambisonic Order" value="1.0"/>
+    <PARAM id="Chorus Ambisonic Decode" value="0.0"/>
     <PARAM id="Chorus Stereo Spread"/>
+    <PARAM id="Chorus Swarm Falloff" value="1.0"/>
+    <PARAM id="Chorus Swarm Population" value="0.0"/>
+    <PARAM id="Chorus Timing Model" value="0.0"/>
     <PARAM id="Click Volume"/>
   </Parameters>
   <CUSTOM_DATA>
     <FREQ_SONG value="120 1000, 0 1000"/>
     <RES_SONG value="440 1000, 880 1000"/>
+    <SEED value="1"/>
     <PIPS>
       <PIP freq="1153.18603515625" len="500" tail="43" level="0.1521739363670349"/>
       <PIP freq="1069.771362304688" len="670" tail="29" level="0.4239130616188049"/>
       <PIP freq="2839.251708984375" len="759" tail="0" level="0.02173912525177002"/>
       <PIP freq="920.605224609375" len="100" tail="0" level="0.5"/>
     </PIPS>
+    <SPECIES mainWeight="1"/>
   </CUSTOM_DATA>
 </Preset>
 )";
@@ -60,10 +73,38 @@ const juce::File PresetManager::defaultDir{
 const juce::String PresetManager::extension{ "preset" };
 
 
+//pip lists show up for the main species and for every extra one
+static void writePips(juce::XmlElement& pipsElement, const std::vector<Pip>& pips) {
+	for (const auto& pip : pips) {
+		auto* pipElement = pipsElement.createNewChildElement("PIP");
+		pipElement->setAttribute("freq", pip.frequency);
+		pipElement->setAttribute("len", pip.length);
+		pipElement->setAttribute("tail", pip.tail);
+		pipElement->setAttribute("level", pip.level);
+	}
+}
+
+
+static std::vector<Pip> readPips(const juce::XmlElement& pipsElement) {
+	std::vector<Pip> pips;
+	for (auto* pipElement : pipsElement.getChildWithTagNameIterator("PIP")) {
+		Pip pip;
+		pip.frequency = pipElement->getDoubleAttribute("freq");
+		pip.length = pipElement->getDoubleAttribute("len");
+		pip.tail = pipElement->getDoubleAttribute("tail");
+		pip.level = pipElement->getDoubleAttribute("level");
+		pips.push_back(pip);
+	}
+	return pips;
+}
+
+
 
 PresetManager::PresetManager(juce::AudioProcessorValueTreeState& valueTreeState, juce::String& freqSongRef,
-	juce::String& resSongRef,std::vector<Pip>& pipsRef, BugsoundsAudioProcessor& p)
-	: apvts(valueTreeState), freqSong(freqSongRef), resSong(resSongRef), pips(pipsRef), audioProcessor(p)
+	juce::String& resSongRef,std::vector<Pip>& pipsRef, juce::int64& masterSeedRef, ChorusSpeciesList& speciesRef,
+	BugsoundsAudioProcessor& p)
+	: apvts(valueTreeState), freqSong(freqSongRef), resSong(resSongRef), pips(pipsRef), masterSeed(masterSeedRef),
+	species(speciesRef), audioProcessor(p)
 {
 	//create a default director for presets if it doesn't exist yet
 	if (!defaultDir.exists()) {
@@ -109,15 +150,23 @@ void PresetManager::exportXml(juce::XmlElement& parentElement){
 		->setAttribute("value", freqSong);
 	customData->createNewChildElement("RES_SONG")
 		->setAttribute("value", resSong);
+	customData->createNewChildElement("SEED")
+		->setAttribute("value", juce::String(masterSeed));
 
 	//save Pips collection
-	auto* pipsElement = customData->createNewChildElement("PIPS");
-	for (const auto& pip : pips) {
-		auto* pipElement = pipsElement->createNewChildElement("PIP");
-		pipElement->setAttribute("freq", pip.frequency);
-		pipElement->setAttribute("len", pip.length);
-		pipElement->setAttribute("tail", pip.tail);
-		pipElement->setAttribute("level", pip.level);
+	writePips(*customData->createNewChildElement("PIPS"), pips);
+
+	//save the chorus species. the main one is the songs and pips above, so only its weight goes here
+	auto* speciesElement = customData->createNewChildElement("SPECIES");
+	speciesElement->setAttribute("mainWeight", species.mainWeight);
+	for (const auto& extra : species.extraSpecies) {
+		auto* extraElement = speciesElement->createNewChildElement("EXTRA");
+		extraElement->setAttribute("freqSong", extra.freqSong);
+		extraElement->setAttribute("resSong", extra.resSong);
+		extraElement->setAttribute("weight", extra.weight);
+		extraElement->setAttribute("gain", extra.gain);
+		extraElement->setAttribute("resonator", extra.resonatorOn);
+		writePips(*extraElement, extra.pips);
 	}
 }
 
@@ -184,6 +233,8 @@ void PresetManager::importXml(const juce::XmlElement& parentElement) {
 	//load custom data from "CUSTOM_DATA" child
 	juce::String freqSong, resSong;
 	std::vector<Pip> pips;
+	juce::int64 seed = 1;	//presets from before seeds existed all get the same one
+	ChorusSpeciesList speciesList;	//and presets from before species are just the main one
 
 	if (auto* customData = parentElement.getChildByName("CUSTOM_DATA")) {
 		//load FREQ_SONG and RES_SONG
@@ -193,21 +244,31 @@ void PresetManager::importXml(const juce::XmlElement& parentElement) {
 		if (auto* resElement = customData->getChildByName("RES_SONG"))
 			resSong = resElement->getStringAttribute("value");
 
+		if (auto* seedElement = customData->getChildByName("SEED"))
+			seed = seedElement->getStringAttribute("value").getLargeIntValue();
+
 		//load pip list
-		if (auto* pipsElement = customData->getChildByName("PIPS")) {
-			for (auto* pipElement : pipsElement->getChildWithTagNameIterator("PIP")) {
-				Pip pip;
-				pip.frequency = pipElement->getDoubleAttribute("freq");
-				pip.length = pipElement->getDoubleAttribute("len");
-				pip.tail = pipElement->getDoubleAttribute("tail");
-				pip.level = pipElement->getDoubleAttribute("level");
-				pips.push_back(pip);
+		if (auto* pipsElement = customData->getChildByName("PIPS"))
+			pips = readPips(*pipsElement);
+
+		//load chorus species
+		if (auto* speciesElement = customData->getChildByName("SPECIES")) {
+			speciesList.mainWeight = (float)speciesElement->getDoubleAttribute("mainWeight", 1.0);
+			for (auto* extraElement : speciesElement->getChildWithTagNameIterator("EXTRA")) {
+				ChorusSpeciesDescription extra;
+				extra.freqSong = extraElement->getStringAttribute("freqSong");
+				extra.resSong = extraElement->getStringAttribute("resSong");
+				extra.weight = (float)extraElement->getDoubleAttribute("weight", 1.0);
+				extra.gain = (float)extraElement->getDoubleAttribute("gain", 1.0);
+				extra.resonatorOn = extraElement->getBoolAttribute("resonator", true);
+				extra.pips = readPips(*extraElement);
+				speciesList.extraSpecies.push_back(extra);
 			}
 		}
 	}
 
 	// Propagate loaded data to the processor
-	audioProcessor.propogatePresetLoad(freqSong, resSong, pips);
+	audioProcessor.propogatePresetLoad(freqSong, resSong, pips, seed, speciesList);
 }
 
 
@@ -11,6 +11,7 @@
 #pragma once
 #include <JuceHeader.h>
 #include "PipStructs.h"
+#include "ChorusSpecies.h"
 
 
 class BugsoundsAudioProcessor;
@@ -22,7 +23,8 @@ public:
 
 
     PresetManager(juce::AudioProcessorValueTreeState& valueTreeState, juce::String& freqSongRef,
-        juce::String& resSongRef, std::vector<Pip>& pipsRef, BugsoundsAudioProcessor& p);
+        juce::String& resSongRef, std::vector<Pip>& pipsRef, juce::int64& masterSeedRef, ChorusSpeciesList& speciesRef,
+        BugsoundsAudioProcessor& p);
 
     void savePreset(const juce::String& presetName);
     void exportXml(juce::XmlElement& parentElement);
@@ -42,6 +44,8 @@ private:
     juce::String& freqSong;
     juce::String& resSong;
     std::vector<Pip>& pips;
+    juce::int64& masterSeed;
+    ChorusSpeciesList& species;
     BugsoundsAudioProcessor& audioProcessor;
 
     juce::String currentPreset;
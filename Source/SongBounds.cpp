@@ -0,0 +1,316 @@
+/*
+  ==============================================================================
+
+    SongBounds.cpp
+    Created: 24 Oct 2026 2:41:08pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#include "SongBounds.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <optional>
+#include <set>
+
+
+namespace {
+
+constexpr double infinity = std::numeric_limits<double>::infinity();
+
+
+//every value an expression could come out as is somewhere in [lo, hi]
+struct Interval {
+    double lo = -infinity;
+    double hi = infinity;
+
+    static Interval of(double lo, double hi) { return { lo, hi }; }
+    static Interval join(const Interval& a, const Interval& b) { return { std::min(a.lo, b.lo), std::max(a.hi, b.hi) }; }
+    bool operator==(const Interval& other) const { return lo == other.lo && hi == other.hi; }
+    bool operator!=(const Interval& other) const { return !(*this == other); }
+};
+
+
+//0 * infinity is 0 here, since a count of 0 means none of the infinitely many happen
+double times(double a, double b) {
+    if (a == 0.0 || b == 0.0) return 0.0;
+    return a * b;
+}
+
+
+Interval multiply(const Interval& a, const Interval& b) {
+    const double products[] = { times(a.lo, b.lo), times(a.lo, b.hi), times(a.hi, b.lo), times(a.hi, b.hi) };
+    return { *std::min_element(std::begin(products), std::end(products)), *std::max_element(std::begin(products), std::end(products)) };
+}
+
+
+//integer division. dividing by 0 is an error, so the divisor's 0 is left out, and the closest it gets is 1 or -1
+Interval divide(const Interval& a, const Interval& b) {
+    auto divideBy = [&a](double lo, double hi) {
+        const double quotients[] = { a.lo / lo, a.lo / hi, a.hi / lo, a.hi / hi };
+        Interval result = { infinity, -infinity };
+        for (double q : quotients) {
+            if (std::isnan(q)) q = 0.0;     //infinity / infinity, which is as big as the numerator gets
+            result.lo = std::min(result.lo, q);
+            result.hi = std::max(result.hi, q);
+        }
+        if (std::isinf(lo) || std::isinf(hi)) result = Interval::join(result, { 0.0, 0.0 });
+        return result;
+    };
+
+    const bool negative = b.lo <= -1.0;
+    const bool positive = b.hi >= 1.0;
+    if (negative && positive) return Interval::join(divideBy(b.lo, -1.0), divideBy(1.0, b.hi));
+    if (negative) return divideBy(b.lo, std::min(b.hi, -1.0));
+    if (positive) return divideBy(std::max(b.lo, 1.0), b.hi);
+    return { 0.0, 0.0 };    //always divides by 0, checkSongcode stops that
+}
+
+
+struct BoundsAnalyzer {
+    using Env = std::map<std::string, Interval>;
+
+    //what some statements add to one instance of the song
+    struct Totals {
+        double elements = 0.0;
+        double lengthMs = 0.0;
+    };
+
+    SongBounds bounds;
+    Env env;    //the range of every variable that might be set at this point
+    std::map<const LoopNode*, double> leastIterations;     //the fewest each loop could go round, over every time it's reached
+    std::map<const std::vector<StatementPtr>*, std::vector<std::string>> variablesSet;     //by loop body, see variablesSetIn
+    int loopDepth = 0;
+    int passesLeft = maxLoopPasses;
+
+    //the fixed point for a loop's variables gets a few tries to settle before they're widened to anything.
+    //loops inside loops are gone through again every time round the outer one, so they widen on the first time round again
+    static constexpr int loopPassesBeforeWidening = 3;
+
+    //passes through loop bodies for the whole song. past this, everything a loop sets is taken to be anything,
+    //which one pass is enough for, so deep nesting can't take exponential time
+    static constexpr int maxLoopPasses = 256;
+
+    Interval evaluate(const ExprPtr& expr) const {
+        if (!expr) return {};
+
+        if (auto* additive = dynamic_cast<AdditiveExprNode*>(expr.get())) {
+            const Interval left = evaluate(additive->left);
+            const Interval right = evaluate(additive->right);
+            if (additive->op == AdditiveExprNode::Add) return { left.lo + right.lo, left.hi + right.hi };
+            return { left.lo - right.hi, left.hi - right.lo };
+        }
+        if (auto* multiplicative = dynamic_cast<MultiplicativeExprNode*>(expr.get())) {
+            const Interval left = evaluate(multiplicative->left);
+            const Interval right = evaluate(multiplicative->right);
+            return multiplicative->op == MultiplicativeExprNode::Multiply ? multiply(left, right) : divide(left, right);
+        }
+        if (auto* primary = dynamic_cast<PrimaryExprNode*>(expr.get())) {
+            switch (primary->kind) {
+                case PrimaryExprNode::Integer: return Interval::of(primary->integerValue, primary->integerValue);
+                case PrimaryExprNode::Grouped: return evaluate(primary->groupedExpr);
+                case PrimaryExprNode::Variable: {
+                    auto it = env.find(primary->variableName);
+                    return it != env.end() ? it->second : Interval();
+                }
+            }
+        }
+        //the evaluator swaps min and max if they're the wrong way round, so it's anywhere in either
+        if (auto* rand = dynamic_cast<RandomNode*>(expr.get())) return Interval::join(evaluate(rand->min), evaluate(rand->max));
+        return {};
+    }
+
+    Totals analyzeStatements(const std::vector<StatementPtr>& statements) {
+        Totals totals;
+        for (auto& statement : statements) {
+            if (auto* note = dynamic_cast<NoteNode*>(statement.get())) {
+                bounds.maxFrequency = std::max(bounds.maxFrequency, evaluate(note->frequency).hi);
+                totals.elements += 1.0;
+                totals.lengthMs += std::max(0.0, evaluate(note->duration).hi);
+            }
+            else if (auto* pattern = dynamic_cast<PatternNode*>(statement.get())) {
+                bounds.maxPatternLength = std::max(bounds.maxPatternLength, (int)pattern->subBeats.size());
+                for (auto& subBeat : pattern->subBeats) {
+                    //sub-beats are stored as uint8_ts. anything that might not fit could wrap round to anything
+                    const Interval value = evaluate(subBeat);
+                    const int most = value.lo >= 0.0 && value.hi <= 255.0 ? (int)value.hi : 255;
+                    bounds.maxSubBeats = std::max(bounds.maxSubBeats, most);
+                }
+                totals.elements += 1.0;
+            }
+            else if (auto* let = dynamic_cast<LetNode*>(statement.get())) {
+                env[let->id] = evaluate(let->value);
+            }
+            else if (auto* loop = dynamic_cast<LoopNode*>(statement.get())) {
+                const Interval iterationRange = evaluate(loop->iterations);
+                //past what an int holds, the evaluator's arithmetic could have wrapped round to anything
+                const double least = iterationRange.hi <= std::numeric_limits<int>::max() ? iterationRange.lo : -infinity;
+                auto visited = leastIterations.emplace(loop, least);
+                if (!visited.second) visited.first->second = std::min(visited.first->second, least);
+
+                const double iterations = std::max(0.0, iterationRange.hi);
+                if (iterations == 0.0) continue;
+                const Totals body = analyzeLoopBody(loop->body);
+                totals.elements += times(body.elements, iterations);
+                totals.lengthMs += times(body.lengthMs, iterations);
+            }
+        }
+        return totals;
+    }
+
+    //the variables statements set, loops in them included. only these can change going round a loop
+    const std::vector<std::string>& variablesSetIn(const std::vector<StatementPtr>& statements) {
+        auto known = variablesSet.find(&statements);
+        if (known != variablesSet.end()) return known->second;
+        std::set<std::string> ids;
+        for (auto& statement : statements) {
+            if (auto* let = dynamic_cast<LetNode*>(statement.get())) ids.insert(let->id);
+            else if (auto* loop = dynamic_cast<LoopNode*>(statement.get())) {
+                const auto& inner = variablesSetIn(loop->body);
+                ids.insert(inner.begin(), inner.end());
+            }
+        }
+        return variablesSet[&statements] = std::vector<std::string>(ids.begin(), ids.end());
+    }
+
+    //finds ranges for the variables the body sets that hold on every time round, then goes through it with them.
+    //env comes out holding for any number of iterations, none included
+    Totals analyzeLoopBody(const std::vector<StatementPtr>& body) {
+        const auto& ids = variablesSetIn(body);
+        const int widenFrom = loopDepth > 0 ? 1 : loopPassesBeforeWidening;
+        std::vector<std::optional<Interval>> start(ids.size());     //by ids, unset for ones not set yet
+        Totals totals;
+        loopDepth++;
+        for (int pass = 0; ; pass++) {
+            if (passesLeft > 0) passesLeft--;
+            else for (auto& id : ids) env[id] = Interval();
+
+            for (size_t i = 0; i < ids.size(); i++) {
+                auto it = env.find(ids[i]);
+                start[i] = it != env.end() ? std::optional<Interval>(it->second) : std::nullopt;
+            }
+            totals = analyzeStatements(body);
+
+            //going round again starts from either what it started with or what the body left
+            bool settled = true;
+            for (size_t i = 0; i < ids.size(); i++) {
+                auto it = env.find(ids[i]);
+                if (it == env.end()) continue;      //never set, the body's lets didn't get reached
+                if (!start[i]) {
+                    settled = false;    //first set in the body, so the next time round has it
+                    continue;
+                }
+                Interval joined = Interval::join(*start[i], it->second);
+                if (joined != *start[i]) {
+                    settled = false;
+                    if (pass >= widenFrom) {
+                        if (joined.lo < start[i]->lo) joined.lo = -infinity;
+                        if (joined.hi > start[i]->hi) joined.hi = infinity;
+                    }
+                }
+                it->second = joined;
+            }
+            if (settled) break;
+        }
+        loopDepth--;
+        return totals;
+    }
+};
+
+}
+
+
+SongBounds analyzeSongBounds(const ScriptPtr& script) {
+    BoundsAnalyzer analyzer;
+    if (!script) return analyzer.bounds;
+    const auto totals = analyzer.analyzeStatements(script->statements);
+    analyzer.bounds.maxElements = totals.elements;
+    analyzer.bounds.maxLengthMs = totals.lengthMs;
+    return analyzer.bounds;
+}
+
+
+std::set<const LoopNode*> findLoopsThatAlwaysRun(const ScriptPtr& script) {
+    std::set<const LoopNode*> loops;
+    if (!script) return loops;
+    BoundsAnalyzer analyzer;
+    analyzer.analyzeStatements(script->statements);
+    for (auto& [loop, least] : analyzer.leastIterations) {
+        if (least >= 1.0) loops.insert(loop);
+    }
+    return loops;
+}
+
+
+
+
+
+
+/*
+-------------------============ VOICE LOAD ============-------------------
+A click plays its pips one after another, each starting (length - tail) samples after
+the last (at least 1), and is done once its last pip has started. A pip sounds for its
+length. So from the fastest the song can click, it's how many clicks and pips can be
+going at any one moment.
+*/
+
+VoiceLoad VoiceLoad::forSong(const SongBounds& bounds, const std::vector<Pip>& pips, double sampleRate) {
+    VoiceLoad load;
+    load.patternLength = bounds.maxPatternLength;
+    if (pips.empty() || sampleRate <= 0.0) return load;
+
+    //the first layer's phase goes back to 0 on a click, so it's at most one a sample
+    load.clicksPerSample = bounds.getMaxClickRate() / sampleRate;
+    const double rate = std::min(1.0, std::max(0.0, load.clicksPerSample));
+
+    double clickLength = 1.0;   //samples from a click starting to its last pip starting
+    double longestPip = 1.0;
+    double shortestStep = infinity;
+    for (size_t i = 0; i < pips.size(); i++) {
+        const double step = std::max(pips[i].length - pips[i].tail, 1) + 1;
+        if (i + 1 < pips.size()) {
+            clickLength += step;
+            shortestStep = std::min(shortestStep, step);
+        }
+        longestPip = std::max(longestPip, (double)pips[i].length);
+    }
+
+    //clicks that started within the window are the only ones that can still be going
+    auto clicksWithin = [rate](double samples) { return std::floor(samples * rate) + 1.0; };
+    load.clicks = clicksWithin(clickLength);
+    const double pipsPerClick = std::min((double)pips.size(), std::floor(longestPip / shortestStep) + 1.0);
+    load.subClicks = clicksWithin(clickLength + longestPip) * pipsPerClick;
+    return load;
+}
+
+
+VoiceLoad& VoiceLoad::include(const VoiceLoad& other) {
+    clicksPerSample = std::max(clicksPerSample, other.clicksPerSample);
+    clicks = std::max(clicks, other.clicks);
+    subClicks = std::max(subClicks, other.subClicks);
+    patternLength = std::max(patternLength, other.patternLength);
+    return *this;
+}
+
+
+int VoiceLoad::getClickCapacity() const { return (int)std::min(clicks, (double)maxClicks); }
+int VoiceLoad::getSubClickCapacity() const { return (int)std::min(subClicks, (double)maxSubClicks); }
+int VoiceLoad::getPatternCapacity() const { return (int)std::min(patternLength, (double)maxPatternLength); }
+
+
+std::string VoiceLoad::getBudgetWarning() const {
+    auto count = [](double n) { return std::isinf(n) ? std::string("unlimited") : std::to_string((long long)n); };
+    if (clicksPerSample > 1.0) {
+        return "Warning: clicks can come faster than one per sample, so some will be lost";
+    }
+    if (subClicks > maxSubClicks) {
+        return "Warning: up to " + count(subClicks) + " pips at once, more than a voice plays (" + std::to_string(maxSubClicks) + "). some will be dropped";
+    }
+    if (clicks > maxClicks) {
+        return "Warning: up to " + count(clicks) + " clicks at once, more than a voice plays (" + std::to_string(maxClicks) + "). some will be dropped";
+    }
+    return "";
+}
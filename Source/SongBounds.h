@@ -0,0 +1,69 @@
+/*
+  ==============================================================================
+
+    SongBounds.h
+    Created: 24 Oct 2026 2:41:08pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <set>
+#include <string>
+#include <vector>
+#include "Evaluator.h"
+#include "PipStructs.h"
+
+
+//the worst a song can do, worked out from its AST without playing it. every expression is treated
+//as the range of values it could come out as (rands are their whole range), and a loop as its body
+//times the most iterations it could get. variables a loop keeps changing (let a = a * 2) are widened
+//to anything, so it's always an upper bound, just sometimes not a tight one. infinity means there's
+//no bound it could find
+struct SongBounds {
+	double maxElements = 0.0;		//notes and patterns in one instance of the song
+	double maxLengthMs = 0.0;		//how long one instance can go on for
+	double maxFrequency = 0.0;		//Hz. the fastest a note ticks the first layer over
+	int maxSubBeats = 1;			//the most clicks a pattern squeezes into one tick
+	int maxPatternLength = 1;		//sub-beats in the longest pattern (1 for the default pattern)
+
+	//first layer clicks per second, at most
+	double getMaxClickRate() const { return maxFrequency * maxSubBeats; }
+};
+
+//script should be folded, and have passed checkSongcode
+SongBounds analyzeSongBounds(const ScriptPtr& script);
+
+//loops that go round at least once every time the song gets to them, going by the same ranges. a
+//variable count can be one of them (let n = rand(1 4), [...] n). for checkSongcode's definite assignment
+std::set<const LoopNode*> findLoopsThatAlwaysRun(const ScriptPtr& script);
+
+
+//what a voice playing a song needs at once, for a pip sequence and sample rate. these size the voices'
+//click lists up front, so the audio thread never has to grow them
+struct VoiceLoad {
+	//past these, a voice drops clicks instead of reserving more. they're the real time budget per voice
+	static constexpr int maxClicks = 256;
+	static constexpr int maxSubClicks = 1024;
+	static constexpr int maxPatternLength = 1024;
+
+	double clicksPerSample = 0.0;	//first layer. a voice can't click more than once a sample
+	double clicks = 1.0;			//clicks going through their pips at once
+	double subClicks = 1.0;			//pips sounding at once
+	double patternLength = 1.0;
+
+	static VoiceLoad forSong(const SongBounds& bounds, const std::vector<Pip>& pips, double sampleRate);
+
+	//the worse of the two, for a voice that could be playing either
+	VoiceLoad& include(const VoiceLoad& other);
+
+	//what the voices reserve for this, within the budget
+	int getClickCapacity() const;
+	int getSubClickCapacity() const;
+	int getPatternCapacity() const;
+
+	//what goes over the budget, for the editor. empty if nothing does
+	std::string getBudgetWarning() const;
+};
@@ -0,0 +1,994 @@
+/*
+  ==============================================================================
+
+    SongBytecode.cpp
+    Created: 22 Oct 2026 10:37:12am
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "SongBytecode.h"
+
+#include <algorithm>
+#include <utility>
+
+
+/*
+-------------------============ COMPILER ============-------------------
+*/
+
+namespace {
+
+using Op = SongInstruction::Op;
+
+//walks the AST once, the same order evaluateStatement does, so the rands draw in the same order.
+//runs of constant statements (foldConstants leaves most deterministic songs as plain numbers) become
+//segments, so the program only has instructions for the parts that change between instances
+struct SongCompiler {
+    SongProgram& program;
+    ErrorInfo* errorInfo;
+    std::map<std::string, int> slotIndices;
+    std::map<std::vector<uint8_t>, int> patternStarts;     //where each pattern is in the pool
+    int stackDepth = 0;
+    int loopDepth = 0;
+
+    //stackChange is how much the instruction grows (or shrinks) the stack
+    int emit(Op op, int arg, int stackChange) {
+        program.code.push_back({ op, arg });
+        stackDepth += stackChange;
+        program.maxStackDepth = std::max(program.maxStackDepth, stackDepth);
+        return (int)program.code.size() - 1;
+    }
+
+    int getSlot(const std::string& name) {
+        auto it = slotIndices.find(name);
+        if (it != slotIndices.end()) return it->second;
+        const int slot = (int)program.slotNames.size();
+        program.slotNames.push_back(name);
+        slotIndices[name] = slot;
+        return slot;
+    }
+
+    bool fail(const std::string& message) {
+        setErrorInfo(errorInfo, message, 0, 0, "");
+        return false;
+    }
+
+
+    static bool isInteger(const ExprPtr& expr, int* value = nullptr) {
+        auto* primary = dynamic_cast<PrimaryExprNode*>(expr.get());
+        if (primary == nullptr || primary->kind != PrimaryExprNode::Integer) return false;
+        if (value != nullptr) *value = primary->integerValue;
+        return true;
+    }
+
+
+    //how many elements a statement always comes out as. -1 if it isn't always the same.
+    //lets don't count, they have to actually run so their variables get set
+    static int getConstantLength(const StatementPtr& statement) {
+        if (auto* note = dynamic_cast<NoteNode*>(statement.get())) {
+            return isInteger(note->frequency) && isInteger(note->duration) ? 1 : -1;
+        }
+        if (auto* pattern = dynamic_cast<PatternNode*>(statement.get())) {
+            for (auto& subBeat : pattern->subBeats) {
+                if (!isInteger(subBeat)) return -1;
+            }
+            return 1;
+        }
+        if (auto* loop = dynamic_cast<LoopNode*>(statement.get())) {
+            int iterations;
+            if (!isInteger(loop->iterations, &iterations)) return -1;
+            int64_t bodyLength = 0;
+            for (auto& bodyStatement : loop->body) {
+                const int length = getConstantLength(bodyStatement);
+                if (length < 0) return -1;
+                bodyLength += length;
+            }
+            //saturates, past here it's too long for a segment anyway
+            return (int)std::min<int64_t>(std::max(0, iterations) * bodyLength, std::numeric_limits<int>::max());
+        }
+        return -1;
+    }
+
+
+    //where a pattern is in the program's pool, adding it if it isn't yet
+    int getPatternStart(const std::vector<uint8_t>& subBeats) {
+        auto it = patternStarts.find(subBeats);
+        if (it != patternStarts.end()) return it->second;
+        const int start = (int)program.patternPool.size();
+        program.patternPool.insert(program.patternPool.end(), subBeats.begin(), subBeats.end());
+        patternStarts[subBeats] = start;
+        return start;
+    }
+
+
+    //appends a constant statement's elements
+    void expand(const StatementPtr& statement, std::vector<SegmentElement>& elements) {
+        int a, b;
+        if (auto* note = dynamic_cast<NoteNode*>(statement.get())) {
+            isInteger(note->frequency, &a);
+            isInteger(note->duration, &b);
+            elements.push_back({ (float)a, (float)b });
+        }
+        else if (auto* pattern = dynamic_cast<PatternNode*>(statement.get())) {
+            std::vector<uint8_t> subBeats;
+            for (auto& subBeat : pattern->subBeats) {
+                isInteger(subBeat, &a);
+                subBeats.push_back((uint8_t)a);
+            }
+            elements.push_back({ -1.0f, -1.0f, getPatternStart(subBeats), (int)subBeats.size() });
+        }
+        else if (auto* loop = dynamic_cast<LoopNode*>(statement.get())) {
+            isInteger(loop->iterations, &a);
+            for (int i = 0; i < a; i++) {
+                for (auto& bodyStatement : loop->body) expand(bodyStatement, elements);
+            }
+        }
+    }
+
+
+    void flushSegment(std::vector<SegmentElement>& pending) {
+        if (pending.empty()) return;
+        program.segments.push_back(std::move(pending));
+        pending.clear();
+        emit(Op::Segment, (int)program.segments.size() - 1, 0);
+    }
+
+
+    bool compileStatements(const std::vector<StatementPtr>& statements) {
+        std::vector<SegmentElement> pending;
+        for (auto& statement : statements) {
+            const int length = getConstantLength(statement);
+            if (length >= 0 && (int)pending.size() + length <= SongProgram::maxSegmentLength) {
+                expand(statement, pending);
+                continue;
+            }
+            flushSegment(pending);
+            if (length >= 0 && length <= SongProgram::maxSegmentLength) expand(statement, pending);
+            else if (!compileStatement(statement)) return false;
+        }
+        flushSegment(pending);
+        return true;
+    }
+
+
+    bool compileExpr(const ExprPtr& expr) {
+        if (!expr) return fail("Error: null expression node encountered");
+
+        if (auto* additive = dynamic_cast<AdditiveExprNode*>(expr.get())) {
+            if (!compileExpr(additive->left) || !compileExpr(additive->right)) return false;
+            emit(additive->op == AdditiveExprNode::Add ? Op::Add : Op::Subtract, 0, -1);
+            return true;
+        }
+        if (auto* multiplicative = dynamic_cast<MultiplicativeExprNode*>(expr.get())) {
+            if (!compileExpr(multiplicative->left) || !compileExpr(multiplicative->right)) return false;
+            emit(multiplicative->op == MultiplicativeExprNode::Multiply ? Op::Multiply : Op::Divide, 0, -1);
+            return true;
+        }
+        if (auto* primary = dynamic_cast<PrimaryExprNode*>(expr.get())) {
+            switch (primary->kind) {
+            case PrimaryExprNode::Integer: emit(Op::Push, primary->integerValue, 1); return true;
+            case PrimaryExprNode::Variable: emit(Op::Load, getSlot(primary->variableName), 1); return true;
+            case PrimaryExprNode::Grouped: return compileExpr(primary->groupedExpr);
+            }
+            return fail("Error: can't parse primary expression");
+        }
+        if (auto* rand = dynamic_cast<RandomNode*>(expr.get())) {
+            if (!compileExpr(rand->min) || !compileExpr(rand->max)) return false;
+            emit(Op::Rand, 0, -1);
+            return true;
+        }
+        return fail("Error: unknown expression type");
+    }
+
+
+    bool compileStatement(const StatementPtr& statement) {
+        if (auto* note = dynamic_cast<NoteNode*>(statement.get())) {
+            if (!compileExpr(note->frequency) || !compileExpr(note->duration)) return false;
+            emit(Op::Note, 0, -2);
+            return true;
+        }
+        if (auto* pattern = dynamic_cast<PatternNode*>(statement.get())) {
+            for (auto& subBeat : pattern->subBeats) {
+                if (!compileExpr(subBeat)) return false;
+            }
+            const int numSubBeats = (int)pattern->subBeats.size();
+            emit(Op::Pattern, numSubBeats, -numSubBeats);
+            program.maxPatternLength = std::max(program.maxPatternLength, numSubBeats);
+            return true;
+        }
+        if (auto* let = dynamic_cast<LetNode*>(statement.get())) {
+            if (!compileExpr(let->value)) return false;
+            emit(Op::Store, getSlot(let->id), -1);
+            return true;
+        }
+        if (auto* loop = dynamic_cast<LoopNode*>(statement.get())) {
+            if (!compileExpr(loop->iterations)) return false;
+            const int begin = emit(Op::LoopBegin, 0, -1);
+            program.maxLoopDepth = std::max(program.maxLoopDepth, ++loopDepth);
+            if (!compileStatements(loop->body)) return false;
+            emit(Op::LoopEnd, begin + 1, 0);
+            program.code[(size_t)begin].arg = (int)program.code.size();
+            loopDepth--;
+            return true;
+        }
+        return fail("Error: unknown statement type");
+    }
+};
+
+}
+
+
+SongProgram::Ptr compileSongProgram(ScriptPtr script, ErrorInfo* errorInfo) {
+    if (!script) return nullptr;
+    SongProgram::Ptr program = new SongProgram();
+    SongCompiler compiler{ *program, errorInfo };
+    if (!compiler.compileStatements(script->statements)) return nullptr;
+    return program;
+}
+
+
+
+/*
+-------------------============ MACHINE ============-------------------
+*/
+
+SongCursor::~SongCursor() {
+    if (program != nullptr) program->decReferenceCount();
+}
+
+
+SongCursor::SongCursor(SongCursor&& other) noexcept {
+    *this = std::move(other);
+}
+
+
+SongCursor& SongCursor::operator=(SongCursor&& other) noexcept {
+    if (this == &other) return *this;
+    if (program != nullptr) program->decReferenceCount();
+    program = std::exchange(other.program, nullptr);
+    startRng = other.startRng;
+    rng = other.rng;
+    pc = other.pc;
+    stackTop = other.stackTop;
+    loopDepth = other.loopDepth;
+    segment = other.segment;
+    segmentPosition = other.segmentPosition;
+    lastFreq = other.lastFreq;
+    failed = other.failed;
+    stack = std::move(other.stack);
+    loopsRemaining = std::move(other.loopsRemaining);
+    slots = std::move(other.slots);
+    patternBuffer = std::move(other.patternBuffer);
+    return *this;
+}
+
+
+SongCursorSize& SongCursorSize::include(const SongProgram* program) {
+    if (program == nullptr) return *this;
+    stackDepth = std::max(stackDepth, program->maxStackDepth);
+    loopDepth = std::max(loopDepth, program->maxLoopDepth);
+    slotCount = std::max(slotCount, (int)program->slotNames.size());
+    patternLength = std::max(patternLength, program->maxPatternLength);
+    return *this;
+}
+
+
+SongCursorSize& SongCursorSize::include(const SongCursorSize& other) {
+    stackDepth = std::max(stackDepth, other.stackDepth);
+    loopDepth = std::max(loopDepth, other.loopDepth);
+    slotCount = std::max(slotCount, other.slotCount);
+    patternLength = std::max(patternLength, other.patternLength);
+    return *this;
+}
+
+
+void SongCursor::reserve(const SongCursorSize& size) {
+    if ((int)stack.size() < size.stackDepth) stack.resize((size_t)size.stackDepth);
+    if ((int)loopsRemaining.size() < size.loopDepth) loopsRemaining.resize((size_t)size.loopDepth);
+    if ((int)slots.size() < size.slotCount) slots.resize((size_t)size.slotCount);
+    if ((int)patternBuffer.capacity() < size.patternLength) patternBuffer.reserve((size_t)size.patternLength);
+}
+
+
+void SongCursor::adoptStorage(SongCursor& bigger) {
+    //reserve sizes these, so they're as big as their size
+    auto swapIn = [](auto& current, auto& larger) {
+        if (larger.size() <= current.size()) return;
+        std::copy(current.begin(), current.end(), larger.begin());
+        std::swap(current, larger);
+    };
+    swapIn(stack, bigger.stack);
+    swapIn(loopsRemaining, bigger.loopsRemaining);
+    swapIn(slots, bigger.slots);
+
+    if (bigger.patternBuffer.capacity() <= patternBuffer.capacity()) return;
+    bigger.patternBuffer.assign(patternBuffer.begin(), patternBuffer.end());     //fits in what was reserved, so no allocation
+    std::swap(patternBuffer, bigger.patternBuffer);
+}
+
+
+SongProgram* SongCursor::start(SongProgram* newProgram, const CounterRng& newRng) {
+    SongProgram* old = nullptr;
+    if (newProgram != program) {
+        old = program;
+        program = newProgram;
+        if (program != nullptr) program->incReferenceCount();
+    }
+
+    //only allocates for a program bigger than the cursor was reserved for. voices reserve for every song up front
+    if (program != nullptr) reserve(SongCursorSize().include(program));
+    for (auto& slot : slots) slot = {};
+    startRng = newRng;
+    rewind();
+    return old;
+}
+
+
+int SongCursor::findSlot(const std::string& name) const {
+    if (program == nullptr) return -1;
+    for (size_t i = 0; i < program->slotNames.size(); i++) {
+        if (program->slotNames[i] == name) return (int)i;
+    }
+    return -1;
+}
+
+
+void SongCursor::importVariables(const std::map<std::string, float>& vars) {
+    if (program == nullptr) return;
+    for (size_t i = 0; i < program->slotNames.size(); i++) {
+        auto it = vars.find(program->slotNames[i]);
+        if (it == vars.end()) continue;
+        slots[i].importedValue = (int)it->second;
+        slots[i].imported = true;
+    }
+    rewind();
+}
+
+
+void SongCursor::importVariables(const SongCursor& other) {
+    if (program == nullptr) return;
+    for (size_t i = 0; i < program->slotNames.size(); i++) {
+        const int otherSlot = other.findSlot(program->slotNames[i]);
+        if (otherSlot < 0 || other.slots[(size_t)otherSlot].state == Unset) continue;
+        slots[i].importedValue = other.slots[(size_t)otherSlot].value;
+        slots[i].imported = true;
+    }
+    rewind();
+}
+
+
+void SongCursor::exportVariables(std::map<std::string, float>& vars) const {
+    if (program == nullptr) return;
+    for (size_t i = 0; i < program->slotNames.size(); i++) {
+        if (slots[i].state == Assigned) vars[program->slotNames[i]] = (float)slots[i].value;
+    }
+}
+
+
+void SongCursor::rewind() {
+    rng = startRng;
+    pc = 0;
+    stackTop = 0;
+    loopDepth = 0;
+    segment = -1;
+    segmentPosition = 0;
+    lastFreq = 0.0f;
+    failed = false;
+    for (auto& slot : slots) {
+        slot.value = slot.importedValue;
+        slot.state = slot.imported ? Imported : Unset;
+    }
+}
+
+
+bool SongCursor::fail(ErrorInfo* errorInfo, const std::string& message) {
+    failed = true;
+    if (errorInfo != nullptr) setErrorInfo(errorInfo, message, 0, 0, "");
+    return false;
+}
+
+
+//the segment's next element, with where its note starts filled in. false at the end of the segment
+bool SongCursor::nextFromSegment(SongStep& step) {
+    const auto& elements = program->segments[(size_t)segment];
+    if (segmentPosition >= (int)elements.size()) {
+        segment = -1;
+        return false;
+    }
+    const SegmentElement& source = elements[(size_t)segmentPosition++];
+    step.endFrequency = source.endFrequency;
+    step.duration = source.duration;
+    if (source.patternStart < 0) {
+        step.type = SongElement::Type::Note;
+        step.startFrequency = lastFreq;
+        step.pattern = nullptr;
+        step.patternLength = 0;
+        lastFreq = source.endFrequency;
+    }
+    else {
+        step.type = SongElement::Type::Pattern;
+        step.startFrequency = -1.0f;
+        step.pattern = program->patternPool.data() + source.patternStart;
+        step.patternLength = source.patternLength;
+    }
+    return true;
+}
+
+
+bool SongCursor::next(SongElement& element, ErrorInfo* errorInfo, int maxSteps) {
+    SongStep step;
+    if (!next(step, errorInfo, maxSteps)) return false;
+    element.type = step.type;
+    element.startFrequency = step.startFrequency;
+    element.endFrequency = step.endFrequency;
+    element.duration = step.duration;
+    element.beatPattern.assign(step.pattern, step.pattern + step.patternLength);    //reuses the element's storage
+    return true;
+}
+
+
+bool SongCursor::next(SongStep& step, ErrorInfo* errorInfo, int maxSteps) {
+    if (program == nullptr || failed) return false;
+    if (segment >= 0 && nextFromSegment(step)) return true;
+
+    int* const values = stack.data();
+    const SongInstruction* code = program->code.data();
+    const int codeLength = (int)program->code.size();
+    int sp = stackTop;     //one past the top
+
+    for (int steps = 0; pc < codeLength; steps++) {
+        if (steps >= maxSteps) return fail(errorInfo, "Error: song took too long to get to its next note");
+        const SongInstruction& instruction = code[pc++];
+        switch (instruction.op) {
+        case Op::Push:
+            values[sp++] = instruction.arg;
+            break;
+        case Op::Load: {
+            const Slot& slot = slots[(size_t)instruction.arg];
+            if (slot.state == Unset) return fail(errorInfo, "Error: variable used before initialization: " + program->slotNames[(size_t)instruction.arg]);
+            values[sp++] = slot.value;
+            break;
+        }
+        case Op::Store:
+            slots[(size_t)instruction.arg].value = values[--sp];
+            slots[(size_t)instruction.arg].state = Assigned;
+            break;
+        case Op::Add:
+            sp--;
+            values[sp - 1] = songAdd(values[sp - 1], values[sp]);
+            break;
+        case Op::Subtract:
+            sp--;
+            values[sp - 1] = songSubtract(values[sp - 1], values[sp]);
+            break;
+        case Op::Multiply:
+            sp--;
+            values[sp - 1] = songMultiply(values[sp - 1], values[sp]);
+            break;
+        case Op::Divide:
+            sp--;
+            if (values[sp] == 0) return fail(errorInfo, "Error: division by zero");
+            values[sp - 1] = songDivide(values[sp - 1], values[sp]);
+            break;
+        case Op::Rand: {
+            sp--;
+            int min = values[sp - 1];
+            int max = values[sp];
+            if (max < min) std::swap(min, max);
+            values[sp - 1] = rng.nextInt(min, max);
+            break;
+        }
+        case Op::Note: {
+            sp -= 2;
+            const float freq = (float)values[sp];
+            step.type = SongElement::Type::Note;
+            step.startFrequency = lastFreq;
+            step.endFrequency = freq;
+            step.duration = (float)values[sp + 1];
+            step.pattern = nullptr;
+            step.patternLength = 0;
+            lastFreq = freq;
+            stackTop = sp;
+            return true;
+        }
+        case Op::Pattern:
+            sp -= instruction.arg;
+            step.type = SongElement::Type::Pattern;
+            step.startFrequency = step.endFrequency = step.duration = -1.0f;
+            patternBuffer.assign(values + sp, values + sp + instruction.arg);     //reserved for the program's longest, in start
+            step.pattern = patternBuffer.data();
+            step.patternLength = instruction.arg;
+            stackTop = sp;
+            return true;
+        case Op::LoopBegin: {
+            const int iterations = values[--sp];
+            if (iterations <= 0) pc = instruction.arg;
+            else loopsRemaining[(size_t)loopDepth++] = iterations;
+            break;
+        }
+        case Op::LoopEnd:
+            if (--loopsRemaining[(size_t)loopDepth - 1] > 0) pc = instruction.arg;
+            else loopDepth--;
+            break;
+        case Op::Segment:
+            segment = instruction.arg;
+            segmentPosition = 0;
+            if (nextFromSegment(step)) {
+                stackTop = sp;
+                return true;
+            }
+            break;
+        }
+    }
+    stackTop = sp;
+    return false;
+}
+
+
+std::vector<SongElement> SongCursor::run(SongProgram& newProgram, ErrorInfo* errorInfo, std::map<std::string, float>* vars, CounterRng* songRng) {
+    //not the audio thread, so the old program can just be let go
+    if (SongProgram* old = start(&newProgram, *songRng)) old->decReferenceCount();
+    if (vars != nullptr) importVariables(*vars);
+
+    std::vector<SongElement> song;
+    SongElement element(0.0f, 0.0f, 0.0f);
+    while (next(element, errorInfo)) song.push_back(element);
+    *songRng = rng;
+    if (failed) return {};
+
+    //hand the script's variables back, like evaluateScript does
+    if (vars != nullptr) exportVariables(*vars);
+    return song;
+}
+
+
+/*
+-------------------============ BATCH ============-------------------
+Lanes are the song's instances, side by side. The whole stack moves together, since
+how deep it is only depends on where in the code it is. Lanes that aren't active still
+get the arithmetic done on them (it's cheaper than checking), but never store, draw a
+rand, hit an error or play anything.
+*/
+
+void SongBatch::start(SongProgram* newProgram, const CounterRng* laneRngs, int newNumLanes) {
+    program = newProgram;
+    numLanes = juce::jlimit(0, maxLanes, newNumLanes);
+    lanes = (LaneMask)((1u << numLanes) - 1);
+    active = program != nullptr ? lanes : 0;
+    failed = 0;
+    pc = 0;
+    stackTop = 0;
+    loopDepth = 0;
+    segment = -1;
+    segmentPosition = 0;
+    for (int lane = 0; lane < numLanes; lane++) {
+        rngs[(size_t)lane] = laneRngs[lane];
+        lastFreqs[(size_t)lane] = 0.0f;
+        stepCounts[(size_t)lane] = 0;
+        errors[(size_t)lane] = {};
+    }
+    if (program == nullptr) return;
+
+    stack.assign((size_t)(program->maxStackDepth * maxLanes), 0);
+    loopsRemaining.assign((size_t)(program->maxLoopDepth * maxLanes), 0);
+    outerMasks.assign((size_t)program->maxLoopDepth, 0);
+    slotValues.assign(program->slotNames.size() * maxLanes, 0);
+    slotsSet.assign(program->slotNames.size(), 0);
+}
+
+
+void SongBatch::exportVariables(int lane, std::map<std::string, float>& vars) const {
+    if (program == nullptr || lane < 0 || lane >= numLanes) return;
+    for (size_t i = 0; i < program->slotNames.size(); i++) {
+        if ((slotsSet[i] >> lane) & 1) vars[program->slotNames[i]] = (float)slotValues[i * maxLanes + (size_t)lane];
+    }
+}
+
+
+void SongBatch::fail(int lane, const std::string& message) {
+    failed |= (LaneMask)(1u << lane);
+    active &= ~failed;
+    setErrorInfo(&errors[(size_t)lane], message, 0, 0, "");
+}
+
+
+//the segment's next element for every active lane. 0 at the end of the segment
+SongBatch::LaneMask SongBatch::nextFromSegment(Steps& steps) {
+    const auto& elements = program->segments[(size_t)segment];
+    if (segmentPosition >= (int)elements.size() || active == 0) {
+        segment = -1;
+        return 0;
+    }
+    const SegmentElement& source = elements[(size_t)segmentPosition++];
+    for (int lane = 0; lane < numLanes; lane++) {
+        if (!((active >> lane) & 1)) continue;
+        SongStep& step = steps[(size_t)lane];
+        step.endFrequency = source.endFrequency;
+        step.duration = source.duration;
+        if (source.patternStart < 0) {
+            step.type = SongElement::Type::Note;
+            step.startFrequency = lastFreqs[(size_t)lane];
+            step.pattern = nullptr;
+            step.patternLength = 0;
+            lastFreqs[(size_t)lane] = source.endFrequency;
+        }
+        else {
+            step.type = SongElement::Type::Pattern;
+            step.startFrequency = -1.0f;
+            step.pattern = program->patternPool.data() + source.patternStart;
+            step.patternLength = source.patternLength;
+        }
+        stepCounts[(size_t)lane] = 0;
+    }
+    return active;
+}
+
+
+SongBatch::LaneMask SongBatch::next(Steps& steps, int maxSteps) {
+    if (program == nullptr) return 0;
+    if (segment >= 0) {
+        const LaneMask emitted = nextFromSegment(steps);
+        if (emitted != 0) return emitted;
+    }
+
+    const SongInstruction* code = program->code.data();
+    const int codeLength = (int)program->code.size();
+    int sp = stackTop;
+
+    while (pc < codeLength) {
+        if ((lanes & ~failed) == 0) break;
+        for (int lane = 0; lane < numLanes; lane++) {
+            if (((active >> lane) & 1) && stepCounts[(size_t)lane]++ >= maxSteps) fail(lane, "Error: song took too long to get to its next note");
+        }
+
+        const SongInstruction& instruction = code[pc++];
+        switch (instruction.op) {
+        case Op::Push: {
+            int* top = lanesAt(sp++);
+            for (int lane = 0; lane < maxLanes; lane++) top[lane] = instruction.arg;
+            break;
+        }
+        case Op::Load: {
+            const LaneMask unset = active & ~slotsSet[(size_t)instruction.arg];
+            for (int lane = 0; lane < numLanes; lane++) {
+                if ((unset >> lane) & 1) fail(lane, "Error: variable used before initialization: " + program->slotNames[(size_t)instruction.arg]);
+            }
+            std::copy_n(slotValues.data() + (size_t)instruction.arg * maxLanes, maxLanes, lanesAt(sp++));
+            break;
+        }
+        case Op::Store: {
+            const int* top = lanesAt(--sp);
+            int* slot = slotValues.data() + (size_t)instruction.arg * maxLanes;
+            for (int lane = 0; lane < maxLanes; lane++) {
+                if ((active >> lane) & 1) slot[lane] = top[lane];
+            }
+            slotsSet[(size_t)instruction.arg] |= active;
+            break;
+        }
+        //wrapping, so the garbage in inactive lanes can't overflow either
+        case Op::Add: {
+            const int* right = lanesAt(--sp);
+            int* left = lanesAt(sp - 1);
+            for (int lane = 0; lane < maxLanes; lane++) left[lane] = songAdd(left[lane], right[lane]);
+            break;
+        }
+        case Op::Subtract: {
+            const int* right = lanesAt(--sp);
+            int* left = lanesAt(sp - 1);
+            for (int lane = 0; lane < maxLanes; lane++) left[lane] = songSubtract(left[lane], right[lane]);
+            break;
+        }
+        case Op::Multiply: {
+            const int* right = lanesAt(--sp);
+            int* left = lanesAt(sp - 1);
+            for (int lane = 0; lane < maxLanes; lane++) left[lane] = songMultiply(left[lane], right[lane]);
+            break;
+        }
+        case Op::Divide: {
+            const int* right = lanesAt(--sp);
+            int* left = lanesAt(sp - 1);
+            for (int lane = 0; lane < maxLanes; lane++) {
+                const bool running = (active >> lane) & 1;
+                if (right[lane] == 0) {
+                    if (running) fail(lane, "Error: division by zero");
+                    left[lane] = 0;
+                }
+                else left[lane] = songDivide(left[lane], right[lane]);
+            }
+            break;
+        }
+        case Op::Rand: {
+            const int* maxes = lanesAt(--sp);
+            int* mins = lanesAt(sp - 1);
+            for (int lane = 0; lane < maxLanes; lane++) {
+                if (!((active >> lane) & 1)) continue;
+                int min = mins[lane];
+                int max = maxes[lane];
+                if (max < min) std::swap(min, max);
+                mins[lane] = rngs[(size_t)lane].nextInt(min, max);
+            }
+            break;
+        }
+        case Op::Note: {
+            sp -= 2;
+            const int* freqs = lanesAt(sp);
+            const int* durations = lanesAt(sp + 1);
+            for (int lane = 0; lane < numLanes; lane++) {
+                if (!((active >> lane) & 1)) continue;
+                SongStep& step = steps[(size_t)lane];
+                const float freq = (float)freqs[lane];
+                step.type = SongElement::Type::Note;
+                step.startFrequency = lastFreqs[(size_t)lane];
+                step.endFrequency = freq;
+                step.duration = (float)durations[lane];
+                step.pattern = nullptr;
+                step.patternLength = 0;
+                lastFreqs[(size_t)lane] = freq;
+                stepCounts[(size_t)lane] = 0;
+            }
+            if (active != 0) {
+                stackTop = sp;
+                return active;
+            }
+            break;
+        }
+        case Op::Pattern:
+            sp -= instruction.arg;
+            for (int lane = 0; lane < numLanes; lane++) {
+                if (!((active >> lane) & 1)) continue;
+                auto& buffer = patternBuffers[(size_t)lane];
+                buffer.resize((size_t)instruction.arg);
+                for (int i = 0; i < instruction.arg; i++) buffer[(size_t)i] = (uint8_t)lanesAt(sp + i)[lane];
+                SongStep& step = steps[(size_t)lane];
+                step.type = SongElement::Type::Pattern;
+                step.startFrequency = step.endFrequency = step.duration = -1.0f;
+                step.pattern = buffer.data();
+                step.patternLength = instruction.arg;
+                stepCounts[(size_t)lane] = 0;
+            }
+            if (active != 0) {
+                stackTop = sp;
+                return active;
+            }
+            break;
+        //lanes with no iterations drop out for the loop. it's skipped if that's all of them
+        case Op::LoopBegin: {
+            const int* iterations = lanesAt(--sp);
+            int* remaining = loopsRemaining.data() + (size_t)loopDepth * maxLanes;
+            LaneMask looping = 0;
+            for (int lane = 0; lane < maxLanes; lane++) {
+                remaining[lane] = iterations[lane];
+                if (((active >> lane) & 1) && iterations[lane] > 0) looping |= (LaneMask)(1u << lane);
+            }
+            if (looping == 0) pc = instruction.arg;
+            else {
+                outerMasks[(size_t)loopDepth++] = active;
+                active = looping;
+            }
+            break;
+        }
+        //lanes that are done wait for the rest, then the loop's over for all of them
+        case Op::LoopEnd: {
+            int* remaining = loopsRemaining.data() + (size_t)(loopDepth - 1) * maxLanes;
+            LaneMask looping = 0;
+            for (int lane = 0; lane < maxLanes; lane++) {
+                if (((active >> lane) & 1) && --remaining[lane] > 0) looping |= (LaneMask)(1u << lane);
+            }
+            if (looping != 0) {
+                active = looping;
+                pc = instruction.arg;
+            }
+            else active = outerMasks[(size_t)--loopDepth] & ~failed;
+            break;
+        }
+        case Op::Segment: {
+            segment = instruction.arg;
+            segmentPosition = 0;
+            const LaneMask emitted = nextFromSegment(steps);
+            if (emitted != 0) {
+                stackTop = sp;
+                return emitted;
+            }
+            break;
+        }
+        }
+    }
+    stackTop = sp;
+    return 0;
+}
+
+
+std::vector<std::vector<SongElement>> SongBatch::run(SongProgram& newProgram, const CounterRng* laneRngs, int newNumLanes) {
+    start(&newProgram, laneRngs, newNumLanes);
+    std::vector<std::vector<SongElement>> songs((size_t)numLanes);
+
+    Steps steps;
+    while (const LaneMask emitted = next(steps)) {
+        for (int lane = 0; lane < numLanes; lane++) {
+            if (!((emitted >> lane) & 1)) continue;
+            const SongStep& step = steps[(size_t)lane];
+            SongElement element(step.startFrequency, step.endFrequency, step.duration);
+            element.type = step.type;
+            element.beatPattern.assign(step.pattern, step.pattern + step.patternLength);
+            songs[(size_t)lane].push_back(std::move(element));
+        }
+    }
+    for (int lane = 0; lane < numLanes; lane++) {
+        if ((failed >> lane) & 1) songs[(size_t)lane].clear();
+    }
+    return songs;
+}
+
+
+bool testRunSong(SongBatch& batch, SongProgram* program, uint64_t seed, ErrorInfo& error,
+    const std::function<bool()>& cancelled, int maxElements, int maxSteps) {
+    std::array<CounterRng, SongBatch::maxLanes> rngs;
+    for (int lane = 0; lane < SongBatch::maxLanes; lane++) rngs[(size_t)lane] = CounterRng(seed, (uint64_t)lane);
+    batch.start(program, rngs.data(), SongBatch::maxLanes);
+
+    SongBatch::Steps steps;
+    SongBatch::LaneMask noted = 0;     //lanes that got to a note
+    for (int i = 0; i < maxElements; i++) {
+        if (cancelled && cancelled()) return false;
+        if (batch.getFailedLanes() != 0) break;
+        const SongBatch::LaneMask emitted = batch.next(steps, maxSteps);
+        if (emitted == 0) break;
+        for (int lane = 0; lane < SongBatch::maxLanes; lane++) {
+            if (((emitted >> lane) & 1) && steps[(size_t)lane].type == SongElement::Type::Note) noted |= (SongBatch::LaneMask)(1u << lane);
+        }
+    }
+
+    for (int lane = 0; lane < SongBatch::maxLanes; lane++) {
+        if ((batch.getFailedLanes() >> lane) & 1) {
+            error = batch.getError(lane);
+            return false;
+        }
+        if (!((noted >> lane) & 1)) {
+            setErrorInfo(&error, "Error: song doesn't play any notes", 0, 0, "");
+            return false;
+        }
+    }
+    return !(cancelled && cancelled());
+}
+
+
+
+
+/*
+-------------------============ BENCHMARK ============-------------------
+*/
+
+namespace {
+
+//the cases from Notes/test cases.md that should work
+const std::vector<std::string> testCaseCorpus = {
+    "120 1000, 240 1000, 0 500",
+    "[120 500, 240 500] 4, 0 500",
+    "[120 250, [240 100, 360 100] 3] 2, 0 500",
+    "[1 1, 2 2] rand(3 6), 0 500",
+    "rand(100 200) 1000, rand(200 300) 1000, 0 500",
+    "120 rand(500 1000), 240 rand(750 1250), 0 500",
+    "[120 500, 240 500] rand(2 5), 0 500",
+    "[rand(100 150) rand(400 600), rand(200 250) rand(300 500)] rand(3 6), 0 500",
+    "pattern(1 2 1), 120 500, 240 500, 360 500, 0 500",
+    "pattern(2 0 3 1), 120 250, 240 250, 360 167, 480 167, 600 167, 720 500, 0 500",
+    "pattern(rand(1 3) rand(0 2) rand(1 3)), 120 500, 240 500, 360 500, 0 500",
+    "pattern(2 0), [rand(100 150) 500, rand(200 250) 500] rand(2 4), 0 500, 120 1, rand(120 130) rand(500 600), [pattern(1 rand(0 3) 0 0), rand(120 130) 500, pattern(2 0 rand(1 5)), rand(240 250) 500] rand(1 5), 0 500",
+    "0 0",
+    "20000 1",
+    "[120 1] 0",
+    "pattern(0 0 0), 120 500, 0 500",
+    "100 100, 200 100, 300 100, 400 100, 500 100, [600 50, 700 50, 800 50] 10, 900 100, 1000 100, 1100 100, 1200 100, 0 500",
+    "[100 100, [200 50, 300 50] 3, 400 100] 2, [500 200, [600 100, 700 100] 2] 3, 0 500"
+};
+
+
+bool sameSong(const std::vector<SongElement>& a, const std::vector<SongElement>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].type != b[i].type || a[i].beatPattern != b[i].beatPattern
+            || a[i].startFrequency != b[i].startFrequency || a[i].endFrequency != b[i].endFrequency
+            || a[i].duration != b[i].duration) return false;
+    }
+    return true;
+}
+
+}
+
+
+SongBenchmarkResult benchmarkSongEvaluators(std::vector<std::string> corpus, int instancesPerScript) {
+    if (corpus.empty()) corpus = testCaseCorpus;
+
+    std::vector<ScriptPtr> scripts;
+    std::vector<SongProgram::Ptr> programs;
+    for (auto& songcode : corpus) {
+        ErrorInfo error = {};
+        ScriptPtr script = generateAST(songcode, &error);
+        if (error.message != "" || script == nullptr) continue;
+        SongProgram::Ptr program = compileSongProgram(script, &error);
+        if (program == nullptr) continue;
+        scripts.push_back(script);
+        programs.push_back(program);
+    }
+
+    SongBenchmarkResult result;
+    result.numScripts = (int)scripts.size();
+    if (scripts.empty() || instancesPerScript <= 0) return result;
+
+    SongCursor cursor;
+    const int totalInstances = result.numScripts * instancesPerScript;
+    size_t treeElements = 0, bytecodeElements = 0, batchElements = 0;    //so nothing gets optimized away
+
+    //same streams for both, so they should make the same songs
+    auto startTicks = juce::Time::getHighResolutionTicks();
+    for (size_t s = 0; s < scripts.size(); s++) {
+        for (int i = 0; i < instancesPerScript; i++) {
+            ErrorInfo error = {};
+            std::map<std::string, float> env;
+            CounterRng rng(1, (uint64_t)i);
+            treeElements += evaluateAST(scripts[s], &error, &env, &rng).size();
+        }
+    }
+    const double treeWalkSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+
+    startTicks = juce::Time::getHighResolutionTicks();
+    for (size_t s = 0; s < programs.size(); s++) {
+        for (int i = 0; i < instancesPerScript; i++) {
+            ErrorInfo error = {};
+            std::map<std::string, float> env;
+            CounterRng rng(1, (uint64_t)i);
+            bytecodeElements += cursor.run(*programs[s], &error, &env, &rng).size();
+        }
+    }
+    const double bytecodeSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+
+    //the last batch of a script can be part full
+    SongBatch batch;
+    std::array<CounterRng, SongBatch::maxLanes> rngs;
+    startTicks = juce::Time::getHighResolutionTicks();
+    for (size_t s = 0; s < programs.size(); s++) {
+        for (int i = 0; i < instancesPerScript; i += SongBatch::maxLanes) {
+            const int lanes = juce::jmin(SongBatch::maxLanes, instancesPerScript - i);
+            for (int lane = 0; lane < lanes; lane++) rngs[(size_t)lane] = CounterRng(1, (uint64_t)(i + lane));
+            for (auto& song : batch.run(*programs[s], rngs.data(), lanes)) batchElements += song.size();
+        }
+    }
+    const double batchSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+
+    for (size_t s = 0; s < scripts.size() && result.outputsMatch; s++) {
+        for (int i = 0; i < 16; i++) {
+            ErrorInfo treeError = {}, bytecodeError = {};
+            std::map<std::string, float> treeEnv, bytecodeEnv;
+            CounterRng treeRng(2, (uint64_t)i), bytecodeRng(2, (uint64_t)i);
+            auto treeSong = evaluateAST(scripts[s], &treeError, &treeEnv, &treeRng);
+            auto bytecodeSong = cursor.run(*programs[s], &bytecodeError, &bytecodeEnv, &bytecodeRng);
+            if (!sameSong(treeSong, bytecodeSong) || treeEnv != bytecodeEnv || treeError.message != bytecodeError.message) {
+                result.outputsMatch = false;
+                break;
+            }
+        }
+    }
+
+    for (size_t s = 0; s < programs.size() && result.outputsMatch; s++) {
+        for (int lane = 0; lane < SongBatch::maxLanes; lane++) rngs[(size_t)lane] = CounterRng(2, (uint64_t)lane);
+        const auto batchSongs = batch.run(*programs[s], rngs.data(), SongBatch::maxLanes);
+        for (int lane = 0; lane < SongBatch::maxLanes; lane++) {
+            ErrorInfo error = {};
+            CounterRng rng(2, (uint64_t)lane);
+            if (!sameSong(batchSongs[(size_t)lane], cursor.run(*programs[s], &error, nullptr, &rng))
+                || batch.getError(lane).message != error.message) {
+                result.outputsMatch = false;
+                break;
+            }
+        }
+    }
+
+    result.outputsMatch = result.outputsMatch && treeElements == bytecodeElements && batchElements == bytecodeElements;
+    result.treeWalkInstancesPerSecond = treeWalkSeconds > 0.0 ? totalInstances / treeWalkSeconds : 0.0;
+    result.bytecodeInstancesPerSecond = bytecodeSeconds > 0.0 ? totalInstances / bytecodeSeconds : 0.0;
+    result.batchInstancesPerSecond = batchSeconds > 0.0 ? totalInstances / batchSeconds : 0.0;
+    return result;
+}
@@ -0,0 +1,286 @@
+/*
+  ==============================================================================
+
+    SongBytecode.h
+    Created: 22 Oct 2026 10:37:12am
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include <functional>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+#include "Evaluator.h"
+#include "CounterRng.h"
+
+
+/*
+-------------------============ SONG BYTECODE ============-------------------
+
+The AST compiled into a flat list of instructions for a little stack machine.
+Chorus voices evaluate a fresh randomized instance of their song every time they
+restart, so the songs get compiled once (when the species set is built) and each
+instance just runs the program: no dynamic_casts, and variables live in numbered
+slots instead of being looked up by name.
+
+Run all at once (SongCursor::run), the output is the same as evaluateAST's, rand()
+draws included, so the same rng stream gives the same song either way. evaluateAST
+stays as the reference.
+*/
+
+
+struct SongInstruction {
+	enum class Op : uint8_t {
+		Push,			//push arg
+		Load,			//push variable slot arg
+		Store,			//pop into variable slot arg
+		Add,			//arithmetic pops right, then left, and pushes the result
+		Subtract,
+		Multiply,
+		Divide,
+		Rand,			//pops max then min, pushes a random int between them
+		Note,			//pops duration then frequency, and emits a note
+		Pattern,		//pops arg sub beats, and emits a pattern
+		LoopBegin,		//pops the iteration count. nothing to do jumps to arg (past the loop)
+		LoopEnd,		//back to arg (the start of the body) until the count runs out
+		Segment			//emits every element of segment arg, one per element
+	};
+
+	Op op;
+	int arg = 0;
+};
+
+
+//a note or pattern in a segment. a pattern is a stretch of the program's patternPool
+struct SegmentElement {
+	float endFrequency = 0.0f;
+	float duration = 0.0f;
+	int patternStart = -1;		//-1 for notes
+	int patternLength = 0;
+};
+
+
+//a compiled script. immutable once compiled, so any number of voices can run it
+struct SongProgram : public juce::ReferenceCountedObject {
+	using Ptr = juce::ReferenceCountedObjectPtr<SongProgram>;
+
+	std::vector<SongInstruction> code;
+	std::vector<std::string> slotNames;		//variable names, by slot. for trading values with an env map
+
+	//stretches of song that come out the same every time (no rands, no variables), worked out once
+	//at compile time. notes don't have a start frequency yet, that's whatever came before
+	std::vector<std::vector<SegmentElement>> segments;
+	static constexpr int maxSegmentLength = 256;	//constant loops bigger than this keep their loop, around a segment of their body
+
+	//every segment's patterns, back to back. a pattern that comes up more than once is only in here once
+	std::vector<uint8_t> patternPool;
+
+	//what a machine needs to run it
+	int maxStackDepth = 0;
+	int maxLoopDepth = 0;
+	int maxPatternLength = 0;	//of the patterns built as it runs (the ones with rands or variables)
+};
+
+
+//nullptr for a null script (or an AST with a node the compiler doesn't know, which sets errorInfo)
+SongProgram::Ptr compileSongProgram(ScriptPtr script, ErrorInfo* errorInfo);
+
+
+//a song element that doesn't own its pattern, for pulling songs along without copying patterns around.
+//the pattern is either in the program's patternPool or the cursor's own buffer (for patterns with rands
+//or variables), and stays put until the cursor's next pattern, or until the program's let go of
+struct SongStep {
+	SongElement::Type type = SongElement::Type::Note;
+	float startFrequency = 0.0f;	//notes only
+	float endFrequency = 0.0f;
+	float duration = 0.0f;
+	const uint8_t* pattern = nullptr;	//patterns only
+	int patternLength = 0;
+};
+
+
+//room in a SongCursor for running programs without allocating. starts at what every cursor reserves,
+//which covers any sane song, and include grows it to fit bigger programs
+struct SongCursorSize {
+	int stackDepth = 64;
+	int loopDepth = 16;
+	int slotCount = 32;
+	int patternLength = 16;
+
+	SongCursorSize& include(const SongProgram* program);	//nullptr for no song
+	SongCursorSize& include(const SongCursorSize& other);
+	bool operator==(const SongCursorSize& other) const {
+		return stackDepth == other.stackDepth && loopDepth == other.loopDepth && slotCount == other.slotCount && patternLength == other.patternLength;
+	}
+	bool operator!=(const SongCursorSize& other) const { return !(*this == other); }
+};
+
+
+//one running instance of a song program. voices pull their songs out of one of these an element at
+//a time, so a song costs the same to start however long it is, and only takes as much memory as its
+//deepest nesting ([...] 10000 is one loop counter, not 10000 copies of the body). rands are drawn
+//when the song gets to them, from the cursor's own copy of the stream.
+//
+//holds a reference to its program. start hands the old one back instead of dropping it, so the audio
+//thread can send it somewhere else to be released
+class SongCursor {
+public:
+	SongCursor() { reserve(SongCursorSize()); }
+	~SongCursor();
+	SongCursor(SongCursor&& other) noexcept;
+	SongCursor& operator=(SongCursor&& other) noexcept;
+	SongCursor(const SongCursor&) = delete;
+	SongCursor& operator=(const SongCursor&) = delete;
+
+	//call off the audio thread to make room for bigger programs than the defaults
+	void reserve(const SongCursorSize& size);
+
+	//takes bigger's storage wherever it's bigger, with the song so far in it, and leaves the old storage in bigger.
+	//for growing a cursor on the audio thread without allocating: bigger is reserved off it and never started.
+	//a step viewing the old pattern buffer has to move to getPatternBuffer()
+	void adoptStorage(SongCursor& bigger);
+	const uint8_t* getPatternBuffer() const { return patternBuffer.data(); }
+
+	//starts a new instance of program (nullptr for no song), drawing its rands from a copy of rng.
+	//returns the program this had before, along with the reference to it, if it was a different one
+	SongProgram* start(SongProgram* newProgram, const CounterRng& newRng);
+
+	//variables set before the song starts. call right after start.
+	//the cursor version reads another song as far as it's got, like the resonator song reading the main song's lets
+	void importVariables(const std::map<std::string, float>& vars);
+	void importVariables(const SongCursor& other);
+	void exportVariables(std::map<std::string, float>& vars) const;		//the song's own lets
+
+	//runs to the next note or pattern. false at the end of the song, or on an error (into errorInfo, if there is one).
+	//taking more than maxSteps instructions to get there is an error too, so [let a = 1] 100000000 can't stall the caller
+	bool next(SongStep& step, ErrorInfo* errorInfo = nullptr, int maxSteps = std::numeric_limits<int>::max());
+
+	//same, copying the pattern into element (reusing its storage)
+	bool next(SongElement& element, ErrorInfo* errorInfo = nullptr, int maxSteps = std::numeric_limits<int>::max());
+
+	//back to the start of the same instance: same rands, same imported variables
+	void rewind();
+
+	//the whole song at once, same as evaluateAST. rng is advanced past everything the song drew
+	std::vector<SongElement> run(SongProgram& newProgram, ErrorInfo* errorInfo, std::map<std::string, float>* vars, CounterRng* rng);
+
+private:
+	//values imported but never assigned don't get exported
+	enum SlotState : uint8_t { Unset = 0, Imported, Assigned };
+
+	struct Slot {
+		int value = 0;
+		int importedValue = 0;		//for rewind
+		SlotState state = Unset;
+		bool imported = false;
+	};
+
+	bool fail(ErrorInfo* errorInfo, const std::string& message);
+	int findSlot(const std::string& name) const;
+	bool nextFromSegment(SongStep& step);
+
+	SongProgram* program = nullptr;
+	CounterRng startRng;
+	CounterRng rng;
+	int pc = 0;
+	int stackTop = 0;
+	int loopDepth = 0;
+	int segment = -1;		//the segment being emitted, if there is one
+	int segmentPosition = 0;
+	float lastFreq = 0.0f;
+	bool failed = false;
+
+	std::vector<int> stack;
+	std::vector<int> loopsRemaining;
+	std::vector<Slot> slots;
+	std::vector<uint8_t> patternBuffer;		//the last pattern with rands or variables
+};
+
+
+//up to maxLanes instances of one program, run in lockstep: one pass over the code for all of them. every
+//lane runs the same instruction at the same time on its own values, variables and rng stream, so lane i
+//comes out the same as a SongCursor started with rngs[i]. the only way lanes can go different ways is a
+//loop going round a different number of times, and lanes that are done with a loop just sit masked off
+//until the rest are. lanes are side by side in memory, so the arithmetic is one loop over them.
+//
+//for checking or pre-generating lots of variants of a song for about the cost of one. not for the audio
+//thread (it allocates in start), voices each stream their own instance with a SongCursor
+class SongBatch {
+public:
+	static constexpr int maxLanes = 8;
+	using LaneMask = uint32_t;
+	using Steps = std::array<SongStep, maxLanes>;
+
+	//starts numLanes instances of program, lane i drawing its rands from a copy of rngs[i]
+	void start(SongProgram* newProgram, const CounterRng* rngs, int numLanes);
+
+	//runs every lane to its next note or pattern, into steps. returns the lanes that got one: the ones
+	//still going, apart from any waiting on a loop. 0 once they're all finished or failed.
+	//maxSteps is per lane, like SongCursor::next
+	LaneMask next(Steps& steps, int maxSteps = std::numeric_limits<int>::max());
+
+	//lanes that hit an error, and what it was
+	LaneMask getFailedLanes() const { return failed; }
+	const ErrorInfo& getError(int lane) const { return errors[(size_t)lane]; }
+
+	//a lane's lets so far, like SongCursor::exportVariables
+	void exportVariables(int lane, std::map<std::string, float>& vars) const;
+
+	//every lane's whole song, same as SongCursor::run with each rng. failed lanes come out empty
+	std::vector<std::vector<SongElement>> run(SongProgram& newProgram, const CounterRng* rngs, int numLanes);
+
+private:
+	int* lanesAt(int stackDepth) { return stack.data() + (size_t)stackDepth * maxLanes; }
+	void fail(int lane, const std::string& message);
+	LaneMask nextFromSegment(Steps& steps);
+
+	SongProgram::Ptr program;
+	int numLanes = 0;
+	LaneMask lanes = 0;			//every lane that was started
+	LaneMask active = 0;		//lanes running the current instruction
+	LaneMask failed = 0;
+	int pc = 0;
+	int stackTop = 0;
+	int loopDepth = 0;
+	int segment = -1;
+	int segmentPosition = 0;
+
+	std::array<CounterRng, maxLanes> rngs;
+	std::array<float, maxLanes> lastFreqs{};
+	std::array<int, maxLanes> stepCounts{};		//instructions each lane has run since its last element
+	std::array<ErrorInfo, maxLanes> errors;
+	std::array<std::vector<uint8_t>, maxLanes> patternBuffers;
+
+	//lane values side by side: [depth * maxLanes + lane]
+	std::vector<int> stack;
+	std::vector<int> loopsRemaining;
+	std::vector<LaneMask> outerMasks;	//what was active outside each loop being run
+	std::vector<int> slotValues;
+	std::vector<LaneMask> slotsSet;		//per slot, the lanes it's been assigned in
+};
+
+
+//the check a song gets before voices play it: a batch of instances (lane i on stream seed, i), each up to
+//maxElements notes and patterns. false, with the first lane's error, if any of them hits one or never gets
+//to a note (a voice can't start a song like that). cancelled is polled every element, and gives up (false)
+bool testRunSong(SongBatch& batch, SongProgram* program, uint64_t seed, ErrorInfo& error,
+	const std::function<bool()>& cancelled = {}, int maxElements = 20000, int maxSteps = 100000);
+
+
+//instances per second for the tree walker and the bytecode, over a corpus of songs (the working
+//cases from Notes/test cases.md if it's empty). also checks both give the same songs from the same streams
+struct SongBenchmarkResult {
+	double treeWalkInstancesPerSecond = 0.0;
+	double bytecodeInstancesPerSecond = 0.0;
+	double batchInstancesPerSecond = 0.0;		//SongBatch, maxLanes instances a pass
+	int numScripts = 0;
+	bool outputsMatch = true;
+};
+
+SongBenchmarkResult benchmarkSongEvaluators(std::vector<std::string> corpus = {}, int instancesPerScript = 2000);
@@ -9,13 +9,13 @@
 */
 
 #include "songCodeCompiler.h"
+#include "CounterRng.h"
 
 #include <iostream>
 #include <vector>
 #include <string>
 #include <sstream>
 #include <regex>
-#include <random>
 #include <cmath>
 #include <cstdint>
 
@@ -89,7 +89,7 @@ vector<string> tokenizeByBrackets(const string& str) {
 
 
 // Helper function to resolve rand(min, max)
-int resolveRand(const std::string& randToken) {
+int resolveRand(const std::string& randToken, CounterRng& rng) {
     // Check if the string starts with "rand(" and ends with ")"
     if (randToken.substr(0, 5) != "rand(" || randToken.back() != ')') {
         throw std::invalid_argument("Invalid rand() format: " + randToken);
@@ -110,16 +110,12 @@ int resolveRand(const std::string& randToken) {
         throw std::invalid_argument("Invalid range: min must be less than or equal to max: " + randToken);
     }
 
-    // Use static variables for the random number generator to avoid reinitializing every call
-    static std::mt19937 gen(std::time(nullptr));
-    static std::uniform_int_distribution<> dis(0, std::numeric_limits<int>::max());
-
-    // Generate a random number within the range
-    return min + dis(gen) % (max - min + 1);
+    // Generate a random number within the range, from the caller's stream
+    return rng.nextInt(min, max);
 }
 
 
-int resolveLinkedRand(const std::string &lrandToken, std::map<char, int>& linkedRandValues) {
+int resolveLinkedRand(const std::string &lrandToken, std::map<char, int>& linkedRandValues, CounterRng& rng) {
     //check that it is an lrand
     if (lrandToken.substr(0, 6) != "lrand(" || lrandToken.back() != ')') {
         throw std::invalid_argument("Invalid lrand() format: " + lrandToken);
@@ -157,9 +153,7 @@ int resolveLinkedRand(const std::string &lrandToken, std::map<char, int>& linked
     }
 
     // Generate a new random value
-    static std::mt19937 gen(std::time(nullptr));
-    static std::uniform_int_distribution<> dis(0, std::numeric_limits<int>::max());
-    int randomValue = min + dis(gen) % (max - min + 1);
+    int randomValue = rng.nextInt(min, max);
 
     // Store the new value in the map
     linkedRandValues[linkingCharacter] = randomValue;
@@ -305,7 +299,7 @@ std::vector<std::string> firstPassTokenize(const std::string& song, std::string*
 
 //expand all the loops iteratively. Work from the outer to the inner.
 //evals the single lrands and rands for LOOPS ONLY
-vector<string> secondPassTokenize(const vector<string>& tokens, std::string* errorMsg, std::map<char, int>& linkedRandValues) {
+vector<string> secondPassTokenize(const vector<string>& tokens, std::string* errorMsg, std::map<char, int>& linkedRandValues, CounterRng& rng) {
     vector<string> tempTokens(tokens);
 
     while(true){
@@ -363,11 +357,11 @@ vector<string> secondPassTokenize(const vector<string>& tokens, std::string* err
             loopIterationCount = stoi(loopIterationToken);
         }
         else if (regex_match(loopIterationToken, justRandPattern)) {
-            loopIterationCount = resolveRand(loopIterationToken);
+            loopIterationCount = resolveRand(loopIterationToken, rng);
         }
         else {
             juce::Logger::writeToLog("lrand detected: " + loopIterationToken + "\n");
-            loopIterationCount = resolveLinkedRand(loopIterationToken, linkedRandValues);
+            loopIterationCount = resolveLinkedRand(loopIterationToken, linkedRandValues, rng);
 
         }
     }
@@ -410,7 +404,7 @@ vector<string> secondPassTokenize(const vector<string>& tokens, std::string* err
 // lrand(a min max) number
 // number lrand(a min max)
 // lrand(a min max) lrand(a min max)
-vector<string> thirdPassTokenize(const vector<string>& tokens, std::string* errorMsg, std::map<char, int>& linkedRandValues)
+vector<string> thirdPassTokenize(const vector<string>& tokens, std::string* errorMsg, std::map<char, int>& linkedRandValues, CounterRng& rng)
 {
     std::vector<std::string> resolvedTokens;
     std::vector<std::string> resolvedTokens2;
@@ -429,7 +423,7 @@ vector<string> thirdPassTokenize(const vector<string>& tokens, std::string* erro
                 int resolvedValue = -1;
                 //extract/resolve the lrand
                 try {
-                    resolvedValue = resolveLinkedRand(extractedLrand, linkedRandValues);
+                    resolvedValue = resolveLinkedRand(extractedLrand, linkedRandValues, rng);
                 }
                 catch (std::exception& e) {
                     *errorMsg = e.what();
@@ -460,7 +454,7 @@ vector<string> thirdPassTokenize(const vector<string>& tokens, std::string* erro
                 int resolvedValue = -1;
                 string extractedRand = str.substr(pos, endPos + 1 - pos);
                 try {
-                    resolvedValue = resolveRand(str.substr(pos, endPos + 1 - pos));
+                    resolvedValue = resolveRand(str.substr(pos, endPos + 1 - pos), rng);
                 }
                 catch (std::exception& e) {
                     *errorMsg = e.what();
@@ -479,7 +473,7 @@ vector<string> thirdPassTokenize(const vector<string>& tokens, std::string* erro
 }
 
 
-vector<string> tokenize(const string& song, std::string* errorMsg, std::map<char, int>& linkedRandValues)
+vector<string> tokenize(const string& song, std::string* errorMsg, std::map<char, int>& linkedRandValues, CounterRng& rng)
 {   
     vector<string> firstPassTokens = firstPassTokenize(song, errorMsg);
     if (firstPassTokens.empty()) return {};  // Error handling: Return an empty song on error
@@ -487,13 +481,13 @@ vector<string> tokenize(const string& song, std::string* errorMsg, std::map<char
     for (string s : firstPassTokens) {
         juce::Logger::writeToLog(s);
     }
-    vector<string> secondPassTokens = secondPassTokenize(firstPassTokens, errorMsg, linkedRandValues);
+    vector<string> secondPassTokens = secondPassTokenize(firstPassTokens, errorMsg, linkedRandValues, rng);
     if(secondPassTokens.empty()) return {};
     juce::Logger::writeToLog("-------------second pass-------------");
     for (string s : secondPassTokens) {
         juce::Logger::writeToLog(s);
     }
-    vector<string> thirdPassTokens = thirdPassTokenize(secondPassTokens, errorMsg, linkedRandValues);
+    vector<string> thirdPassTokens = thirdPassTokenize(secondPassTokens, errorMsg, linkedRandValues, rng);
     if(thirdPassTokens.empty()) return {};
     juce::Logger::writeToLog("-------------Third pass-------------");
     for (string s : thirdPassTokens) {
@@ -503,9 +497,9 @@ vector<string> tokenize(const string& song, std::string* errorMsg, std::map<char
 }
 
 
-std::vector<SongElement> compileSongcode(const std::string& songcode, std::string* errorMsg, std::map<char, int>& linkedRandValues, juce::Colour& statusColor) {
+std::vector<SongElement> compileSongcode(const std::string& songcode, std::string* errorMsg, std::map<char, int>& linkedRandValues, juce::Colour& statusColor, CounterRng& rng) {
     std::string tokenizeErrors; 
-    std::vector<std::string> tokens = tokenize(songcode, &tokenizeErrors, linkedRandValues);
+    std::vector<std::string> tokens = tokenize(songcode, &tokenizeErrors, linkedRandValues, rng);
     if (tokens.empty()) {
         // Handle error: return an empty vector or throw an exception
         statusColor = juce::Colours::darkred;
@@ -0,0 +1,224 @@
+/*
+  ==============================================================================
+
+    SongcodeCompileThread.h
+    Created: 22 Oct 2026 6:14:50pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "Evaluator.h"
+#include "SongBytecode.h"
+#include "SongBounds.h"
+#include "CounterRng.h"
+
+
+//compiles the editors' songcode on its own thread, so a huge or pathological song can't freeze the ui.
+//a newer compile makes whatever is compiling stale, so it gives up partway and its result is never delivered.
+//(the editors debounce edits themselves, since even copying the text out is too much to do every keystroke)
+//
+//songs are checked statically first (checkSongcode), which finds most errors without playing anything.
+//they get a test run too, for the errors that depend on what the rands draw. the main song runs a batch of
+//instances at once (SongBatch), so it tries that many sets of draws for not much more than one. only up to a budget of notes
+//though, so [...] 100000000 checks as fast as [...] 1
+class SongcodeCompileThread : private juce::Thread, private juce::AsyncUpdater {
+public:
+	//the text, and the editor's tokens for it if it has them (positions into text)
+	struct Songcode {
+		std::string text;
+		std::vector<Token> tokens;
+		bool lexed = false;
+	};
+
+	struct Result {
+		ScriptPtr songScript;		//null if either song has an error
+		ScriptPtr resScript;		//null if it has an error, or the resonator's off
+		SongProgram::Ptr songProgram;	//the scripts compiled, the same programs the test runs played
+		SongProgram::Ptr resProgram;
+		ErrorInfo songError = {};	//empty messages for songs that compiled
+		ErrorInfo resError = {};
+		std::string songWarning;	//from checkSongcode, for songs that compiled anyway
+		std::string resWarning;
+		bool resChecked = false;	//the resonator was on, so its song was compiled
+		SongBounds songBounds;		//for songScript, when it compiled
+		int generation = 0;
+	};
+
+	//message thread. only gets results for the latest edit
+	std::function<void(const Result&)> onCompiled;
+
+
+	SongcodeCompileThread() : juce::Thread("Songcode compiler") {
+		startThread();
+	}
+
+	~SongcodeCompileThread() override {
+		cancelPendingUpdate();
+		latestGeneration++;		//stops a test run partway
+		stopThread(stopTimeoutMs);
+	}
+
+
+	//message thread. replaces whatever was waiting or compiling, and starts after delayMs with no newer compiles
+	void compile(Songcode song, Songcode res, bool resonatorOn, int delayMs = 0) {
+		{
+			const juce::ScopedLock lock(requestLock);
+			request.song = std::move(song);
+			request.res = std::move(res);
+			request.resonatorOn = resonatorOn;
+			request.startTime = juce::Time::getMillisecondCounter() + (juce::uint32)juce::jmax(0, delayMs);
+			request.generation = ++latestGeneration;
+			hasRequest = true;
+		}
+		notify();
+	}
+
+
+private:
+	struct Request {
+		Songcode song;
+		Songcode res;
+		bool resonatorOn = false;
+		juce::uint32 startTime = 0;
+		int generation = 0;
+	};
+
+
+	void run() override {
+		while (!threadShouldExit()) {
+			Request job;
+			const int waitMs = takeRequest(job);
+			if (waitMs != 0) {
+				wait(waitMs);
+				continue;
+			}
+
+			Result result = build(job);
+			if (isStale(job.generation)) continue;
+			{
+				const juce::ScopedLock lock(resultLock);
+				latestResult = std::move(result);
+			}
+			triggerAsyncUpdate();
+		}
+	}
+
+
+	//hands over the waiting request once its delay is up. otherwise returns how long to wait (-1 for no request)
+	int takeRequest(Request& job) {
+		const juce::ScopedLock lock(requestLock);
+		if (!hasRequest) return -1;
+		const int remaining = (int)(request.startTime - juce::Time::getMillisecondCounter());
+		if (remaining > 0) return remaining;
+		job = std::move(request);
+		hasRequest = false;
+		return 0;
+	}
+
+
+	bool isStale(int generation) const {
+		return generation != latestGeneration.load() || threadShouldExit();
+	}
+
+
+	Result build(Request& job) {
+		Result result;
+		result.generation = job.generation;
+		const uint64_t seed = (uint64_t)juce::Time::getHighResolutionTicks();
+
+		ScriptPtr song = parse(job.song, result.songError);
+		if (song == nullptr || result.songError.message != "") return result;
+		if (!checkSongcode(song, &result.songError, nullptr, &result.songWarning)) return result;
+		const SongBounds songBounds = analyzeSongBounds(song);
+		SongBatch songBatch;
+		SongProgram::Ptr songProgram, resProgram;
+		if (!testBatch(song, songProgram, songBatch, seed, job.generation, result.songError)) return result;
+
+		if (job.resonatorOn) {
+			result.resChecked = true;
+			ScriptPtr res = parse(job.res, result.resError);
+			if (res == nullptr || result.resError.message != "") return result;
+			if (!checkSongcode(res, &result.resError, song.get(), &result.resWarning)) return result;
+			std::map<std::string, float> songVariables;
+			songBatch.exportVariables(0, songVariables);
+			SongCursor resCursor;
+			if (!testRun(res, resProgram, resCursor, songVariables, CounterRng(seed, 0), job.generation, result.resError)) return result;
+			result.resScript = res;
+			result.resProgram = resProgram;
+		}
+		result.songScript = song;
+		result.songProgram = songProgram;
+		result.songBounds = songBounds;
+		return result;
+	}
+
+
+	static ScriptPtr parse(Songcode& songcode, ErrorInfo& error) {
+		if (songcode.lexed) return generateAST(songcode.text, songcode.tokens, &error);
+		return generateAST(songcode.text, &error);
+	}
+
+
+	//compiles the song into program, and plays a batch of instances of it up to the budget (see testRunSong).
+	//false on an error in any of them, or if a newer edit came in
+	bool testBatch(ScriptPtr script, SongProgram::Ptr& program, SongBatch& batch, uint64_t seed, int generation, ErrorInfo& error) {
+		program = compileSongProgram(script, &error);
+		if (program == nullptr) return false;
+		return testRunSong(batch, program.get(), seed, error, [this, generation] { return isStale(generation); },
+			maxTestElements, maxTestSteps);
+	}
+
+
+	//compiles the resonator song into program, and plays an instance of it up to the budget. it reads the main
+	//song's lets, like it does in the voices. false on an error, or if a newer edit came in
+	bool testRun(ScriptPtr script, SongProgram::Ptr& program, SongCursor& cursor, const std::map<std::string, float>& songVariables,
+		const CounterRng& rng, int generation, ErrorInfo& error) {
+		program = compileSongProgram(script, &error);
+		if (program == nullptr) return false;
+		cursor.start(program.get(), rng);
+		cursor.importVariables(songVariables);
+
+		SongElement element(0.0f, 0.0f, 0.0f);
+		for (int i = 0; i < maxTestElements; i++) {
+			if (isStale(generation)) return false;
+			if (!cursor.next(element, &error, maxTestSteps)) return error.message == "";
+		}
+		return !isStale(generation);
+	}
+
+
+	void handleAsyncUpdate() override {
+		Result result;
+		{
+			const juce::ScopedLock lock(resultLock);
+			result = std::move(latestResult);
+			latestResult = {};
+		}
+		if (result.generation != latestGeneration.load()) return;	//edited again since
+		if (onCompiled) onCompiled(result);
+	}
+
+
+	static constexpr int stopTimeoutMs = 2000;
+	static constexpr int maxTestElements = 20000;	//notes and patterns a test run plays before calling the song good
+	static constexpr int maxTestSteps = 100000;		//same as the voices: instructions to the next note before it's an error
+
+	juce::CriticalSection requestLock;
+	Request request;
+	bool hasRequest = false;
+
+	juce::CriticalSection resultLock;
+	Result latestResult;
+
+	std::atomic<int> latestGeneration{ 0 };
+
+	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SongcodeCompileThread)
+};
@@ -0,0 +1,167 @@
+/*
+  ==============================================================================
+
+    SongcodeTokenCache.cpp
+    Created: 23 Oct 2026 11:02:37am
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#include "SongcodeTokenCache.h"
+#include <algorithm>
+
+
+SongcodeTokenCache::SongcodeTokenCache() {
+    replaceLines(0, 0, { std::string() });
+}
+
+
+void SongcodeTokenCache::replaceLines(int firstLine, int numOldLines, std::vector<std::string> newLines) {
+    firstLine = juce::jlimit(0, (int)lines.size(), firstLine);
+    numOldLines = juce::jlimit(0, (int)lines.size() - firstLine, numOldLines);
+
+    //reuses the old lines where it can, so typing within a line doesn't shuffle every line after it
+    const int numNewLines = (int)newLines.size();
+    const int reused = juce::jmin(numOldLines, numNewLines);
+    if (numOldLines > numNewLines) {
+        lines.erase(lines.begin() + firstLine + reused, lines.begin() + firstLine + numOldLines);
+    }
+    else if (numNewLines > numOldLines) {
+        lines.insert(lines.begin() + firstLine + reused, (size_t)(numNewLines - numOldLines), Line());
+    }
+    for (int i = 0; i < numNewLines; i++) lines[(size_t)(firstLine + i)].text = std::move(newLines[(size_t)i]);
+
+    bool inComment = firstLine > 0 && lines[(size_t)firstLine - 1].commentAtEnd;
+    int line = firstLine;
+    for (; line < firstLine + numNewLines; line++) {
+        lexLine(lines[(size_t)line], inComment);
+        inComment = lines[(size_t)line].commentAtEnd;
+    }
+
+    //the lines after only change if the edit opened or closed a comment
+    for (; line < (int)lines.size() && lines[(size_t)line].commentAtStart != inComment; line++) {
+        lexLine(lines[(size_t)line], inComment);
+        inComment = lines[(size_t)line].commentAtEnd;
+    }
+    linesRelexed = line - firstLine;
+}
+
+
+int SongcodeTokenCache::getLineLength(int line) const {
+    if (line < 0 || line >= (int)lines.size()) return 0;
+    return (int)lines[(size_t)line].text.size();
+}
+
+
+const SongcodeTokenCache::LineToken* SongcodeTokenCache::findToken(int line, int column) const {
+    if (line < 0 || line >= (int)lines.size()) return nullptr;
+    const auto& tokens = lines[(size_t)line].tokens;
+    auto it = std::upper_bound(tokens.begin(), tokens.end(), column,
+        [](int c, const LineToken& token) { return c < token.end; });
+    return it != tokens.end() ? &*it : nullptr;
+}
+
+
+bool SongcodeTokenCache::getTokens(std::vector<Token>& tokens) const {
+    tokens.clear();
+    if (!lines.empty() && lines.back().commentAtEnd) return false;      //unclosed comment
+
+    size_t offset = 0;
+    for (const auto& line : lines) {
+        if (line.hasError || !line.isAscii) return false;
+        for (const auto& token : line.tokens) {
+            if (token.kind == Comment) continue;
+            tokens.emplace_back(token.type, token.numValue, offset + (size_t)token.start, offset + (size_t)token.end - 1, std::string_view());
+        }
+        offset += line.text.size();
+    }
+    return true;
+}
+
+
+std::string SongcodeTokenCache::toLineText(const juce::String& line) {
+    std::string text;
+    text.reserve((size_t)line.length());
+    for (auto c = line.getCharPointer(); !c.isEmpty(); ++c) {
+        const juce::juce_wchar character = *c;
+        text.push_back(character < 128 ? (char)character : '\x7f');
+    }
+    return text;
+}
+
+
+//lexes the line on its own. errors become error tokens, and lexing carries on after them, so the rest of the line still gets highlighted
+void SongcodeTokenCache::lexLine(Line& line, bool commentAtStart) {
+    line.tokens.clear();
+    line.commentAtStart = commentAtStart;
+    line.hasError = false;
+    line.isAscii = std::find(line.text.begin(), line.text.end(), '\x7f') == line.text.end();
+
+    bool inComment = commentAtStart;
+    size_t pos = 0;
+    for (;;) {
+        ErrorInfo error = {};
+        scratch.clear();
+        const bool lexed = lexSongcodeRange(line.text, pos, line.text.size(), inComment, scratch, &error, true);
+
+        for (const auto& token : scratch) {
+            Kind kind = Operator;
+            switch (token.type) {
+                case TokenType::Let:
+                case TokenType::Pattern: kind = Keyword; break;
+                case TokenType::LStart:
+                case TokenType::LEnd: kind = Loop; break;
+                case TokenType::Rand: kind = Rand; break;
+                case TokenType::Num: kind = Number; break;
+                case TokenType::Id: kind = Identifier; break;
+                case TokenType::Comment: kind = Comment; break;
+                default: break;
+            }
+            line.tokens.push_back({ (int)token.startPos, (int)token.endPos + 1, kind, token.type, token.numValue });
+        }
+        if (lexed) break;
+
+        line.hasError = true;
+        line.tokens.push_back({ (int)error.errorStart, (int)error.errorEnd + 1, Error, TokenType::Comment, 0 });
+        pos = error.errorEnd + 1;
+    }
+    line.commentAtEnd = inComment;
+}
+
+
+int SongcodeTokeniser::readNextToken(juce::CodeDocument::Iterator& source) {
+    const int line = source.getLine();
+    const int column = source.toPosition().getIndexInLine();
+    const auto* token = cache.findToken(line, column);
+
+    int length;
+    int kind = SongcodeTokenCache::Plain;
+    if (token == nullptr) length = cache.getLineLength(line) - column;       //whitespace to the end of the line
+    else if (token->start > column) length = token->start - column;         //whitespace to the token
+    else {
+        length = token->end - column;
+        kind = token->kind;
+    }
+
+    //out of step with the document (between an edit and the cache catching up), so just move on
+    if (length <= 0) length = 1;
+
+    for (int i = 0; i < length && !source.isEOF(); i++) source.skip();
+    return kind;
+}
+
+
+juce::CodeEditorComponent::ColourScheme SongcodeTokeniser::getDefaultColourScheme() {
+    juce::CodeEditorComponent::ColourScheme scheme;
+    scheme.set("Plain", juce::Colours::white);
+    scheme.set("Keyword", juce::Colour(0xffe0a060));
+    scheme.set("Loop", juce::Colour(0xffc080e0));
+    scheme.set("Rand", juce::Colour(0xff60d0c0));
+    scheme.set("Number", juce::Colour(0xffa0d080));
+    scheme.set("Identifier", juce::Colour(0xff90b8f0));
+    scheme.set("Operator", juce::Colours::lightgrey);
+    scheme.set("Comment", juce::Colours::grey);
+    scheme.set("Error", juce::Colours::red);
+    return scheme;
+}
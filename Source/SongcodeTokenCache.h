@@ -0,0 +1,87 @@
+/*
+  ==============================================================================
+
+    SongcodeTokenCache.h
+    Created: 23 Oct 2026 11:02:37am
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <string>
+#include <vector>
+#include "Evaluator.h"
+
+
+//the songcode editors' tokens, kept a line at a time. an edit only relexes the lines it touched, plus the
+//lines after them for as long as it changed whether they start inside a $comment$ (so typing a $ relexes
+//to the next one, and typing anything else relexes one line). feeds both the highlighting and the parser,
+//so the editors never lex their whole text per keystroke
+class SongcodeTokenCache {
+public:
+	//what a bit of songcode gets highlighted as. also the token types the code editor sees
+	enum Kind { Plain = 0, Keyword, Loop, Rand, Number, Identifier, Operator, Comment, Error, numKinds };
+
+	struct LineToken {
+		int start;			//characters into the line
+		int end;			//one past its last
+		Kind kind;
+		TokenType type;		//what the lexer made of it (meaningless for errors)
+		int numValue;
+	};
+
+
+	SongcodeTokenCache();
+
+	//lines [firstLine, firstLine + numOldLines) were replaced by newLines (line breaks included, like
+	//juce::CodeDocument's lines). everything is a replaceLines(0, getNumLines(), allLines)
+	void replaceLines(int firstLine, int numOldLines, std::vector<std::string> newLines);
+
+	int getNumLines() const { return (int)lines.size(); }
+	int getLineLength(int line) const;
+
+	//the first token on line that ends after column, or nullptr
+	const LineToken* findToken(int line, int column) const;
+
+	//every token in the text, for generateAST(songcode, tokens, ...), positions counting from the start of the
+	//text. false if the lexer would stop with an error somewhere, so the caller lexes it properly and reports it
+	bool getTokens(std::vector<Token>& tokens) const;
+
+	//lines relexed by the last replaceLines
+	int getLinesRelexed() const { return linesRelexed; }
+
+	//a line of the editor's text, one char per character. anything past ascii becomes a char the lexer won't take
+	static std::string toLineText(const juce::String& line);
+
+
+private:
+	struct Line {
+		std::string text;
+		std::vector<LineToken> tokens;
+		bool commentAtStart = false;
+		bool commentAtEnd = false;
+		bool hasError = false;
+		bool isAscii = true;		//otherwise the parser's byte positions wouldn't be these character positions
+	};
+
+	void lexLine(Line& line, bool commentAtStart);
+
+	std::vector<Line> lines;
+	std::vector<Token> scratch;
+	int linesRelexed = 0;
+};
+
+
+//hands the cache's tokens to a juce::CodeEditorComponent for colouring
+class SongcodeTokeniser : public juce::CodeTokeniser {
+public:
+	explicit SongcodeTokeniser(const SongcodeTokenCache& cache) : cache(cache) {}
+
+	int readNextToken(juce::CodeDocument::Iterator& source) override;
+	juce::CodeEditorComponent::ColourScheme getDefaultColourScheme() override;
+
+private:
+	const SongcodeTokenCache& cache;
+};
@@ -0,0 +1,114 @@
+/*
+  ==============================================================================
+
+    SpatialGrid.h
+    Created: 21 Oct 2026 1:37:08pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <cmath>
+#include <vector>
+
+
+//uniform grid over the ground around the listener, for finding which voices are near each other.
+//points get rebuilt into it every control tick (counting sort by cell, so no allocation after prepare),
+//and a neighbour query only looks at the cells the radius touches. so finding everyone's neighbours
+//is O(n*k) for k neighbours, instead of every voice checking every other voice
+class SpatialGrid {
+public:
+	//allocates for up to maxPoints in a square of +-extent meters. call off the audio thread
+	void prepare(int maxPoints, float newExtent) {
+		extent = newExtent;
+		points.reserve((size_t)maxPoints);
+		sorted.reserve((size_t)maxPoints);
+		cellStart.reserve((size_t)(maxCellsPerSide * maxCellsPerSide + 1));
+		pointCell.reserve((size_t)maxPoints);
+	}
+
+
+	//starts a new set of points. cells are at least cellSize wide (there's a cap on how many there are)
+	void beginBuild(float cellSize) {
+		cellsPerSide = juce::jlimit(1, maxCellsPerSide, (int)std::floor(2.0f * extent / juce::jmax(cellSize, 1.0e-3f)));
+		cellWidth = 2.0f * extent / (float)cellsPerSide;
+		points.clear();
+	}
+
+
+	//points are numbered in the order they're added, starting at 0
+	void add(float x, float y) {
+		jassert(points.size() < points.capacity());
+		points.push_back({ x, y });
+	}
+
+
+	//sorts the points into their cells
+	void endBuild() {
+		const int numCells = cellsPerSide * cellsPerSide;
+		cellStart.assign((size_t)numCells + 1, 0);
+		pointCell.resize(points.size());
+		for (size_t i = 0; i < points.size(); i++) {
+			pointCell[i] = getCell(getColumn(points[i].x), getColumn(points[i].y));
+			cellStart[(size_t)pointCell[i] + 1]++;
+		}
+		for (int c = 0; c < numCells; c++) cellStart[(size_t)c + 1] += cellStart[(size_t)c];
+
+		//cellStart is reused as the write position while filling, then shifted back
+		sorted.resize(points.size());
+		for (size_t i = 0; i < points.size(); i++) sorted[(size_t)cellStart[(size_t)pointCell[i]]++] = (int)i;
+		for (int c = numCells; c > 0; c--) cellStart[(size_t)c] = cellStart[(size_t)c - 1];
+		cellStart[0] = 0;
+	}
+
+
+	//calls function(j, distanceSquared) for every other point within radius of point i
+	template <typename Function>
+	void forEachNeighbour(int i, float radius, Function&& function) const {
+		const Point& p = points[(size_t)i];
+		const float radiusSquared = radius * radius;
+		const int reach = (int)std::ceil(radius / cellWidth);
+		const int column = getColumn(p.x);
+		const int row = getColumn(p.y);
+		for (int y = juce::jmax(0, row - reach); y <= juce::jmin(cellsPerSide - 1, row + reach); y++) {
+			for (int x = juce::jmax(0, column - reach); x <= juce::jmin(cellsPerSide - 1, column + reach); x++) {
+				const int cell = getCell(x, y);
+				for (int s = cellStart[(size_t)cell]; s < cellStart[(size_t)cell + 1]; s++) {
+					const int j = sorted[(size_t)s];
+					if (j == i) continue;
+					const float dx = points[(size_t)j].x - p.x;
+					const float dy = points[(size_t)j].y - p.y;
+					const float distanceSquared = dx * dx + dy * dy;
+					if (distanceSquared <= radiusSquared) function(j, distanceSquared);
+				}
+			}
+		}
+	}
+
+
+	int getNumPoints() const { return (int)points.size(); }
+
+
+private:
+	struct Point { float x, y; };
+
+	//anything outside the square goes in the edge cells
+	int getColumn(float coordinate) const {
+		return juce::jlimit(0, cellsPerSide - 1, (int)std::floor((coordinate + extent) / cellWidth));
+	}
+
+	int getCell(int column, int row) const { return row * cellsPerSide + column; }
+
+
+	static constexpr int maxCellsPerSide = 32;
+
+	float extent = 1.0f;
+	int cellsPerSide = 1;
+	float cellWidth = 2.0f;
+	std::vector<Point> points;
+	std::vector<int> sorted;		//point indices, grouped by cell
+	std::vector<int> cellStart;		//where each cell's points start in sorted, plus one past the end
+	std::vector<int> pointCell;
+};
@@ -10,17 +10,27 @@
 
 #pragma once
 #include <JuceHeader.h>
+#include "BinauralRenderer.h"
+#include "AmbisonicBus.h"
+#include "EarlyReflections.h"
 
 
+//how the chorus voices get placed in the output. matches the "Chorus Spatial Mode" choices
+enum class SpatialMode {
+	Stereo = 0,		//cosine panning, per voice
+	Binaural,		//HRTF convolution, per occupied azimuth bin
+	Ambisonic		//encoded into a shared ambisonic bus, decoded once per block
+};
+
 
 //effects object takes raw mono audio and spatializes it into a stereo signal,
-//based on two variables which are set before processing: distance, and angle
+//based on two variables which are set before processing: distance, and angle.
+//room sound isn't done here: every voice sends into the shared EarlyReflections, if one is set
 class Spatializer {
 public:
 	using ProcessChain = juce::dsp::ProcessorChain<
 		juce::dsp::Gain<float>,			//distance attenuation
-		juce::dsp::IIR::Filter<float>,	//high shelf filter
-		juce::dsp::Reverb				//reverb
+		juce::dsp::IIR::Filter<float>	//high shelf filter
 	>;
 
 	//keep the panner separate so the chain stays mono
@@ -44,6 +54,19 @@ public:
 	}
 
 
+	//for reusing an already prepared spatializer on a new voice: clears the filter and panner
+	//state left over from the last voice, without preparing again (which can allocate)
+	void restart(float distance, float angle) {
+		jassert(isPrepared);
+		chain.reset();
+		panner.reset();
+		updatePosition(distance, angle);
+	}
+
+
+	double getPreparedSampleRate() const { return isPrepared ? currentSpec.sampleRate : 0.0; }
+
+
 	void updatePosition(float newDistance, float newAngle) {
 		const float minDistance = 5.0f;
 		const float maxDistance = 15.0f;
@@ -70,20 +93,24 @@ public:
 			juce::Decibels::decibelsToGain(shelfGainDB)
 		);
 
-		//REVERB: 
-		juce::Reverb::Parameters reverbParams;
-		reverbParams.wetLevel = juce::jmap(normalizedDistance, 0.1f, 0.8f);
-		reverbParams.roomSize = 0.5f;
-		reverbParams.damping = 1.0f;
-		reverbParams.dryLevel = 1 - reverbParams.wetLevel;
-		reverbParams.width = 0.5f;
-		chain.get<2>().setParameters(reverbParams);
+		//REFLECTIONS: pick the shared environment bin for this position
+		if (reflections != nullptr) reflectionBin = reflections->getBin(newAngle, normalizedDistance);
 
 
 		//PANNING: map angle (0 to 2pi) to the panners -1 to 1 range
 		//we only care about x-axis projection since we're working with stereo
 		float normalizedPan = juce::jlimit(-1.0f, 1.0f, std::cos(newAngle));
 		panner.setPan(normalizedPan);
+
+		currentAngle = newAngle;
+		currentNormalizedDistance = normalizedDistance;
+	}
+
+
+	//the shared environment this voice sends to. nullptr means no room sound
+	void setReflections(EarlyReflections* newReflections) {
+		reflections = newReflections;
+		if (reflections != nullptr) reflectionBin = reflections->getBin(currentAngle, currentNormalizedDistance);
 	}
 
 
@@ -108,9 +135,8 @@ public:
 		monoBuffer.copyFrom(0, 0, inBuffer, 0, 0, numSamples);
 
 		//process through the chain
-		juce::dsp::AudioBlock<float> block(monoBuffer);
-		juce::dsp::ProcessContextReplacing<float> context(block);
-		chain.process(context);
+		processMono(monoBuffer, numSamples);
+		sendToReflections(monoBuffer, numSamples);
 
 
 		//STEREOIZATION SECTION
@@ -133,6 +159,53 @@ public:
 	}
 
 
+	//binaural version of processBlock. runs the mono chain in place, then sums the voice
+	//into the renderer's bin for its angle instead of panning it. the renderer does the
+	//actual HRTF convolution once all voices have been added
+	void processBlockBinaural(juce::AudioBuffer<float>& voiceBuffer, BinauralRenderer& renderer, int numSamples) {
+		jassert(voiceBuffer.getNumChannels() == 1);
+
+		processMono(voiceBuffer, numSamples);
+
+		//skip silent voices (cooldown) so their bins can go idle
+		if (voiceBuffer.getMagnitude(0, 0, numSamples) < silenceThreshold) return;
+		sendToReflections(voiceBuffer, numSamples);
+		renderer.addToBin(renderer.getBinForAngle(currentAngle), voiceBuffer.getReadPointer(0), numSamples);
+	}
+
+
+	//ambisonic version of processBlock. runs the mono chain in place, then encodes the voice
+	//into the shared bus. the bus gets decoded once all voices have been added
+	void processBlockAmbisonic(juce::AudioBuffer<float>& voiceBuffer, AmbisonicBus& bus, int numSamples) {
+		jassert(voiceBuffer.getNumChannels() == 1);
+
+		processMono(voiceBuffer, numSamples);
+		sendToReflections(voiceBuffer, numSamples);
+		bus.encode(voiceBuffer.getReadPointer(0), currentAngle, currentNormalizedDistance, numSamples);
+	}
+
+
+	//runs the distance gain/shelf chain over the first numSamples of a mono buffer, in place
+	void processMono(juce::AudioBuffer<float>& monoBuffer, int numSamples) {
+		juce::dsp::AudioBlock<float> block = juce::dsp::AudioBlock<float>(monoBuffer).getSubBlock(0, (size_t)numSamples);
+		juce::dsp::ProcessContextReplacing<float> context(block);
+		if (panOnly) chain.get<0>().process(context);
+		else chain.process(context);
+	}
+
+
+	//cheap mode for when the cpu governor is struggling: distance gain only, no shelf filter
+	void setPanOnly(bool shouldPanOnly) { panOnly = shouldPanOnly; }
+
+
+	//adds the processed voice to its environment bin. silent voices are skipped
+	void sendToReflections(const juce::AudioBuffer<float>& monoBuffer, int numSamples) {
+		if (reflections == nullptr) return;
+		if (monoBuffer.getMagnitude(0, 0, numSamples) < silenceThreshold) return;
+		reflections->addToBin(reflectionBin, monoBuffer.getReadPointer(0), numSamples);
+	}
+
+
 	//=====================================================================================
 
 
@@ -143,12 +216,17 @@ public:
 
 	bool isPrepared = false;
 private:
+	bool panOnly = false;
 
 	ProcessChain chain;
 	juce::dsp::ProcessSpec currentSpec;
+	float currentAngle = 0.0f;
+	float currentNormalizedDistance = 0.0f;
+	EarlyReflections* reflections = nullptr;
+	int reflectionBin = 0;
+	static constexpr float silenceThreshold = 1.0e-6f;
 
 	//spatialization parameters
 	float leftGain, rightGain;
 	float distanceFreqCutoff;
-	float reverbMix;
 };
\ No newline at end of file
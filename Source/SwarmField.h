@@ -0,0 +1,297 @@
+/*
+  ==============================================================================
+
+    SwarmField.h
+    Created: 20 Oct 2026 5:48:12pm
+    Author:  Taro
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <array>
+#include "PipStructs.h"
+#include "SongCodeCompiler.h"
+#include "SongBytecode.h"
+#include "CounterRng.h"
+
+
+//the far part of a big swarm. the chorus voices are the nearest insects, each rendered on its own.
+//everyone past them (innerRadius to outerRadius) is only rendered statistically:
+//each far insect clicks at the average rate of the song (counting its cooldowns), so the whole
+//far field is a poisson stream of clicks, split over a few diffuse beds around the listener.
+//every click plays the pip sequence at a random distance, drawn from the density falloff.
+//
+//past maxEventsPerSecond a bed stops adding events, and makes the ones it has louder instead
+//(by the square root, since the clicks don't line up). so the cost stays the same whether
+//there's a hundred far insects or ten thousand
+class SwarmField {
+public:
+	static constexpr int numBeds = 4;
+	static constexpr int maxGrains = 32;	//clicks in flight, per bed
+	static constexpr int maxTones = 96;		//pips in flight, per bed
+	static constexpr float innerRadius = 15.0f;	//as far as the chorus voices go
+	static constexpr float outerRadius = 80.0f;
+	static constexpr float maxEventsPerSecond = 400.0f;	//per bed
+
+	//click settings shared with the chorus voices, loaded once per block
+	struct Settings {
+		float pitchRandom = 0.0f;	//octaves
+		float attackRatio = 0.5f;
+		float gain = 1.0f;
+	};
+
+
+	//call from prepareToPlay, not from the audio thread
+	void prepare(double newSampleRate, int maximumBlockSize) {
+		sampleRate = newSampleRate;
+		bedBuffers.setSize(numBeds, maximumBlockSize);
+		//far away, so only the low end of the clicks makes it over. one pole is plenty for a bed
+		lowpassCoefficient = 1.0f - std::exp(-juce::MathConstants<float>::twoPi * bedCutoff / (float)sampleRate);
+		reset();
+	}
+
+
+	void reset() {
+		for (auto& bed : beds) {
+			bed.numGrains = 0;
+			bed.numTones = 0;
+			bed.samplesUntilEvent = 0;
+			bed.lowpassState = 0.0f;
+		}
+		bedBuffers.clear();
+		insectClickRate = 0.0f;
+		hasSongStats = false;
+	}
+
+
+	//the far field's random stream. SynthVoice derives it from the master seed
+	void reseed(uint64_t seed, uint64_t stream) {
+		rng.reset(seed, stream);
+	}
+
+
+	//running totals over a song. voices add each element as they get to it, since songs are
+	//only evaluated as they're sung
+	struct SongStats {
+		double weightedClicks = 0.0;
+		double totalMs = 0.0;
+		float clicksPerCycle = 1.0f;
+
+		void add(const SongStep& element) {
+			if (element.type == SongElement::Type::Pattern) {
+				//a pattern value of n is n clicks in one cycle, and 0 is a skipped cycle
+				int sum = 0;
+				for (int i = 0; i < element.patternLength; i++) sum += element.pattern[i];
+				clicksPerCycle = element.patternLength <= 0 ? 1.0f : (float)sum / (float)element.patternLength;
+			}
+			else if (element.duration > 0.0f) {
+				weightedClicks += 0.5 * (element.startFrequency + element.endFrequency) * clicksPerCycle * element.duration;
+				totalMs += element.duration;
+			}
+		}
+	};
+
+
+	//updates the song statistics from a song (or as much of one as has been sung)
+	void observeSong(const SongStats& stats, float cooldownMaxSeconds) {
+		if (stats.totalMs <= 0.0) return;
+
+		//average over a whole song, plus an average cooldown
+		const double songSeconds = stats.totalMs / 1000.0;
+		const float rate = (float)(stats.weightedClicks / stats.totalMs * songSeconds / (songSeconds + cooldownMaxSeconds * 0.5));
+
+		//voices keep rerolling their songs, so follow them smoothly
+		insectClickRate = hasSongStats ? insectClickRate + 0.25f * (rate - insectClickRate) : rate;
+		hasSongStats = true;
+	}
+
+	bool hasObservedSong() const { return hasSongStats; }
+
+
+	//farInsects is everyone not rendered as a chorus voice. falloff is how fast the density
+	//drops with distance (0 is even everywhere). singing false stops new clicks, so the field dies down
+	void setPopulation(int farInsects, float newFalloff, bool singing) {
+		falloff = newFalloff;
+		const float trueRate = singing ? (float)juce::jmax(0, farInsects) * insectClickRate / (float)numBeds : 0.0f;
+		eventRate = juce::jmin(trueRate, maxEventsPerSecond);
+		eventGainScale = eventRate > 0.0f ? std::sqrt(trueRate / eventRate) : 1.0f;
+	}
+
+
+	//true if there's anything to render this block
+	bool isActive() const {
+		if (eventRate > 0.0f) return true;
+		for (const auto& bed : beds) {
+			if (bed.numGrains > 0 || bed.numTones > 0) return true;
+		}
+		return false;
+	}
+
+
+	//renders every bed into its mono buffer. read them back with getBed
+	void render(int numSamples, const std::vector<Pip>& pips, const Settings& settings) {
+		jassert(numSamples <= bedBuffers.getNumSamples());
+		const float meanInterval = eventRate > 0.0f ? (float)sampleRate / eventRate : 0.0f;
+
+		for (int b = 0; b < numBeds; b++) {
+			Bed& bed = beds[b];
+			float* out = bedBuffers.getWritePointer(b);
+
+			for (int s = 0; s < numSamples; s++) {
+				if (meanInterval > 0.0f && --bed.samplesUntilEvent <= 0) {
+					startGrain(bed, pips, settings);
+					//exponential gaps between events make it a poisson stream
+					bed.samplesUntilEvent = juce::jmax(1, (int)std::round(-std::log(1.0f - rng.nextFloat()) * meanInterval));
+				}
+				advanceGrains(bed, pips, settings);
+				const float dry = renderTones(bed);
+				bed.lowpassState += lowpassCoefficient * (dry - bed.lowpassState);
+				out[s] = bed.lowpassState;
+			}
+		}
+	}
+
+
+	const float* getBed(int bed) const { return bedBuffers.getReadPointer(bed); }
+
+
+	//beds sit on the diagonals, so between them they cover every direction
+	static float getBedAngle(int bed) {
+		using R = juce::MathConstants<float>;
+		return R::pi * 0.25f + (float)bed * R::halfPi;
+	}
+
+
+	//stereo mode. constant power panning from each bed's left/right position
+	void addToStereo(juce::AudioBuffer<float>& outBuffer, int outputStartSample, int numSamples) const {
+		using R = juce::MathConstants<float>;
+		for (int b = 0; b < numBeds; b++) {
+			const float pan = (std::cos(getBedAngle(b)) + 1.0f) * 0.5f;
+			outBuffer.addFrom(0, outputStartSample, bedBuffers, b, 0, numSamples, std::cos(pan * R::halfPi));
+			outBuffer.addFrom(1, outputStartSample, bedBuffers, b, 0, numSamples, std::sin(pan * R::halfPi));
+		}
+	}
+
+
+private:
+	//one far insect's click, walking through the pip sequence like SynthVoice::Click
+	struct Grain {
+		int pos;
+		int samplesTilNextPip;
+		float gain;
+	};
+
+	//one pip of a grain, like SynthVoice::SubClick
+	struct Tone {
+		int samplesRemaining;
+		float phase;
+		float phaseDelta;
+		float peak;
+		float level;
+		float levelChangePerSample;
+	};
+
+	struct Bed {
+		std::array<Grain, maxGrains> grains;
+		std::array<Tone, maxTones> tones;
+		int numGrains = 0;
+		int numTones = 0;
+		int samplesUntilEvent = 0;
+		float lowpassState = 0.0f;
+	};
+
+
+	void startGrain(Bed& bed, const std::vector<Pip>& pips, const Settings& settings) {
+		if (pips.empty() || bed.numGrains >= maxGrains) return;
+		//inverse square, from the chorus voices' level at innerRadius (-5 dB)
+		const float distanceFactor = innerRadius / drawRadius();
+		const float gain = innerRadiusGain * distanceFactor * distanceFactor * eventGainScale * settings.gain;
+		bed.grains[(size_t)bed.numGrains++] = { 0, 0, gain };
+	}
+
+
+	void advanceGrains(Bed& bed, const std::vector<Pip>& pips, const Settings& settings) {
+		for (int g = 0; g < bed.numGrains;) {
+			Grain& grain = bed.grains[(size_t)g];
+			if (grain.samplesTilNextPip <= 0 && grain.pos < (int)pips.size()) {
+				const Pip& pip = pips[(size_t)grain.pos];
+				startTone(bed, pip, grain.gain, settings);
+				grain.pos++;
+				grain.samplesTilNextPip = juce::jmax(pip.length - pip.tail, 1);
+			}
+			else {
+				grain.samplesTilNextPip--;
+			}
+
+			//swap finished grains out, order doesn't matter here
+			if (grain.pos >= (int)pips.size()) bed.grains[(size_t)g] = bed.grains[(size_t)--bed.numGrains];
+			else g++;
+		}
+	}
+
+
+	void startTone(Bed& bed, const Pip& pip, float gain, const Settings& settings) {
+		if (bed.numTones >= maxTones) return;
+		const float freqMultiplier = std::pow(2.0f, (rng.nextFloat() * 2.0f - 1.0f) * settings.pitchRandom);
+		const int attackSamples = juce::jmax(1, (int)std::round(settings.attackRatio * pip.length));
+		const float peak = pip.level * gain;
+
+		Tone& tone = bed.tones[(size_t)bed.numTones++];
+		tone.samplesRemaining = pip.length;
+		tone.phase = 0.0f;
+		tone.phaseDelta = pip.frequency * freqMultiplier / (float)sampleRate;
+		tone.peak = peak;
+		tone.level = 0.0f;
+		tone.levelChangePerSample = peak / (float)attackSamples;
+	}
+
+
+	//same attack/decay envelope as the chorus voices' subclicks
+	float renderTones(Bed& bed) {
+		float output = 0.0f;
+		for (int t = 0; t < bed.numTones;) {
+			Tone& tone = bed.tones[(size_t)t];
+			output += std::sin(tone.phase * juce::MathConstants<float>::twoPi) * tone.level;
+			tone.phase += tone.phaseDelta;
+			tone.phase -= std::floor(tone.phase);
+
+			if (tone.level >= tone.peak && tone.samplesRemaining > 0) tone.levelChangePerSample = -tone.peak / (float)tone.samplesRemaining;
+			tone.level += tone.levelChangePerSample;
+			tone.samplesRemaining--;
+
+			if (tone.samplesRemaining <= 0) bed.tones[(size_t)t] = bed.tones[(size_t)--bed.numTones];
+			else t++;
+		}
+		return output;
+	}
+
+
+	//random distance between the radii. the density (insects per area) goes like r^-falloff,
+	//so the radius itself is distributed like r^(1 - falloff). inverse cdf of that
+	float drawRadius() {
+		const float u = rng.nextFloat();
+		const float k = 2.0f - falloff;
+		if (std::abs(k) < 1.0e-3f) return innerRadius * std::pow(outerRadius / innerRadius, u);
+		const float a = std::pow(innerRadius, k);
+		const float b = std::pow(outerRadius, k);
+		return std::pow(a + u * (b - a), 1.0f / k);
+	}
+
+
+	static constexpr float bedCutoff = 1500.0f;
+	static constexpr float innerRadiusGain = 0.56f;
+
+	std::array<Bed, numBeds> beds;
+	juce::AudioBuffer<float> bedBuffers;
+	CounterRng rng;
+	double sampleRate = 44100.0;
+	float lowpassCoefficient = 1.0f;
+
+	float insectClickRate = 0.0f;	//clicks per second from one far insect
+	bool hasSongStats = false;
+	float falloff = 1.0f;
+	float eventRate = 0.0f;			//events per second actually rendered, per bed
+	float eventGainScale = 1.0f;
+};
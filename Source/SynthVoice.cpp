@@ -11,6 +11,58 @@
 #include "SynthVoice.h"
 #include "PluginProcessor.h"
 
+SynthVoice::SynthVoice(int maxVoices) {
+    voiceCapacity = juce::jlimit(1, (int)maxChorusVoices, maxVoices);
+
+    //every slot is reserved up front, so adding voices and pool objects never reallocates.
+    //a trim can retire a whole pool's worth of each at once, so leave room for all of it.
+    //a species change retires up to two song programs and one set of buffers per voice on top of that
+    voices.reserve((size_t)voiceCapacity);
+    pendingRetired.reserve((size_t)voiceCapacity * 6 + 64);
+    wakeScheduler.prepare(voiceCapacity);
+    synchrony.prepare(voiceCapacity);
+    neighbourGrid.prepare(voiceCapacity, ChorusTrajectory::maxDistance);
+    cullScratch.reserve((size_t)voiceCapacity);
+    resonatorPool.reserve(voiceCapacity);
+    spatializerPool.reserve(voiceCapacity);
+
+    //the mono voice. chorus voices get created by the timer, see timerCallback
+    voices.push_back(createVoiceState());
+    voices[0]->hot = &hotVoices[0];
+    voicesSent = 1;
+}
+
+
+SynthVoice::~SynthVoice() {
+    stopTimer();
+
+    //free anything still in flight between the threads
+    auto freeCommand = [](const VoiceCommand& command) {
+        delete command.voice;
+        delete command.resonator;
+        delete command.spatializer;
+        delete command.buffers;
+        if (command.species != nullptr) command.species->decReferenceCount();
+    };
+    VoiceCommand command;
+    while (commandQueue.pop(command)) freeCommand(command);
+    for (auto& pending : pendingCommands) freeCommand(pending);
+
+    freeRetiredObjects();
+    for (auto& retired : pendingRetired) {
+        if (retired.species != nullptr) retired.species->decReferenceCount();
+        if (retired.program != nullptr) retired.program->decReferenceCount();
+        delete retired.voice;
+        delete retired.resonator;
+        delete retired.spatializer;
+        delete retired.buffers;
+    }
+}
+
+
+//===========================================================================
+
+
 //always true 
 //i think
 bool SynthVoice::canPlaySound(juce::SynthesiserSound* sound) {
@@ -22,46 +74,53 @@ bool SynthVoice::canPlaySound(juce::SynthesiserSound* sound) {
 // ================================================================================
 
 void SynthVoice::startNote(int /*midiNote*/, float velocity, juce::SynthesiserSound* /*sound*/, int /*currentPitchWheelPosition*/) {
+    //pick up any script/pip changes that arrived since the last block
+    drainCommands();
+
     isChorusEnabled = apvts->getRawParameterValue("Chorus On")->load();
+
+    //every note starts its streams from the top, so the same note with the same seed renders the same
+    noteSeed = masterSeed.load();
+    for (auto& voice : voices) voice->songInstance = 0;
     startMode = isChorusEnabled ? 1 : 0; //0 = mono, 1 = chorus
+    samplesUntilControlTick = 0;    //tick right away, so the first span starts with fresh control values
     bool resonatorOn = apvts->getRawParameterValue("Resonator On")->load();
     if (startMode == 1) {   //CHORUS MODE
 
-        const int chorusCount = apvts->getRawParameterValue("Chorus Count")->load();
-        const float stereoSpread = apvts->getRawParameterValue("Chorus Stereo Spread")->load();
-        const float maxDistance = apvts->getRawParameterValue("Chorus Max Distance")->load();
-
-        //make sure we have enough voices already to do playback
-        while (voices.size() < chorusCount) voices.push_back(std::make_unique<VoiceState>());
+        //voices are created ahead of time on the message thread. if the count was just raised,
+        //the rest will join once they arrive (see updateChorusVoiceCount)
+        const int chorusCount = getUsableChorusCount();
+        wakeScheduler.reset();
+        cooldownRate = 1.0f;
+        swarmField.reset();
+        swarmField.reseed(noteSeed, CounterRng::makeStream(SwarmStream, 0, 0));
 
         //VOICE INITIALIZATION
+        //every voice gets a new spot, so the doppler lanes jump there instead of swooping in from the last note's
         for (int i = 0; i < chorusCount; ++i) {
             auto& voice = *voices[i];
             initializeChorusVoice(&voice, resonatorOn);
+            if (i < DopplerDelayBank::maxLanes) dopplerBank.releaseLane(i);
         }
+        lastChorusCount = chorusCount;
+        voiceHighWaterMark = juce::jmax(voiceHighWaterMark, chorusCount);
 
         playing = true;
         stopChorusRefresh = false;
     }
     else {      //MONO MODE
-        //compile songs
-        ErrorInfo error;
-        std::map<std::string, float> sharedEnv;
-        std::vector<SongElement> mainSong = evaluateAST(compiledSongScript, &error, &sharedEnv);
-        std::vector<SongElement> resSong = {};
-        if (resonatorOn) resSong = evaluateAST(compiledResonatorScript, &error, &sharedEnv);
-
-        if (mainSong.empty()) {
+        //the mono voice always exists, it's created with the synth voice
+        auto& voice = *voices[0];
+        beginSongInstance(voice);
+        voice.speciesIndex = 0;     //mono mode only plays the species in the editors
+        const ChorusSpecies& species = getSpecies(voice);
+        resonatorOn = resonatorOn && species.resonatorOn;
+
+        //reset and initialize. the song is evaluated as it plays
+        if (!initializeVoiceState(&voice, velocity, species, resonatorOn)) {
             clearCurrentNote();
             return;
         }
-
-        //create new voice (mono) if needed
-        if (voices.empty()) voices.push_back(std::make_unique<VoiceState>());
-        auto& voice = *voices[0];
-
-        //reset and initialize
-        initializeVoiceState(&voice, velocity, mainSong, resSong, resonatorOn);
         voice.state = VoiceState::VoiceStateState::Playing;
         playing = true;
         stopChorusRefresh = true;
@@ -86,15 +145,80 @@ void SynthVoice::stopNote(float /*velocity*/, bool /*allowTailOff*/) {
 }
 
 
+//=============================================================================
+
+
+//the synthesiser only passes the sample rate down to its voices, so the processor
+//calls this directly to size anything that depends on the block length
+void SynthVoice::prepareToPlay(double sampleRate, int samplesPerBlock, const juce::AudioChannelSet& outputLayout) {
+    binauralRenderer.prepare(sampleRate, samplesPerBlock);
+    binauralActive = false;
+    ambisonicBus.prepare(samplesPerBlock, outputLayout);
+    dopplerBank.prepare(sampleRate, ChorusTrajectory::maxDistance);
+    earlyReflections.prepare(sampleRate, samplesPerBlock);
+    swarmField.prepare(sampleRate, samplesPerBlock);
+    dopplerActive = false;
+
+    //every voice slot gets its own output buffer, at the longest block the host said it would send
+    maxBlockSize = juce::jmax(1, samplesPerBlock);
+    activeVoices.reserve((size_t)voiceCapacity);
+    tempBuffers.clear();
+    for (int i = 0; i < voiceCapacity; i++) tempBuffers.emplace_back(1, maxBlockSize);
+
+    //spatializers are prepared once, when they're built. a new rate means preparing them again,
+    //which is fine here since the audio thread isn't running
+    spatializerSampleRate = sampleRate;
+    spatializerPool.forEach([sampleRate](Spatializer& spatializer) {
+        spatializer.prepare(ChorusTrajectory::maxDistance, 0.0f, { sampleRate, 1024, 2 });
+    });
+
+    //the same control rate in time whatever the sample rate: 32 samples at 48k, 64 at 96k and up
+    setControlInterval((int)std::round(sampleRate * controlIntervalSeconds));
+    samplesUntilControlTick = 0;
+    clickGain.reset(sampleRate, 0.05);
+    clickGain.setCurrentAndTargetValue(juce::Decibels::decibelsToGain((float)*apvts->getRawParameterValue("Click Volume")));
+    currentClickGain = clickGain.getCurrentValue();
+}
+
+
+//message thread. the binaural renderer's delay, when the chorus goes through it. this doesn't follow the cpu
+//governor dropping to panning, since hosts can't follow latency changing mid playback anyway
+int SynthVoice::getLatencySamples() const {
+    if (!*apvts->getRawParameterValue("Chorus On")) return 0;
+    const auto spatialMode = static_cast<SpatialMode>((int)*apvts->getRawParameterValue("Chorus Spatial Mode"));
+    const auto decode = static_cast<AmbisonicBus::Decode>((int)*apvts->getRawParameterValue("Chorus Ambisonic Decode"));
+    const bool binaural = spatialMode == SpatialMode::Binaural
+        || (spatialMode == SpatialMode::Ambisonic && decode == AmbisonicBus::Decode::Binaural);
+    return binaural ? binauralRenderer.getLatencySamples() : 0;
+}
+
+
+//sets how many samples pass between control ticks. clamped to minControlInterval..maxControlInterval.
+//the audio thread reads it, so only while it isn't running. prepareToPlay sets it from the sample rate
+void SynthVoice::setControlInterval(int samples) {
+    controlInterval = juce::jlimit(minControlInterval, maxControlInterval, samples);
+}
+
+
 //=============================================================================
 
 void SynthVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples) {
+    if (maxBlockSize == 0) return;      //not prepared yet
+    //a host can send more than it said it would. that gets rendered in pieces that fit the buffers
+    if (numSamples > maxBlockSize) {
+        for (int done = 0; done < numSamples; done += maxBlockSize)
+            renderNextBlock(outputBuffer, startSample + done, juce::jmin(maxBlockSize, numSamples - done));
+        return;
+    }
 
     // ========================== 1. PRELMIMINARY STUFF ==========================
+    //apply whatever the message thread queued up since the last block
+    drainCommands();
+    publishChorusPositions(numSamples);
     if (!playing) return;
+    qualityTier = governor != nullptr ? governor->getTier() : CpuGovernor::Tier::Full;
 
     const auto sampleRate = getSampleRate();
-    const float timingRandomParam = *apvts->getRawParameterValue("Click Timing Random");
     const float clickVolumeParam = *apvts->getRawParameterValue("Click Volume");
     const int numChannels = outputBuffer.getNumChannels();
     const bool resonatorOn = *apvts->getRawParameterValue("Resonator On");
@@ -103,96 +227,65 @@ void SynthVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int sta
 
     // ======================== 3. COLLECT ACTIVE VOICES ========================
     //single voice for the mono mode, and every active/cooldown voice for the chorus mode
-    std::vector<VoiceState*> activeVoices;
+    activeVoices.clear();
     //mono voice:
     if (startMode == 0) activeVoices.push_back(voices[0].get());    //get raw pointer from unique pointer
     //stero voice:
     else {
-        const int chorusVoiceNumber = *apvts->getRawParameterValue("Chorus Count");
         //collect the active voices
-        timerCallback();
-        for (int i = 0; i < chorusVoiceNumber; ++i) {
+        updateChorusVoiceCount();
+        for (int i = 0; i < lastChorusCount; ++i) {
             activeVoices.push_back(voices[i].get());
             //load the resonator parameters once per block
-            if (voices[i]->resonatorEnabled) voices[i]->resonator.loadParams();
+            if (voices[i]->resonatorEnabled) voices[i]->resonator->loadParams();
         }
-        lastChorusCount = chorusVoiceNumber;
     }
 
-    int offCooldownVoices = 0;
-
     // ========================= 4. PREPARE TEMP BUFFERS =========================
     //these will store the intermediate output of each voice,
-    //before spatialization and mixing into the stero output buffer
-    std::vector<juce::AudioBuffer<float>> tempBuffers;
-    tempBuffers.reserve(activeVoices.size());
-    for (size_t voice = 0; voice < activeVoices.size(); voice++) {
-        tempBuffers.emplace_back(1, numSamples);
-        tempBuffers.back().clear();
-    }
+    //before spatialization and mixing into the stero output buffer. only the first numSamples get used
+    for (size_t voice = 0; voice < activeVoices.size(); voice++) tempBuffers[voice].clear(0, numSamples);
 
     // =========================== 5. PROCESS VOICES =============================
-    //loop over each sample, for each voice. write to their temp buffers
-    for (size_t v = 0; v < activeVoices.size(); ++v) {
-
-        auto* voice = activeVoices[v];
-        if (voice->state == VoiceState::VoiceStateState::CoolingDown) continue;
-        else offCooldownVoices++;
-
-        for (int sampleIdx = 0; sampleIdx < numSamples; ++sampleIdx) {
-            processFirstLayerClicks(*voice, sampleRate, timingRandomParam);
-            processSecondLayerClicks(*voice);
-            float voiceOutput = generateAudioOutput(*voice, clickVolumeParam); //resonator handled in this function
-            updateSongProgress(*voice);  //also handles switch ending song/switching from playing to cooldown
-            updateResonatorProgress(*voice);
-
-            //write output to temp buffer
-            tempBuffers[v].setSample(0, sampleIdx, voiceOutput);
+    //audio is rendered in spans between control ticks. anything that doesn't need to change every
+    //sample (resonator glide, positions, doppler targets, smoothing) happens on the tick,
+    //so it runs at the same rate no matter what block size the host uses.
+    //in chorus mode spans also end wherever a cooling voice is due, so it starts on that exact sample
+    clickGain.setTargetValue(juce::Decibels::decibelsToGain(clickVolumeParam));
+    int spanStart = 0;
+    while (spanStart < numSamples) {
+        if (samplesUntilControlTick <= 0) {
+            controlTick(activeVoices);
+            samplesUntilControlTick = controlInterval;
+        }
+        int spanLength = juce::jmin(samplesUntilControlTick, numSamples - spanStart);
+        if (startMode == 1) {
+            wakeDueVoices();
+            cooldownRate = getCooldownRate();
+            spanLength = juce::jmin(spanLength, juce::jmax(1, wakeScheduler.getSamplesUntilNextWake(cooldownRate)));
         }
-    }
-    // ====================== 6. CHORUS COOLDOWN MANAGEMENT ======================
-    //there are three different strats for how a bug decides when it starts singing
-    //1. alternation: avoid starting your song when another bug is already singing. avoid interference.
-    //2. random: just wait out the variable cooldown. No consideration for other bugs.
-    //3. synchrony: try to sing over other bugs to drown them out.
-
-    //we decide which to use based on a correlation parameter. -1:alternation, 0:random 1: synchrony
-    //and then linearly interpolate between them
-    if (startMode == 1) {
-        const int n = activeVoices.size();
-        const float correlation = *apvts->getRawParameterValue("Chorus Correlation");
-
-        //the value for completely random correlation. relies completely on the randomly assigned cooldown
-        const int randomDecrement = numSamples;
-        const float playingProportion = (float)(offCooldownVoices) / (float)(n);
-        int finalDecrement = numSamples;
 
-        for (int v = 0; v < n; v++) {
+        //loop over each sample in the span, for each voice. write to their temp buffers
+        for (size_t v = 0; v < activeVoices.size(); ++v) {
             auto* voice = activeVoices[v];
-            if (voice->state == VoiceState::VoiceStateState::Playing || voice->state == VoiceState::VoiceStateState::Dormant) continue;
-            if (correlation > 0) {
-                // 1: syncrony: try to sing when other bugs are singing. 
-                //if all voices are playing, then the cooldown is twice as fast. If no voices, then it's normal length
-                float syncronyDecrement = numSamples * (1 + playingProportion * correlationWeight);
-                finalDecrement = static_cast<int>(juce::jmap(correlation, (float)randomDecrement, syncronyDecrement));
-            }
-            else {
-                // -1: alternation: avoid singing when other bugs are singing
-                //when lots of voices are singing, slow down and wait for it to get quieter (by increasing your cooldown)
-                float baseSlow = 1.0f - playingProportion * correlationWeight;
-                //and when fewer voices are singing, get ready to sing faster (by decreasing the cooldown faster)
-                float handoffBoost = boostFactor * (1.0f - playingProportion);
-                float alternationDecrement = numSamples * juce::jmax(0.0f, baseSlow + handoffBoost);
-                finalDecrement = static_cast<int>(juce::jmap(correlation + 1, alternationDecrement, (float)randomDecrement));
-            }
+            //voices that stopped singing still get to finish the clicks they started
+            if (voice->state != VoiceState::VoiceStateState::Playing
+                && voice->activeClicks.empty() && voice->activeSubClicks.empty()) continue;
 
-            voice->chorusCooldownSamples -= finalDecrement;
-            if (voice->chorusCooldownSamples <= 0 && !stopChorusRefresh) reinitializeChorusModeVoice(voice);
+            renderVoiceSpan(*voice, tempBuffers[v].getWritePointer(0, spanStart), spanLength, sampleRate);
+        }
+        if (startMode == 1) {
+            applyDoppler(activeVoices, tempBuffers, spanStart, spanLength);
+            wakeScheduler.advance(spanLength, cooldownRate);
         }
+
+        samplesUntilControlTick -= spanLength;
+        spanStart += spanLength;
     }
 
     // ========================= 6. SPATIALIZE OUTPUT ============================
     if (startMode == 0) {
+        binauralActive = false;
         for (int i = 0; i < numChannels; i++) {
             //write mono output to both channels of the output buffer
             //spatialization isn't applied in mono mode
@@ -206,14 +299,51 @@ void SynthVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int sta
         }
     }
     else {
+        //the last quality tier drops hrtf and ambisonics, and every voice just gets panned
+        const bool panOnly = qualityTier >= CpuGovernor::Tier::PanOnly;
+        const auto spatialMode = panOnly ? SpatialMode::Stereo
+            : static_cast<SpatialMode>((int)*apvts->getRawParameterValue("Chorus Spatial Mode"));
+        const auto decode = static_cast<AmbisonicBus::Decode>((int)*apvts->getRawParameterValue("Chorus Ambisonic Decode"));
+
+        //the renderer's fifo and delay lines still hold whatever it was last fed. clear them, so that doesn't replay
+        const bool binauralNow = spatialMode == SpatialMode::Binaural
+            || (spatialMode == SpatialMode::Ambisonic && decode == AmbisonicBus::Decode::Binaural);
+        if (binauralNow && !binauralActive) binauralRenderer.reset();
+        binauralActive = binauralNow;
+
+        if (spatialMode == SpatialMode::Ambisonic) {
+            const int ambisonicOrder = (int)*apvts->getRawParameterValue("Chorus Ambisonic Order") == 0 ? 1 : 3;
+            ambisonicBus.beginBlock(ambisonicOrder, numSamples);
+        }
+
+        //voices moved on the control ticks. the distance filters and panning only catch up once per block, here,
+        //to wherever the last tick left them
+        for (auto* voice : activeVoices) voice->spatializer->updatePosition(voice->distance, voice->angle);
+        earlyReflections.setEnvironment(static_cast<EarlyReflections::Environment>((int)*apvts->getRawParameterValue("Chorus Environment")));
+        earlyReflections.setTapDensity(qualityTier >= CpuGovernor::Tier::SparseReverb ? 0.5f : 1.0f);
+
         //spatialize the output for each voice, and then mix them together to get the output
         for (size_t v = 0; v < activeVoices.size(); v++) {
             VoiceState* voice = activeVoices[v];
             juce::AudioBuffer<float>& voiceBuffer = tempBuffers[v];
             Spatializer& spatializer = *voice->spatializer;
-            voice->spatializer->updatePosition(voice->distance, voice->angle);
-            spatializer.processBlock(voiceBuffer, outputBuffer, startSample, numSamples);
+            spatializer.setPanOnly(panOnly);
+            if (spatialMode == SpatialMode::Binaural) spatializer.processBlockBinaural(voiceBuffer, binauralRenderer, numSamples);
+            else if (spatialMode == SpatialMode::Ambisonic) spatializer.processBlockAmbisonic(voiceBuffer, ambisonicBus, numSamples);
+            else spatializer.processBlock(voiceBuffer, outputBuffer, startSample, numSamples);
         }
+        renderSwarmField(outputBuffer, startSample, numSamples, spatialMode);
+
+        //binaural and ambisonic voices were only grouped/encoded above. the expensive part happens once here
+        if (spatialMode == SpatialMode::Binaural) {
+            binauralRenderer.process(outputBuffer, startSample, numSamples);
+        }
+        else if (spatialMode == SpatialMode::Ambisonic) {
+            ambisonicBus.decode(outputBuffer, startSample, numSamples, decode, binauralRenderer);
+        }
+
+        //every voice sent into the shared environment above. reflections and late reverb go out here
+        earlyReflections.process(outputBuffer, startSample, numSamples);
     }
 
     // ========================= 7. FINAL STEREO PROCESSING ============================
@@ -224,17 +354,39 @@ void SynthVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int sta
 //===============================================================================
 
 
+//called from the UI. the new positions are rolled here, and sent to the audio thread to apply
 void SynthVoice::randomizeChorusPositions(){
-    float maxDistance = *apvts->getRawParameterValue("Chorus Max Distance");
-    float stereoSpread = *apvts->getRawParameterValue("Chorus Stereo Spread");
-    for (auto& voice : voices) {
-        //spatialization
-        voice->distanceScalar = rng.nextFloat();
-        voice->angleScalar = rng.nextFloat() * 2.0f - 1.0f; //from -1 to 1
-        voice->distance = minDist + voice->distanceScalar * (maxDistance - minDist);
-        voice->angle = getBaseAngle(voice->angleScalar, stereoSpread);
+    for (int i = 0; i < voicesSent; i++) {
+        VoiceCommand command;
+        command.type = VoiceCommand::Type::PlaceVoice;
+        command.index = i;
+        command.values = {
+            messageThreadRng.nextFloat(),                   //distance scalar
+            messageThreadRng.nextFloat() * 2.0f - 1.0f,     //angle scalar, from -1 to 1
+            messageThreadRng.nextFloat(),                   //trajectory randoms
+            messageThreadRng.nextFloat(),
+            messageThreadRng.nextFloat()
+        };
+        sendCommand(command);
     }
-    updateInternalSpatialization(maxDistance, stereoSpread);
+}
+
+
+//===============================================================================
+
+
+//the whole set goes over at once, so a voice never sees one species' song with another's pips
+void SynthVoice::setSpecies(ChorusSpeciesSet::Ptr species) {
+    if (species == nullptr) return;
+    //bigger buffers go first, so no voice plays the new songs without room for them.
+    //the capacities are worked out at the current sample rate (a lower one later only means more dropped clicks)
+    growVoices(species->getVoiceLoad(spatializerSampleRate.load()), species->getCursorSize());
+
+    VoiceCommand command;
+    command.type = VoiceCommand::Type::SetSpecies;
+    command.species = species.get();
+    command.species->incReferenceCount();
+    sendCommand(command);
 }
 
 
@@ -242,30 +394,49 @@ void SynthVoice::randomizeChorusPositions(){
 
 
 void SynthVoice::beginPeriodicChorusUpdates(){
-    startTimerHz(30);   //30 times a second
+    startTimerHz(timerHz);   //30 times a second
 }
 
 
 //===============================================================================
 
 
+//message thread. hands the newest snapshot from the audio thread to the processor for the readout
 void SynthVoice::pushChorusPositionsToUI(){
+    bool gotSnapshot = false;
+    while (positionQueue.pop(uiPositionSnapshot)) gotSnapshot = true;
+    if (!gotSnapshot) return;
+
     std::vector<BugsoundsAudioProcessor::ChorusVoicePosition> positions;
-    const int chorusVoiceNumber = (int)*apvts->getRawParameterValue("Chorus Count");
-    int count = 0;
+    for (int v = 0; v < uiPositionSnapshot.numVoices; ++v) {
+        const auto& voice = uiPositionSnapshot.voices[v];
+        positions.push_back({ voice.distance, voice.angle, voice.isPlaying, voice.isMoving });
+    }
 
-    for (size_t v = 0; v < chorusVoiceNumber && v < (int)voices.size(); ++v) {
-        if (voices[v] == nullptr) continue;
-        auto* voice = voices[v].get();
-        if (!voice) continue;
+    audioProcessor->setChorusVoicePositions(positions);
+}
 
-        bool isPlaying = (voice->state == VoiceState::VoiceStateState::Playing);
-        positions.push_back({ voice->distance, voice->angle, isPlaying });
 
-        ++count;
+//===============================================================================
+
+
+//audio thread. copies the chorus positions out for the UI, about 30 times a second
+void SynthVoice::publishChorusPositions(int numSamples) {
+    if (!*apvts->getRawParameterValue("Chorus On")) return;
+    samplesSincePositionSnapshot += numSamples;
+    if (samplesSincePositionSnapshot < getSampleRate() / 30.0) return;
+    samplesSincePositionSnapshot = 0;
+
+    const int count = getUsableChorusCount();
+    audioPositionSnapshot.numVoices = count;
+    for (int v = 0; v < count; ++v) {
+        auto* voice = voices[v].get();
+        audioPositionSnapshot.voices[v] = { voice->distance, voice->angle,
+            voice->state == VoiceState::VoiceStateState::Playing, ChorusTrajectory::isMoving(chorusMotion) };
     }
 
-    audioProcessor->setChorusVoicePositions(positions);
+    //if the UI hasn't caught up, this one just gets skipped
+    positionQueue.push(audioPositionSnapshot);
 }
 
 
@@ -275,36 +446,36 @@ void SynthVoice::pushChorusPositionsToUI(){
 
 //handles generating clicks from the provided song
     //also manages patterns and randomness
-void SynthVoice::processFirstLayerClicks(VoiceState& voice, double sampleRate, float /*timingRandomParam*/) {
-    const double threshold = (1.0f / voice.patternPhaseDivisor) + voice.timingOffset;
+void SynthVoice::processFirstLayerClicks(VoiceState& voice, double sampleRate) {
+    const double threshold = (1.0f / voice.hot->patternPhaseDivisor) + voice.hot->timingOffset;
 
-    if (voice.phase >= threshold) { //GENERATE A CLICK
+    if (voice.hot->phase >= threshold) { //GENERATE A CLICK
         //only generate a click if the pattern element is non-zero
-        if (voice.beatPattern[voice.patternIndex] != 0) {
-            const float baseFrequency = voice.phaseDelta * sampleRate;
+        if (voice.beatPattern[voice.hot->patternIndex] != 0) {
+            const float baseFrequency = voice.hot->phaseDelta * sampleRate;
             startNewClick(voice, baseFrequency);
         }
 
-        voice.phase = 0.0f;
+        voice.hot->phase = 0.0f;
 
         //advance pattern state
-        if (--voice.clicksRemainingInBeat <= 0) {
-            voice.patternIndex = (voice.patternIndex + 1) % voice.beatPattern.size();
-            const uint8_t patternValue = voice.beatPattern[voice.patternIndex];
+        if (--voice.hot->clicksRemainingInBeat <= 0) {
+            voice.hot->patternIndex = (voice.hot->patternIndex + 1) % voice.beatPatternLength;
+            const uint8_t patternValue = voice.beatPattern[voice.hot->patternIndex];
 
             //handle zero-values as a single subdivision of the pattern
-            voice.clicksRemainingInBeat = patternValue == 0 ? 1 : patternValue;
-            voice.patternPhaseDivisor = patternValue == 0 ? 1 : patternValue;
+            voice.hot->clicksRemainingInBeat = patternValue == 0 ? 1 : patternValue;
+            voice.hot->patternPhaseDivisor = patternValue == 0 ? 1 : patternValue;
         }
 
         //calculate new timing offset with randomness
-        const float randomOffset = (rng.nextFloat() * timingOffsetMax * 2) - timingOffsetMax;
+        const float randomOffset = (voice.rng.nextFloat() * timingOffsetMax * 2) - timingOffsetMax;
     }
 
     //update core playback state
-    voice.phase += voice.phaseDelta;
-    voice.phaseDelta += voice.deltaChangePerSample;
-    voice.samplesRemainingInNote--;
+    voice.hot->phase += voice.hot->phaseDelta;
+    voice.hot->phaseDelta += voice.hot->deltaChangePerSample;
+    voice.hot->samplesRemainingInNote--;
 }
 
 
@@ -313,6 +484,7 @@ void SynthVoice::processFirstLayerClicks(VoiceState& voice, double sampleRate, f
 
 //handles generating subclicks from the active clicks in a voice
 void SynthVoice::processSecondLayerClicks(VoiceState& voice) {
+    const std::vector<Pip>& pipSequence = getSpecies(voice).pips;
     for (auto& click : voice.activeClicks) {
         if (click.samplesTilNextClick <= 0 && click.pos < pipSequence.size()) {
             //start a new subclick with the next pip in the sequence
@@ -332,7 +504,7 @@ void SynthVoice::processSecondLayerClicks(VoiceState& voice) {
     //remove finished clicks with an iterator
     voice.activeClicks.erase(
         std::remove_if(voice.activeClicks.begin(), voice.activeClicks.end(),
-            [this](const Click& c) { return c.pos >= pipSequence.size(); }),
+            [&pipSequence](const Click& c) { return c.pos >= pipSequence.size(); }),
         voice.activeClicks.end()
     );
 }
@@ -341,7 +513,7 @@ void SynthVoice::processSecondLayerClicks(VoiceState& voice) {
 //===============================================================================
 
 
-float SynthVoice::generateAudioOutput(VoiceState& voice, float clickVolumeParam) {
+float SynthVoice::generateAudioOutput(VoiceState& voice) {
     float output = 0.0f;
 
     for (auto& subClick : voice.activeSubClicks) {
@@ -363,9 +535,8 @@ float SynthVoice::generateAudioOutput(VoiceState& voice, float clickVolumeParam)
         subClick.curLevel += subClick.levelChangePerSample;
         subClick.samplesRemaining--;
 
-        //add this subclick to the output
-        float volumeGain = juce::Decibels::decibelsToGain(clickVolumeParam);
-        output += oscValue * subClick.curLevel * volumeGain;
+        //add this subclick to the output. the click volume is smoothed on the control tick
+        output += oscValue * subClick.curLevel * currentClickGain;
     }
 
     //remove finished subclicks with an iterator
@@ -375,7 +546,7 @@ float SynthVoice::generateAudioOutput(VoiceState& voice, float clickVolumeParam)
         voice.activeSubClicks.end());
 
     //if the resonator is enabled for this voice, then process the output through it
-    return voice.resonatorEnabled ? voice.resonator.processSample(output, voice.resonatorFreq) : output;
+    return voice.resonatorEnabled && !voice.resonatorBypassed ? voice.resonator->processSample(output, voice.hot->resonatorFreq) : output;
 }
 
 
@@ -387,12 +558,13 @@ float SynthVoice::generateAudioOutput(VoiceState& voice, float clickVolumeParam)
     //in mono mode, playback ends when the one voice is done playing
     //in chorus mode, playback ends when ALL voices are done, AND we have already received a noteOff
 void SynthVoice::updateSongProgress(VoiceState& voice) {
-    if (voice.samplesRemainingInNote <= 0) {
+    if (voice.hot->samplesRemainingInNote <= 0) {
         //we've reached the end of a note
-        if (++voice.songIndex >= voice.song.size()) {
+        if (!advanceSong(voice)) {
             //we've reached the end of the song
             if (startMode == 0) {
                 //mono mode
+                voice.state = VoiceState::VoiceStateState::Dormant;
                 clearCurrentNote();
                 playing = false;
             }
@@ -402,8 +574,12 @@ void SynthVoice::updateSongProgress(VoiceState& voice) {
                     //this voice has completed a song, but we aren't done singing yet.
                     //so we need to put this voice into cooldown
                     const float cooldownMax = apvts->getRawParameterValue("Chorus Cooldown Max")->load();
-                    voice.chorusCooldownSamples = rng.nextFloat() * cooldownMax * getSampleRate();
+                    voice.songLengthSamples = voice.songStats.totalMs * getSampleRate() / 1000.0;
+                    swarmField.observeSong(voice.songStats, cooldownMax);
+                    voice.chorusCooldownSamples = voice.rng.nextFloat() * cooldownMax * getSampleRate();
                     voice.state = VoiceState::VoiceStateState::CoolingDown;
+                    scheduleCooldown(voice);
+                    synchrony.startCooldown(voice.index, voice.songLengthSamples, voice.chorusCooldownSamples);
                 }
                 else {
                     //this voice has completed a song, and the synth is done playing
@@ -421,10 +597,6 @@ void SynthVoice::updateSongProgress(VoiceState& voice) {
                 }
             }
         }
-        else {
-            //we HAVENT reached the end of the current song. Just dispatch the next note
-            setupNextNote(voice, voice.song[voice.songIndex]);
-        }
     }
 }
 
@@ -436,17 +608,13 @@ void SynthVoice::updateSongProgress(VoiceState& voice) {
 //  this function is similar to updateSongProgress, but it doesn't handle ending the song
 //  if the resonator song ends while the song is still playing, it stays steady at the final
 //  freq of the last note
-void SynthVoice::updateResonatorProgress(VoiceState& voice) {
+//  runs on the control tick: the resonator only reads its frequency once per hop anyway
+void SynthVoice::updateResonatorProgress(VoiceState& voice, int numSamples) {
     if (voice.resonatorEnabled) {
-        voice.resonatorFreq += voice.resonatorFreqDelta;
+        voice.hot->resonatorFreq += voice.resonatorFreqDelta * numSamples;
+        voice.resSamplesRemainingInNote -= numSamples;
 
-        if (--voice.resSamplesRemainingInNote <= 0) {
-            if (++voice.resIndex >= voice.resSong.size()) {
-                // Loop resonator song
-                voice.resIndex = 0;
-            }
-            setupNextResNote(voice, voice.resSong[voice.resIndex]);
-        }
+        if (voice.resSamplesRemainingInNote <= 0) advanceResSong(voice);
     }
 }
 
@@ -454,12 +622,302 @@ void SynthVoice::updateResonatorProgress(VoiceState& voice) {
 //===========================================================================
 
 
-//quickly converts and updates a voices angle/distance scalars into actual distances and angles
+//quickly converts and updates a voices angle/distance scalars into actual distances and angles.
+//the scalars place the voice's anchor, and its trajectory (if it's moving) is applied on top
 void SynthVoice::updateVoiceSpatialization(VoiceState* voice, float maxDistance, float stereoSpread) {
     float maxDistanceScalar = (maxDistance - minDist) / (15.0f - minDist);
-    voice->distance = minDist + voice->distanceScalar * (juce::jmin(maxDistance, 15.0f) - minDist) + (15 * maxDistanceScalar);
-    voice->distance = juce::jlimit(5.0f, 15.0f, voice->distance);
-    voice->angle = getBaseAngle(voice->angleScalar, stereoSpread);
+    voice->anchorDistance = minDist + voice->distanceScalar * (juce::jmin(maxDistance, 15.0f) - minDist) + (15 * maxDistanceScalar);
+    voice->anchorDistance = juce::jlimit(5.0f, 15.0f, voice->anchorDistance);
+    voice->anchorAngle = getBaseAngle(voice->angleScalar, stereoSpread);
+    voice->trajectory.getPosition(chorusMotion, voice->anchorDistance, voice->anchorAngle, voice->distance, voice->angle);
+}
+
+
+//===========================================================================
+
+
+//moves every chorus voice along its trajectory, by numSamples worth of time. runs on the control tick (see controlTick)
+void SynthVoice::updateChorusMotion(const std::vector<VoiceState*>& activeVoices, int numSamples) {
+    chorusMotion = static_cast<ChorusMotion>((int)*apvts->getRawParameterValue("Chorus Motion"));
+    const float speed = *apvts->getRawParameterValue("Chorus Motion Speed");
+    const float deltaSeconds = (float)(numSamples / getSampleRate());
+
+    for (auto* voice : activeVoices) {
+        voice->trajectory.advance(chorusMotion, deltaSeconds, speed, voice->anchorDistance);
+        voice->trajectory.getPosition(chorusMotion, voice->anchorDistance, voice->anchorAngle, voice->distance, voice->angle);
+    }
+}
+
+
+//===========================================================================
+
+
+//delays each chorus voice by the time its sound takes to reach the listener. the delay follows
+//the voice's distance, so approaching voices pitch up and receding ones pitch down.
+//static voices skip this, since a constant delay wouldn't be audible anyway.
+//targets are set on the control tick (updateDopplerTargets), this just runs the delay lines
+void SynthVoice::applyDoppler(const std::vector<VoiceState*>& activeVoices, std::vector<juce::AudioBuffer<float>>& tempBuffers,
+    int startSample, int numSamples) {
+    if (!dopplerActive) return;
+
+    const int numLanes = juce::jmin((int)activeVoices.size(), DopplerDelayBank::maxLanes);
+    for (int v = 0; v < numLanes; v++) dopplerLanes[v] = tempBuffers[v].getWritePointer(0, startSample);
+    dopplerBank.process(dopplerLanes.data(), numLanes, numSamples);
+}
+
+
+//===========================================================================
+
+
+//points every lane's delay at its voice's current distance, ramped over the next control interval
+void SynthVoice::updateDopplerTargets(const std::vector<VoiceState*>& activeVoices) {
+    if (!ChorusTrajectory::isMoving(chorusMotion)) {
+        dopplerActive = false;
+        return;
+    }
+    if (!dopplerActive) {
+        //the lines still hold audio from the last time voices were moving
+        dopplerBank.reset();
+        dopplerActive = true;
+    }
+
+    const int numLanes = juce::jmin((int)activeVoices.size(), DopplerDelayBank::maxLanes);
+    for (int v = 0; v < numLanes; v++) {
+        dopplerBank.setTargetDelay(v, dopplerBank.getDelayForDistance(activeVoices[v]->distance), controlInterval);
+    }
+}
+
+
+//===========================================================================
+
+
+//the rest of the swarm, past the chorus voices. its beds get routed like a few more (far away)
+//voices, so they land in the same spatial mode and environment as everything else
+void SynthVoice::renderSwarmField(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples, SpatialMode spatialMode) {
+    const int population = (int)*apvts->getRawParameterValue("Chorus Swarm Population");
+    const float falloff = *apvts->getRawParameterValue("Chorus Swarm Falloff");
+    swarmField.setPopulation(population - lastChorusCount, falloff, !stopChorusRefresh);
+    if (!swarmField.isActive()) return;
+
+    SwarmField::Settings settings;
+    settings.pitchRandom = *apvts->getRawParameterValue("Click Pitch Random");
+    settings.attackRatio = *apvts->getRawParameterValue("Click Atack Decay Ratio");
+    settings.gain = currentClickGain;
+    swarmField.render(numSamples, speciesSet->get(0).pips, settings);   //the far field is all the main species
+
+    for (int b = 0; b < SwarmField::numBeds; b++) {
+        const float* bed = swarmField.getBed(b);
+        const float angle = SwarmField::getBedAngle(b);
+        earlyReflections.addToBin(earlyReflections.getBin(angle, 1.0f), bed, numSamples);
+        if (spatialMode == SpatialMode::Binaural) binauralRenderer.addToBin(binauralRenderer.getBinForAngle(angle), bed, numSamples);
+        else if (spatialMode == SpatialMode::Ambisonic) ambisonicBus.encode(bed, angle, 1.0f, numSamples);
+    }
+    if (spatialMode == SpatialMode::Stereo) swarmField.addToStereo(outputBuffer, startSample, numSamples);
+}
+
+
+//===========================================================================
+
+
+//everything that runs at control rate. called every controlInterval samples, before the span it covers
+void SynthVoice::controlTick(const std::vector<VoiceState*>& activeVoices) {
+    //parameter smoothing
+    currentClickGain = clickGain.skip(controlInterval);
+
+    for (auto* voice : activeVoices) {
+        if (voice->state == VoiceState::VoiceStateState::Playing) updateResonatorProgress(*voice, controlInterval);
+    }
+
+    if (startMode == 1) {
+        updateChorusMotion(activeVoices, controlInterval);
+        updateDopplerTargets(activeVoices);
+        updateQualityCuts(activeVoices);
+        timingModel = static_cast<ChorusTimingModel>((int)*apvts->getRawParameterValue("Chorus Timing Model"));
+        const float hearingRange = *apvts->getRawParameterValue("Chorus Hearing Range");
+        const bool wasListeningLocally = listeningLocally;
+        listeningLocally = timingModel == ChorusTimingModel::Cooldown && hearingRange >= minHearingRange;
+        if (wasListeningLocally && !listeningLocally && !stopChorusRefresh) {
+            //back on the shared clock. cooling voices carry on from what they had left, held back ones included
+            for (auto* voice : activeVoices) {
+                if (voice->state == VoiceState::VoiceStateState::CoolingDown) wakeScheduler.schedule(voice->index, voice->cooldownLeft);
+            }
+        }
+        if (timingModel == ChorusTimingModel::PhaseCoupled) updateSynchrony(activeVoices);
+        else if (listeningLocally) updateNeighbourListening(activeVoices, hearingRange);
+    }
+}
+
+
+//===========================================================================
+
+
+//what the cpu governor's tier turns off, worked out once per control tick.
+//culling takes the farthest quarter of the chorus, since those are the quietest
+void SynthVoice::updateQualityCuts(const std::vector<VoiceState*>& activeVoices) {
+    cullDistance = std::numeric_limits<float>::max();
+    if (qualityTier >= CpuGovernor::Tier::CullQuiet && activeVoices.size() >= 4) {
+        cullScratch.clear();
+        for (auto* voice : activeVoices) cullScratch.push_back(voice->distance);
+        const size_t firstCulled = activeVoices.size() - activeVoices.size() / 4;
+        std::nth_element(cullScratch.begin(), cullScratch.begin() + (long)firstCulled, cullScratch.end());
+        cullDistance = cullScratch[firstCulled];
+    }
+
+    const bool bypassFarResonators = qualityTier >= CpuGovernor::Tier::NoDistantResonators;
+    for (auto* voice : activeVoices) voice->resonatorBypassed = bypassFarResonators && voice->distance > resonatorBypassDistance;
+}
+
+
+//===========================================================================
+
+
+//there are three different strats for how a bug decides when it starts singing
+//1. alternation: avoid starting your song when another bug is already singing. avoid interference.
+//2. random: just wait out the variable cooldown. No consideration for other bugs.
+//3. synchrony: try to sing over other bugs to drown them out.
+
+//we decide which to use based on a correlation parameter. -1:alternation, 0:random 1: synchrony
+//and then linearly interpolate between them.
+//when everyone hears everyone, every cooling voice shares the same rate, so this is the speed of
+//the wake scheduler's clock: how many cooldown samples pass per real sample
+float SynthVoice::getCooldownRate() {
+    const int n = lastChorusCount;
+    if (n <= 0) return 1.0f;
+    //these schedule every voice themselves (see updateSynchrony, updateNeighbourListening), in real samples
+    if (timingModel == ChorusTimingModel::PhaseCoupled || listeningLocally) return 1.0f;
+
+    //voices that aren't cooling down are the ones singing
+    return getCooldownRate((float)(n - wakeScheduler.getNumScheduled()) / (float)(n));
+}
+
+
+//the rate for a voice that hears this much of its chorus singing (0 to 1)
+float SynthVoice::getCooldownRate(float playingProportion) {
+    const float correlation = *apvts->getRawParameterValue("Chorus Correlation");
+
+    //the value for completely random correlation. relies completely on the randomly assigned cooldown
+    const float randomRate = 1.0f;
+    if (correlation > 0) {
+        // 1: syncrony: try to sing when other bugs are singing. 
+        //if all voices are playing, then the cooldown is twice as fast. If no voices, then it's normal length
+        float syncronyRate = 1.0f + playingProportion * correlationWeight;
+        return juce::jmap(correlation, randomRate, syncronyRate);
+    }
+    // -1: alternation: avoid singing when other bugs are singing
+    //when lots of voices are singing, slow down and wait for it to get quieter (by increasing your cooldown)
+    float baseSlow = 1.0f - playingProportion * correlationWeight;
+    //and when fewer voices are singing, get ready to sing faster (by decreasing the cooldown faster)
+    float handoffBoost = boostFactor * (1.0f - playingProportion);
+    float alternationRate = juce::jmax(0.0f, baseSlow + handoffBoost);
+    return juce::jmap(correlation + 1, alternationRate, randomRate);
+}
+
+
+//hands a voice that just started cooling down to the wake scheduler.
+//if it happened partway through the span, the clock hasn't caught up to that point yet, so make up for it
+void SynthVoice::scheduleCooldown(VoiceState& voice) {
+    voice.cooldownLeft = voice.chorusCooldownSamples;
+    wakeScheduler.schedule(voice.index, voice.chorusCooldownSamples + (double)cooldownRate * spanOffset);
+}
+
+
+//phase coupled timing model. moves every voice's phase along one control tick, coupled through the
+//mean field, then reschedules the cooling voices for when their phase will come around.
+//the cooldown clock runs at 1 in this model, so the wake scheduler just counts real samples
+void SynthVoice::updateSynchrony(const std::vector<VoiceState*>& activeVoices) {
+    const float coupling = *apvts->getRawParameterValue("Chorus Correlation");
+    const bool distanceWeighted = *apvts->getRawParameterValue("Chorus Distance Coupling");
+    for (auto* voice : activeVoices) {
+        //louder (closer) voices pull harder on the mean field. inverse square, like the spatializer gain
+        const float distanceFactor = minDist / juce::jmax(minDist, voice->distance);
+        synchrony.setWeight(voice->index, distanceWeighted ? distanceFactor * distanceFactor : 1.0f);
+    }
+    synchrony.tick(lastChorusCount, controlInterval, coupling);
+
+    if (stopChorusRefresh) return;
+    for (auto* voice : activeVoices) {
+        if (voice->state != VoiceState::VoiceStateState::CoolingDown) continue;
+        wakeScheduler.schedule(voice->index, synchrony.getSamplesUntilWake(voice->index));
+    }
+}
+
+
+//cooldown model with a hearing range. instead of the whole chorus, each cooling voice only listens to
+//the voices within hearingRange of it (found through neighbourGrid), louder the closer they are.
+//so a big chorus breaks up into local clusters that answer each other, instead of one global turn taking.
+//every voice counts down at its own rate here, so they all get rescheduled every tick
+void SynthVoice::updateNeighbourListening(const std::vector<VoiceState*>& activeVoices, float hearingRange) {
+    neighbourGrid.beginBuild(hearingRange);
+    for (auto* voice : activeVoices) neighbourGrid.add(voice->distance * std::cos(voice->angle), voice->distance * std::sin(voice->angle));
+    neighbourGrid.endBuild();
+
+    for (size_t v = 0; v < activeVoices.size(); v++) {
+        auto* voice = activeVoices[v];
+        if (voice->state != VoiceState::VoiceStateState::CoolingDown) continue;
+
+        //how much of what this voice hears is singing. inverse square, from a meter away
+        float heardSinging = 0.0f, heardTotal = 0.0f;
+        neighbourGrid.forEachNeighbour((int)v, hearingRange, [&](int j, float distanceSquared) {
+            const float loudness = 1.0f / juce::jmax(1.0f, distanceSquared);
+            heardTotal += loudness;
+            if (activeVoices[(size_t)j]->state == VoiceState::VoiceStateState::Playing) heardSinging += loudness;
+        });
+        const float rate = getCooldownRate(heardTotal > 0.0f ? heardSinging / heardTotal : 0.0f);
+
+        if (stopChorusRefresh) continue;
+        //held back until it's quieter around it. it stays scheduled (just never due), so it still counts as cooling down
+        const double wait = rate > 0.0f ? voice->cooldownLeft / rate : std::numeric_limits<double>::infinity();
+        wakeScheduler.schedule(voice->index, wait);
+        voice->cooldownLeft = juce::jmax(0.0, voice->cooldownLeft - (double)rate * controlInterval);
+    }
+}
+
+
+//starts every voice whose cooldown has run out. called at the start of each span
+void SynthVoice::wakeDueVoices() {
+    int index;
+    while (wakeScheduler.popDue(index)) {
+        if (index >= lastChorusCount) continue;
+        auto* voice = voices[index].get();
+        if (voice->state != VoiceState::VoiceStateState::CoolingDown || stopChorusRefresh) continue;
+        if (voice->distance >= cullDistance) {
+            //culled by the cpu governor. skip this song, and wait out the same cooldown again
+            voice->chorusCooldownSamples = juce::jmax(voice->chorusCooldownSamples, controlInterval);
+            scheduleCooldown(*voice);
+            continue;
+        }
+        reinitializeChorusModeVoice(voice);
+    }
+}
+
+
+//===========================================================================
+
+
+//renders one control span of a voice into out.
+//note changes are treated as events: the click loop runs straight up to the end of the current
+//note, and only then does the song advance, instead of checking for the end of the note every sample
+void SynthVoice::renderVoiceSpan(VoiceState& voice, float* out, int numSamples, double sampleRate) {
+    int sampleIdx = 0;
+    while (sampleIdx < numSamples) {
+        const bool singing = voice.state == VoiceState::VoiceStateState::Playing;
+        int eventSamples = numSamples - sampleIdx;
+        if (singing) eventSamples = juce::jmin(eventSamples, juce::jmax(1, voice.hot->samplesRemainingInNote));
+
+        for (int i = 0; i < eventSamples; ++i) {
+            if (singing) processFirstLayerClicks(voice, sampleRate);
+            processSecondLayerClicks(voice);
+            out[sampleIdx + i] = generateAudioOutput(voice); //resonator handled in this function
+        }
+        sampleIdx += eventSamples;
+
+        //also handles switch ending song/switching from playing to cooldown
+        if (singing && voice.hot->samplesRemainingInNote <= 0) {
+            spanOffset = sampleIdx;
+            updateSongProgress(voice);
+            spanOffset = 0;
+        }
+    }
 }
 
 
@@ -471,81 +929,130 @@ void SynthVoice::initializeChorusVoice(VoiceState* voice, bool resonatorOn){
      float maxDistance = *apvts->getRawParameterValue("Chorus Max Distance");
      float stereoSpread = *apvts->getRawParameterValue("Chorus Stereo Spread");
 
-    //spatialization
+    //spatialization. there's always a spatializer free here, see getUsableChorusCount
+     if (voice->spatializer == nullptr) voice->spatializer = spatializerPool.acquire();
+     jassert(voice->spatializer != nullptr);
      if (!voice->hasBeenInitialized) {
-         voice->distanceScalar = rng.nextFloat();
-         voice->angleScalar = rng.nextFloat() * 2.0f - 1.0f; //from -1 to 1
+         CounterRng placementRng(noteSeed, CounterRng::makeStream(PlacementStream, (uint32_t)voice->index, 0));
+         voice->distanceScalar = placementRng.nextFloat();
+         voice->angleScalar = placementRng.nextFloat() * 2.0f - 1.0f; //from -1 to 1
+         voice->trajectory.randomize(placementRng.nextFloat(), placementRng.nextFloat(), placementRng.nextFloat());
          voice->hasBeenInitialized = true;
      }
+    //species comes from its own stream, so rerolling positions doesn't turn crickets into cicadas
+    CounterRng speciesRng(noteSeed, CounterRng::makeStream(PlacementStream, (uint32_t)voice->index, 1));
+    voice->speciesIndex = speciesSet->pick(speciesRng.nextFloat());
+    const ChorusSpecies& species = getSpecies(*voice);
+    resonatorOn = resonatorOn && species.resonatorOn;
     updateVoiceSpatialization(voice, maxDistance, stereoSpread);
-    voice->spatializer = std::make_unique<Spatializer>();
-    voice->spatializer->prepare(voice->distance, voice->angle, { getSampleRate(), 1024, 2 });
+    //already prepared on the message thread, so reusing one is just a reset
+    voice->spatializer->restart(voice->distance, voice->angle);
+    voice->spatializer->setReflections(&earlyReflections);
 
     //first cooldown
     //convert the excitation parameter (0 to 1) to a random cooldown. higher excitation -> shorter cooldown
     const float cooldownMax = apvts->getRawParameterValue("Chorus Cooldown Max")->load();
-    voice->chorusCooldownSamples = rng.nextFloat() * cooldownMax * getSampleRate();
+    beginSongInstance(*voice);
+    voice->chorusCooldownSamples = voice->rng.nextFloat() * cooldownMax * getSampleRate();
     voice->state = VoiceState::VoiceStateState::CoolingDown;
+    scheduleCooldown(*voice);
     
-    //compile the ast so each voice gets its own randomized version of the song
-    ErrorInfo error;
-    std::map<std::string, float> sharedEnv;
-    std::vector<SongElement> mainSong = evaluateAST(compiledSongScript, &error, &sharedEnv);
-    std::vector<SongElement> resSong = {};
-    if (resonatorOn) resSong = evaluateAST(compiledResonatorScript, &error, &sharedEnv);
-
-    if (mainSong.empty()) {
-        clearCurrentNote();
-        playing = false;
-        return;
-    }
+    //each voice gets its own randomized instance of the song. one that doesn't get to a note is just tried
+    //again after the cooldown, like any other song (see sitOutSong)
+    const bool songStarted = initializeVoiceState(voice, 1, species, resonatorOn);
+
+    //songs are only measured as they're sung, so until one finishes, the swarm goes off the first note
+    if (songStarted && !swarmField.hasObservedSong()) swarmField.observeSong(voice->songStats, cooldownMax);
+    //the random first cooldown is also where the voice starts out in its cycle
+    synchrony.startCooldown(voice->index, voice->songLengthSamples, voice->chorusCooldownSamples);
+}
+
+
+//===========================================================================
+
+
+//moves a voice on to a fresh stream for its next song. everything random about that song
+//(its rands, its clicks, and the cooldown after it) comes from this stream
+void SynthVoice::beginSongInstance(VoiceState& voice) {
+    voice.rng.reset(noteSeed, CounterRng::makeStream(SongStream, (uint32_t)voice.index, voice.songInstance++));
+}
+
 
-    initializeVoiceState(voice, 1, mainSong, resSong, resonatorOn);
+//message thread. takes effect on the next note
+void SynthVoice::setMasterSeed(uint64_t seed) {
+    masterSeed = seed;
+    messageThreadRng.reset(seed, CounterRng::makeStream(RerollStream, 0, 0));
 }
 
 
 //===========================================================================
 
+//message thread. this is the only place voices get created: they're fully built here,
+//then handed to the audio thread, so it never allocates one mid-block
 void SynthVoice::timerCallback() {
-    if (!*apvts->getRawParameterValue("Chorus On")) return;
-    //detect if the spatialization parameters have changed since last block
+    freeRetiredObjects();
+    flushPendingCommands();
+
+    //switching to or from binaural changes the delay the host has to make up
+    const int latency = getLatencySamples();
+    if (latency != audioProcessor->getLatencySamples()) audioProcessor->setLatencySamples(latency);
+
+    //keep enough voices built for the current chorus count
+    const int chorusCount = juce::jmin((int)*apvts->getRawParameterValue("Chorus Count"), voiceCapacity);
+    while (voicesSent < chorusCount) {
+        VoiceCommand command;
+        command.type = VoiceCommand::Type::AddVoice;
+        command.voice = createVoiceState().release();
+        sendCommand(command);
+        voicesSent++;
+    }
+
+    //resonators and spatializers only get built once something needs them, see ColdPool.
+    //the mono voice never needs a spatializer
+    const bool chorusOn = *apvts->getRawParameterValue("Chorus On");
+    const int resonatorsNeeded = *apvts->getRawParameterValue("Resonator On") ? (chorusOn ? chorusCount : 1) : 0;
+    while (resonatorsSent < resonatorsNeeded) {
+        VoiceCommand command;
+        command.type = VoiceCommand::Type::AddResonator;
+        command.resonator = new HarmonicResonator();
+        sendCommand(command);
+        resonatorsSent++;
+    }
+    const int spatializersNeeded = chorusOn ? chorusCount : 0;
+    while (spatializersSent < spatializersNeeded) {
+        VoiceCommand command;
+        command.type = VoiceCommand::Type::AddSpatializer;
+        command.spatializer = createSpatializer();
+        sendCommand(command);
+        spatializersSent++;
+    }
+
+    //every so often, have the audio thread give back the slots nobody has used since the last time
+    if (--ticksUntilTrim <= 0) {
+        VoiceCommand command;
+        command.type = VoiceCommand::Type::TrimIdle;
+        command.values[0] = (float)juce::jmax(1, chorusCount);
+        command.values[1] = (float)resonatorsNeeded;
+        command.values[2] = (float)spatializersNeeded;
+        sendCommand(command);
+        ticksUntilTrim = idleTrimTicks;
+    }
+
+    if (!chorusOn) return;
+
+    //detect if the spatialization parameters have changed since last time
     float currentMaxDistance = *apvts->getRawParameterValue("Chorus Max Distance");
     float currentStereoSpread = *apvts->getRawParameterValue("Chorus Stereo Spread");
     if (currentMaxDistance != lastMaxDistance || currentStereoSpread != lastStereoSpread) {
-        updateInternalSpatialization(currentMaxDistance, currentStereoSpread);
-    } 
-
-    //handle voice creation and dormancy
-    if (*apvts->getRawParameterValue("Chorus On")) {
-        const int chorusCount = *apvts->getRawParameterValue("Chorus Count");
-        if (lastChorusCount != chorusCount) {
-            //find the difference, the amount of voices we need to add or remove
-            int difference = 0;
-            if (lastChorusCount < 0) {
-                difference = chorusCount;
-                lastChorusCount = 0;
-            }
-            else difference = chorusCount - lastChorusCount;
-
-            if (difference > 0) {
-                //add voices
-                //if there aren't already enough voices that are dormant, create some new ones
-                while (voices.size() < chorusCount) voices.push_back(std::make_unique<VoiceState>());
-                bool resonatorOn = apvts->getRawParameterValue("Resonator On")->load();
-                for (int i = lastChorusCount; i < chorusCount; i++) {
-                    //only reinitialize new voices, not every voice
-                    auto& newVoice = *voices[i];
-                    initializeChorusVoice(&newVoice, resonatorOn);
-                }
-            }
-            else {
-                //remove voices
-                for (int idx = chorusCount; idx < (int)voices.size(); ++idx)
-                    voices[idx]->state = VoiceState::VoiceStateState::Dormant;
-            }
-        }
-        lastChorusCount = chorusCount;
+        VoiceCommand command;
+        command.type = VoiceCommand::Type::SetSpatialParams;
+        command.values[0] = currentMaxDistance;
+        command.values[1] = currentStereoSpread;
+        sendCommand(command);
+        lastMaxDistance = currentMaxDistance;
+        lastStereoSpread = currentStereoSpread;
     }
+
     pushChorusPositionsToUI();
 }
 
@@ -553,6 +1060,284 @@ void SynthVoice::timerCallback() {
 //===========================================================================
 
 
+//message thread. queues a command for the audio thread. if the queue is full it waits in
+//pendingCommands, and goes out (in order) on a later timer tick
+void SynthVoice::sendCommand(const VoiceCommand& command) {
+    if (pendingCommands.empty() && commandQueue.push(command)) return;
+    pendingCommands.push_back(command);
+}
+
+
+void SynthVoice::flushPendingCommands() {
+    size_t sent = 0;
+    while (sent < pendingCommands.size() && commandQueue.push(pendingCommands[sent])) sent++;
+    pendingCommands.erase(pendingCommands.begin(), pendingCommands.begin() + sent);
+}
+
+
+//message thread. frees whatever the audio thread swapped out or trimmed.
+//trimmed slots come off the counts, so they get built again if they're ever needed
+void SynthVoice::freeRetiredObjects() {
+    RetiredObject retired;
+    while (retiredQueue.pop(retired)) {
+        if (retired.species != nullptr) retired.species->decReferenceCount();
+        if (retired.program != nullptr) retired.program->decReferenceCount();
+        if (retired.voice != nullptr) voicesSent--;
+        if (retired.resonator != nullptr) resonatorsSent--;
+        if (retired.spatializer != nullptr) spatializersSent--;
+        delete retired.voice;
+        delete retired.resonator;
+        delete retired.spatializer;
+        delete retired.buffers;
+    }
+}
+
+
+//builds a voice with everything it needs allocated, so using it later doesn't allocate
+std::unique_ptr<SynthVoice::VoiceState> SynthVoice::createVoiceState() {
+    auto voice = std::make_unique<VoiceState>();
+    voice->activeClicks.reserve((size_t)clickCapacity);
+    voice->activeSubClicks.reserve((size_t)subClickCapacity);
+    voice->song.reserve(cursorSize);
+    voice->resSong.reserve(cursorSize);
+    return voice;
+}
+
+
+//message thread. makes sure every voice has room for the worst the songs can do (within the budget, see VoiceLoad),
+//and song cursors big enough to run every program without allocating.
+//voices only ever grow, new ones get built at the new size, and the ones already out get bigger buffers sent over
+void SynthVoice::growVoices(const VoiceLoad& load, const SongCursorSize& cursors) {
+    const int clicks = juce::jmax(clickCapacity, load.getClickCapacity());
+    const int subClicks = juce::jmax(subClickCapacity, load.getSubClickCapacity());
+    SongCursorSize size = cursorSize;
+    size.include(cursors);
+    size.patternLength = juce::jmax(size.patternLength, load.getPatternCapacity());
+    if (clicks == clickCapacity && subClicks == subClickCapacity && size == cursorSize) return;
+    clickCapacity = clicks;
+    subClickCapacity = subClicks;
+    cursorSize = size;
+
+    for (int i = 0; i < voicesSent; i++) {
+        auto* buffers = new VoiceBuffers();
+        buffers->activeClicks.reserve((size_t)clickCapacity);
+        buffers->activeSubClicks.reserve((size_t)subClickCapacity);
+        buffers->song.reserve(cursorSize);
+        buffers->resSong.reserve(cursorSize);
+
+        VoiceCommand command;
+        command.type = VoiceCommand::Type::GrowVoice;
+        command.index = i;
+        command.buffers = buffers;
+        sendCommand(command);
+    }
+}
+
+
+//message thread. spatializers are prepared here, once, so the audio thread only ever resets them
+Spatializer* SynthVoice::createSpatializer() {
+    auto* spatializer = new Spatializer();
+    spatializer->prepare(ChorusTrajectory::maxDistance, 0.0f, { spatializerSampleRate.load(), 1024, 2 });
+    return spatializer;
+}
+
+
+//===========================================================================
+
+
+//audio thread. applies everything the message thread queued up
+void SynthVoice::drainCommands() {
+    //send back anything that didn't fit last time
+    size_t returned = 0;
+    while (returned < pendingRetired.size() && retiredQueue.push(pendingRetired[returned])) returned++;
+    pendingRetired.erase(pendingRetired.begin(), pendingRetired.begin() + returned);
+
+    VoiceCommand command;
+    while (commandQueue.pop(command)) applyCommand(command);
+}
+
+
+void SynthVoice::applyCommand(const VoiceCommand& command) {
+    using Type = VoiceCommand::Type;
+    switch (command.type) {
+        case Type::AddVoice:
+            //capacity was reserved in the constructor, so this doesn't allocate
+            jassert(voices.size() < voices.capacity());
+            command.voice->index = (int)voices.size();
+            command.voice->hot = &hotVoices[(size_t)voices.size()];
+            voices.emplace_back(command.voice);
+            break;
+
+        case Type::AddResonator:
+            resonatorPool.add(command.resonator);
+            break;
+
+        case Type::AddSpatializer:
+            //the sample rate changed while it was in the queue. preparing it again would allocate, so it goes back,
+            //and the message thread builds another at the new rate
+            if (command.spatializer->getPreparedSampleRate() != getSampleRate()) retire({ nullptr, nullptr, nullptr, command.spatializer });
+            else spatializerPool.add(command.spatializer);
+            break;
+
+        case Type::PlaceVoice: {
+            if (command.index >= (int)voices.size()) break;
+            auto* voice = voices[command.index].get();
+            voice->distanceScalar = command.values[0];
+            voice->angleScalar = command.values[1];
+            voice->trajectory.randomize(command.values[2], command.values[3], command.values[4]);
+            voice->hasBeenInitialized = true;
+            updateVoiceSpatialization(voice, *apvts->getRawParameterValue("Chorus Max Distance"),
+                *apvts->getRawParameterValue("Chorus Stereo Spread"));
+            break;
+        }
+
+        case Type::SetSpatialParams:
+            updateInternalSpatialization(command.values[0], command.values[1]);
+            break;
+
+        case Type::SetSpecies: {
+            //keep the old set alive until the message thread releases it, voices may be mid click on it
+            ChorusSpeciesSet* old = speciesSet.get();
+            old->incReferenceCount();
+            speciesSet = command.species;
+            //drop the reference the command carried. speciesSet holds its own now
+            command.species->decReferenceCount();
+            retire({ old });
+            break;
+        }
+
+        case Type::TrimIdle:
+            trimIdleSlots((int)command.values[0], (int)command.values[1], (int)command.values[2]);
+            break;
+
+        case Type::GrowVoice:
+            if (command.index < (int)voices.size()) growVoice(*voices[command.index], *command.buffers);
+            retire({ nullptr, nullptr, nullptr, nullptr, nullptr, command.buffers });
+            break;
+    }
+}
+
+
+//audio thread. moves the voice's lists into the bigger buffers, and leaves its old ones in buffers to go back.
+//each list is only swapped if it'd actually get bigger (a voice built after the grow already is)
+void SynthVoice::growVoice(VoiceState& voice, VoiceBuffers& buffers) {
+    auto swapIn = [](auto& current, auto& bigger) {
+        if (bigger.capacity() <= current.capacity()) return;
+        bigger.assign(current.begin(), current.end());  //fits in what was reserved, so no allocation
+        std::swap(current, bigger);
+    };
+    swapIn(voice.activeClicks, buffers.activeClicks);
+    swapIn(voice.activeSubClicks, buffers.activeSubClicks);
+
+    //the pattern playing might be in the buffer that's being swapped out
+    const uint8_t* oldPattern = voice.song.getPatternBuffer();
+    voice.song.adoptStorage(buffers.song);
+    if (voice.beatPattern == oldPattern) voice.beatPattern = voice.song.getPatternBuffer();
+    voice.resSong.adoptStorage(buffers.resSong);
+}
+
+
+//audio thread. sends something back to the message thread to be freed
+void SynthVoice::retire(const RetiredObject& object) {
+    if (pendingRetired.empty() && retiredQueue.push(object)) return;
+    if (pendingRetired.size() < pendingRetired.capacity()) {
+        pendingRetired.push_back(object);
+        return;
+    }
+    //both full. shouldn't happen, but freeing here beats leaking
+    jassertfalse;
+    if (object.species != nullptr) object.species->decReferenceCount();
+    delete object.voice;
+    delete object.resonator;
+    delete object.spatializer;
+    delete object.buffers;
+}
+
+
+//audio thread. hands back every slot past what the params need and what's been in use since the
+//last trim. voices only go from the back, so the indices of the ones left don't change.
+//the message thread frees them (see freeRetiredObjects), and builds new ones if the count goes back up
+void SynthVoice::trimIdleSlots(int voicesNeeded, int resonatorsNeeded, int spatializersNeeded) {
+    const int keepVoices = juce::jmax(1, voicesNeeded, voiceHighWaterMark, lastChorusCount);
+    while ((int)voices.size() > keepVoices && voices.back()->state == VoiceState::VoiceStateState::Dormant) {
+        VoiceState* voice = voices.back().release();
+        voices.pop_back();
+        wakeScheduler.cancel(voice->index);
+        releaseColdState(*voice);
+        voice->hot = nullptr;
+        retire({ nullptr, voice });
+    }
+
+    const int keepResonators = juce::jmax(resonatorsNeeded, resonatorPool.getHighWaterMark());
+    while (resonatorPool.getNumCreated() > keepResonators) {
+        auto* resonator = resonatorPool.removeSpare();
+        if (resonator == nullptr) break;
+        retire({ nullptr, nullptr, resonator });
+    }
+
+    const int keepSpatializers = juce::jmax(spatializersNeeded, spatializerPool.getHighWaterMark());
+    while (spatializerPool.getNumCreated() > keepSpatializers) {
+        auto* spatializer = spatializerPool.removeSpare();
+        if (spatializer == nullptr) break;
+        retire({ nullptr, nullptr, nullptr, spatializer });
+    }
+
+    //start watching again from what's in use now
+    voiceHighWaterMark = juce::jmax(1, lastChorusCount);
+    resonatorPool.resetHighWaterMark();
+    spatializerPool.resetHighWaterMark();
+}
+
+
+//===========================================================================
+
+
+//how many chorus voices can actually play: the count param, limited to the voices that have arrived
+//only voices that have arrived, and that can get a spatializer, can sing
+int SynthVoice::getUsableChorusCount() {
+    return juce::jmin((int)*apvts->getRawParameterValue("Chorus Count"), (int)voices.size(), spatializerPool.getNumCreated());
+}
+
+
+//audio thread. gives a voice's borrowed resonator and spatializer back to their pools
+void SynthVoice::releaseColdState(VoiceState& voice) {
+    resonatorPool.release(voice.resonator);
+    voice.resonator = nullptr;
+    voice.resonatorEnabled = false;
+    spatializerPool.release(voice.spatializer);
+    voice.spatializer = nullptr;
+}
+
+
+//audio thread. wakes up voices when the count goes up, and puts them to sleep when it goes down
+void SynthVoice::updateChorusVoiceCount() {
+    const int chorusCount = getUsableChorusCount();
+    if (lastChorusCount == chorusCount) return;
+    if (lastChorusCount < 0) lastChorusCount = 0;
+
+    if (chorusCount > lastChorusCount) {
+        bool resonatorOn = apvts->getRawParameterValue("Resonator On")->load();
+        for (int i = lastChorusCount; i < chorusCount; i++) {
+            //only reinitialize new voices, not every voice
+            initializeChorusVoice(voices[i].get(), resonatorOn);
+        }
+    }
+    else {
+        for (int idx = chorusCount; idx < (int)voices.size(); ++idx) {
+            voices[idx]->state = VoiceState::VoiceStateState::Dormant;
+            wakeScheduler.cancel(idx);
+            releaseColdState(*voices[idx]);
+            if (idx < DopplerDelayBank::maxLanes) dopplerBank.releaseLane(idx);    //it comes back somewhere else
+        }
+    }
+    lastChorusCount = chorusCount;
+    voiceHighWaterMark = juce::jmax(voiceHighWaterMark, chorusCount);
+}
+
+
+//===========================================================================
+
+
 void SynthVoice::updateInternalSpatialization(float maxDistance, float stereoSpread){
     if (!apvts->getRawParameterValue("Chorus On")) return;
     const int chorusVoiceNumber = (int)*apvts->getRawParameterValue("Chorus Count");
@@ -597,23 +1382,47 @@ float SynthVoice::getBaseAngle(float angleScalar, float maxAngle) {
 
 void SynthVoice::reinitializeChorusModeVoice(VoiceState* voice) {
     //separate voice compilations of the ASTs
-    ErrorInfo error;
-    std::map<std::string, float> sharedEnv;
-    std::vector<SongElement> mainSong = evaluateAST(compiledSongScript, &error, &sharedEnv);
-    std::vector<SongElement> resSong = {};
-    bool resonatorOn = apvts->getRawParameterValue("Resonator On")->load();
-    if (resonatorOn) resSong = evaluateAST(compiledResonatorScript, &error, &sharedEnv);
+    beginSongInstance(*voice);
+    const ChorusSpecies& species = getSpecies(*voice);
+    const bool resonatorOn = apvts->getRawParameterValue("Resonator On")->load() && species.resonatorOn;
 
-    if (mainSong.empty()) {
-        clearCurrentNote();
-        playing = false;
+    //TODO idk what I'd pass in for velocity here
+    if (!initializeVoiceState(voice, 1, species, resonatorOn)) {
+        sitOutSong(*voice);
         return;
     }
 
-    //TODO idk what I'd pass in for velocity here
-    initializeVoiceState(voice, 1, mainSong, resSong, resonatorOn);
+    const float cooldownMax = apvts->getRawParameterValue("Chorus Cooldown Max")->load();
     voice->state = VoiceState::VoiceStateState::Playing;
     voice->chorusCooldownSamples = 0;
+    //this song's length isn't known until it's sung, so guess it's as long as the last one
+    synchrony.startSong(voice->index, voice->songLengthSamples, 0.5 * cooldownMax * getSampleRate());
+}
+
+
+//===========================================================================
+
+
+//chorus mode. the voice's song didn't get to a note, which one broken species (or an unlucky draw) can do.
+//only this voice misses out: it cools down again and tries another instance, the rest of the chorus carries on
+void SynthVoice::sitOutSong(VoiceState& voice) {
+    if (stopChorusRefresh) {
+        voice.state = VoiceState::VoiceStateState::Dormant;
+        const bool allDone = std::all_of(voices.begin(), voices.end(),
+            [](const auto& v) { return v->state == VoiceState::VoiceStateState::Dormant; });
+        if (allDone) {
+            clearCurrentNote();
+            playing = false;
+        }
+        return;
+    }
+
+    //at least a control tick, so a species that never plays can't keep waking up within the same span
+    const float cooldownMax = apvts->getRawParameterValue("Chorus Cooldown Max")->load();
+    voice.chorusCooldownSamples = juce::jmax(controlInterval, (int)(voice.rng.nextFloat() * cooldownMax * getSampleRate()));
+    voice.state = VoiceState::VoiceStateState::CoolingDown;
+    scheduleCooldown(voice);
+    synchrony.startCooldown(voice.index, voice.songLengthSamples, voice.chorusCooldownSamples);
 }
 
 
@@ -623,7 +1432,7 @@ void SynthVoice::reinitializeChorusModeVoice(VoiceState* voice) {
 void SynthVoice::loadResonatorParams() {
     for (auto& voice : voices) {
         if (voice->resonatorEnabled) {
-            voice->resonator.loadParams();
+            voice->resonator->loadParams();
         }
     }
 }
@@ -632,112 +1441,158 @@ void SynthVoice::loadResonatorParams() {
 //===========================================================================
 
 
-void SynthVoice::initializeVoiceState(VoiceState* voice, float vel,
-    const std::vector<SongElement>& mainSong,
-    const std::vector<SongElement>& resSong,
-    bool resonatorEnabled)
+//starts a new instance of the species' songs. false if the main song doesn't have any notes
+bool SynthVoice::initializeVoiceState(VoiceState* voice, float vel, const ChorusSpecies& species, bool resonatorEnabled)
 {
     // Manual state reset
-    voice->song.clear();
-    voice->songIndex = 0;
-    voice->samplesRemainingInNote = 0;
+    voice->hot->samplesRemainingInNote = 0;
 
     // Reset impulse state
-    voice->phase = 0.0;
-    voice->phaseDelta = 0.0;
-    voice->deltaChangePerSample = 0.0;
+    voice->hot->phase = 0.0;
+    voice->hot->phaseDelta = 0.0;
+    voice->hot->deltaChangePerSample = 0.0;
     voice->level = vel * 0.15f;
 
     // Reset pattern state
-    voice->beatPattern = { 1 };
-    voice->patternIndex = 0;
-    voice->patternPhaseDivisor = 1;
-    voice->clicksRemainingInBeat = 1;
+    voice->beatPattern = defaultBeatPattern;
+    voice->beatPatternLength = 1;
+    voice->hot->patternIndex = 0;
+    voice->hot->patternPhaseDivisor = 1;
+    voice->hot->clicksRemainingInBeat = 1;
 
     // Clear clicks
     voice->activeClicks.clear();
     voice->activeSubClicks.clear();
 
-    // Main song setup
-    voice->song = mainSong;
-    if (!voice->song.empty() && voice->song[0].type != SongElement::Type::Pattern) {
-        voice->song.insert(voice->song.begin(), SongElement{ std::vector<uint8_t>{1} });
+    // Main song setup. the pattern reset above is the default pattern, until the song sets one
+    retireProgram(voice->song.start(species.songProgram.get(), getSongCodeRng(*voice, 0)));
+    voice->songStats = {};
+    if (!advanceSong(*voice)) return false;
+
+    // Resonator setup. borrow one for this song, or give it back if the resonator is off.
+    //if none have arrived from the message thread yet, this song just plays without it
+    if (resonatorEnabled && voice->resonator == nullptr) voice->resonator = resonatorPool.acquire();
+    if (!resonatorEnabled && voice->resonator != nullptr) {
+        resonatorPool.release(voice->resonator);
+        voice->resonator = nullptr;
     }
+    voice->resonatorEnabled = resonatorEnabled && voice->resonator != nullptr;
+    if (voice->resonatorEnabled) {
+        //the resonator song can use the main song's variables. the ones set before its first note, anyway
+        retireProgram(voice->resSong.start(species.resProgram.get(), getSongCodeRng(*voice, 1)));
+        voice->resSong.importVariables(voice->song);
+        voice->resonator->reset(); // Reset internal DSP state
+        voice->resonator->setAPVTS(apvts);
+        voice->resonator->prepareToPlay(getSampleRate());
+        voice->resSamplesRemainingInNote = 0;
+        advanceResSong(*voice);
+    }
+    return true;
+}
+
+
+//===========================================================================
 
-    // Initialize first element
-    if (!voice->song.empty()) {
-        setupNextNote(*voice, voice->song[0]);
+
+//pulls the song along to its next note. patterns on the way just change the beat pattern.
+//false once the song's over (or it's broken, or it's stuck running code without ever getting to a note)
+bool SynthVoice::advanceSong(VoiceState& voice) {
+    for (int i = 0; i < maxPatternsInARow; i++) {
+        if (!voice.song.next(voice.songStep, nullptr, maxSongSteps)) return false;
+        voice.songStats.add(voice.songStep);
+        if (voice.songStep.type == SongElement::Type::Pattern) {
+            setupNextPattern(voice, voice.songStep);
+        }
+        else {
+            setupNextNote(voice, voice.songStep);
+            return true;
+        }
     }
+    return false;
+}
 
-    // Resonator setup
-    voice->resonatorEnabled = resonatorEnabled;
-    if (voice->resonatorEnabled) {
-        voice->resSong = resSong;
-        voice->resonator.reset(); // Reset internal DSP state
-        voice->resonator.setAPVTS(apvts);
-        voice->resonator.prepareToPlay(getSampleRate());
-        if (!resSong.empty()) {
-            setupNextResNote(*voice, resSong[0]);
+
+//the resonator song loops: when it runs out, the same instance starts over.
+//patterns don't work with the resonator, so they're skipped. with no notes at all it just stays put
+void SynthVoice::advanceResSong(VoiceState& voice) {
+    bool rewound = false;
+    for (int i = 0; i < maxPatternsInARow; i++) {
+        if (!voice.resSong.next(voice.resStep, nullptr, maxSongSteps)) {
+            if (rewound) return;
+            voice.resSong.rewind();
+            rewound = true;
+        }
+        else if (voice.resStep.type == SongElement::Type::Note) {
+            setupNextResNote(voice, voice.resStep);
+            return;
         }
     }
 }
 
 
+//each layer of each song instance draws its rands from its own stream
+CounterRng SynthVoice::getSongCodeRng(const VoiceState& voice, int layer) const {
+    return CounterRng(noteSeed, CounterRng::makeStream(SongCodeStream, (uint32_t)voice.index, voice.songInstance * 2 + (uint32_t)layer));
+}
+
+
+//audio thread. a song cursor moved on from this program (the species set changed), and might have
+//been the last one holding it, so it goes to the message thread to be let go
+void SynthVoice::retireProgram(SongProgram* program) {
+    if (program != nullptr) retire({ nullptr, nullptr, nullptr, nullptr, program });
+}
+
+
+//===========================================================================
+
+
+void SynthVoice::setupNextResNote(VoiceState& voice, const SongStep& note) {
+    auto startingFreq = note.startFrequency;
+    auto endingFreq = note.endFrequency;
+    auto noteLengthInSamples = (note.duration / 1000.0) * getSampleRate();
+    voice.hot->resonatorFreq = startingFreq;
+    voice.resonatorFreqDelta = (endingFreq - startingFreq) / noteLengthInSamples;
+    voice.resSamplesRemainingInNote = (int)noteLengthInSamples;
+}
+
+
 //===========================================================================
 
 
-void SynthVoice::setupNextResNote(VoiceState& voice, const SongElement& note) {
-    if (note.type == SongElement::Type::Pattern) {
-        //ignore. patterns don't work with the resonator
+//patterns are 0-length, so advanceSong goes straight on to the next note after one
+void SynthVoice::setupNextPattern(VoiceState& voice, const SongStep& pattern) {
+    if (pattern.patternLength <= 0) return;
+    voice.beatPattern = pattern.pattern;
+    voice.beatPatternLength = pattern.patternLength;
+    voice.hot->patternIndex = 0;
 
-        voice.resIndex++;
-        setupNextResNote(voice, voice.resSong[voice.resIndex]);
+    if (voice.beatPattern[0] == 0) {
+        //0 means a skipped click, which should take as much time as a single click
+        voice.hot->clicksRemainingInBeat = 1;
+        voice.hot->patternPhaseDivisor = 1;
     }
     else {
-        auto startingFreq = note.startFrequency;
-        auto endingFreq = note.endFrequency;
-        auto noteLengthInSamples = (note.duration / 1000.0) * getSampleRate();
-        voice.resonatorFreq = startingFreq;
-        voice.resonatorFreqDelta = (endingFreq - startingFreq) / noteLengthInSamples;
-        voice.resSamplesRemainingInNote = (int)noteLengthInSamples;
+        voice.hot->clicksRemainingInBeat = voice.beatPattern[0];
+        voice.hot->patternPhaseDivisor = voice.beatPattern[0];
     }
+
+    voice.hot->phase = 0.0f;
 }
 
 
 //===========================================================================
 
 
-void SynthVoice::setupNextNote(VoiceState& voice, const SongElement& note) {
-    if (note.type == SongElement::Type::Pattern) {
-        voice.beatPattern = note.beatPattern;
-        voice.patternIndex = 0;
-
-        if (voice.beatPattern[0] == 0) {
-            //0 means a skipped click, which should take as much time as a single click
-            voice.clicksRemainingInBeat = 1;
-            voice.patternPhaseDivisor = 1;
-        }
-        else {
-            voice.clicksRemainingInBeat = voice.beatPattern[0];
-            voice.patternPhaseDivisor = voice.beatPattern[0];
-        }
-
-        voice.phase = 0.0f;
-        //advance to next note, since patterns are 0-length
-        voice.songIndex++;
-        setupNextNote(voice, voice.song[voice.songIndex]);
-    }
-    else {
-        // calculate how much the angleDelta will have to increase/decrease by
-        // to hit the end frequency in exactly curElement->duration ms.
-        const double startingPhaseChange = note.startFrequency / getSampleRate();
-        const double endingPhaseChange = note.endFrequency / getSampleRate();
-        const double noteLengthInSamples = (note.duration / 1000) * getSampleRate();
+void SynthVoice::setupNextNote(VoiceState& voice, const SongStep& note) {
+    // calculate how much the angleDelta will have to increase/decrease by
+    // to hit the end frequency in exactly curElement->duration ms.
+    const double startingPhaseChange = note.startFrequency / getSampleRate();
+    const double endingPhaseChange = note.endFrequency / getSampleRate();
+    const double noteLengthInSamples = (note.duration / 1000) * getSampleRate();
 
-        voice.phaseDelta = startingPhaseChange;
-        voice.samplesRemainingInNote = static_cast<int>(noteLengthInSamples);
-        voice.deltaChangePerSample = (endingPhaseChange - startingPhaseChange) / noteLengthInSamples;
-    }
+    voice.hot->phaseDelta = startingPhaseChange;
+    voice.hot->samplesRemainingInNote = static_cast<int>(noteLengthInSamples);
+    voice.hot->deltaChangePerSample = (endingPhaseChange - startingPhaseChange) / noteLengthInSamples;
 }
 
 
@@ -746,9 +1601,11 @@ void SynthVoice::setupNextNote(VoiceState& voice, const SongElement& note) {
 
 void SynthVoice::startNewClick(VoiceState& voice, float clickGenerationFreq) {
     Click newClick = {};
+    const ChorusSpecies& species = getSpecies(voice);
+    if (species.pips.empty()) return;
     //create first subclick
-    struct Pip firstPip = pipSequence[0];
-    startNewSubClick(voice, firstPip.frequency, firstPip.length, firstPip.level);
+    struct Pip firstPip = species.pips[0];
+    startNewSubClick(voice, firstPip.frequency, firstPip.length, firstPip.level * species.gain);
 
     //now set up the click state
     newClick.pos = 1;   //already started first pip, go to second
@@ -756,9 +1613,10 @@ void SynthVoice::startNewClick(VoiceState& voice, float clickGenerationFreq) {
     if (newClick.samplesTilNextClick <= 0) {
         newClick.samplesTilNextClick = 1;
     }
-    newClick.vol = 1.0;
+    newClick.vol = species.gain;
 
-    voice.activeClicks.push_back(newClick);
+    //past what was reserved for the songs' worst case (see growVoices), the click is dropped rather than allocated
+    if (voice.activeClicks.size() < voice.activeClicks.capacity()) voice.activeClicks.push_back(newClick);
 }
 
 
@@ -770,7 +1628,7 @@ void SynthVoice::startNewSubClick(VoiceState& voice, float baseFreq, int samples
 
     //frequency randomization
     const float freqRandomness = *apvts->getRawParameterValue("Click Pitch Random");
-    const float freqOffset = (rng.nextFloat() * 2.0f - 1.0f) * freqRandomness;
+    const float freqOffset = (voice.rng.nextFloat() * 2.0f - 1.0f) * freqRandomness;
     const float freqMultiplier = std::pow(2.0f, freqOffset);
 
     //attack/decay timing
@@ -785,7 +1643,7 @@ void SynthVoice::startNewSubClick(VoiceState& voice, float baseFreq, int samples
     newClick.curLevel = 0.0f;
     newClick.levelChangePerSample = vol / static_cast<double>(attackSamples);
 
-    voice.activeSubClicks.push_back(newClick);
+    if (voice.activeSubClicks.size() < voice.activeSubClicks.capacity()) voice.activeSubClicks.push_back(newClick);
 }
 
 
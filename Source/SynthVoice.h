@@ -16,6 +16,19 @@
 #include "HarmonicResonator.h"
 #include "Evaluator.h"
 #include "Spatializer.h"
+#include "ChorusTrajectory.h"
+#include "DopplerDelayBank.h"
+#include "LockFreeQueue.h"
+#include "ChorusWakeScheduler.h"
+#include "SwarmField.h"
+#include "CounterRng.h"
+#include "ColdPool.h"
+#include "ChorusSynchrony.h"
+#include "SpatialGrid.h"
+#include "ChorusSpecies.h"
+#include "CpuGovernor.h"
+#include <atomic>
+#include <limits>
 
 
 class BugsoundsAudioProcessor;
@@ -42,71 +55,158 @@ public:
     };
 
 
+    //what a song plays until it sets a pattern
+    static constexpr uint8_t defaultBeatPattern[1] = { 1 };
+
+
+    //the part of a voice that gets touched every sample: first layer oscillator and pattern state.
+    //these live side by side for every voice in SynthVoice::hotVoices, apart from the rest of
+    //VoiceState, so the render loop doesn't pull songs, click lists, etc. through the cache
+    struct VoiceHot {
+        double phase = 0.0;
+        double phaseDelta = 0.0;
+        double deltaChangePerSample = 0.0;
+        double resonatorFreq = 0.0;
+        float timingOffset = 0.0f;
+        int samplesRemainingInNote = 0;
+        int patternIndex = 0;
+        int patternPhaseDivisor = 1;
+        int clicksRemainingInBeat = 1;
+    };
+
+
     //each voice has a bunch of state variables that are exclusive to that voice.
     //for example: the compiled song, stuff for both layers of click generation, etc.
+    //the per-sample part is in VoiceHot, and the big optional parts are borrowed from pools
     struct VoiceState {
         VoiceState() = default;
         VoiceState(VoiceState&&) = default;
         VoiceState& operator=(VoiceState&&) = default;
         VoiceState(const VoiceState&) = delete;
         VoiceState& operator=(const VoiceState&) = delete;
-        //song state
-        std::vector<SongElement> song;
-        int songIndex = 0;
-        int samplesRemainingInNote = 0;
+        VoiceHot* hot = nullptr;    //this voice's slot in hotVoices
+
+        //song state. the species' compiled song, pulled a note at a time as it plays (see advanceSong)
+        SongCursor song;
+        SongStep songStep;                              //the last thing pulled out of song
+        SwarmField::SongStats songStats;                //the song so far
 
 
         //resonator state
-        HarmonicResonator resonator;
-        std::vector<SongElement> resSong;
-        int resIndex = 0;
+        HarmonicResonator* resonator = nullptr;    //from resonatorPool, only while the resonator is on
+        SongCursor resSong;
+        SongStep resStep;
         int resSamplesRemainingInNote = 0;
         bool resonatorEnabled = false;
-        double resonatorFreq = 0.0f;
+        bool resonatorBypassed = false; //too far away to be worth it, while the cpu governor is struggling
         double resonatorFreqDelta = 0.0f;
 
 
-        //first layer impulse state
-        double phase = 0.0;
-        double phaseDelta = 0.0;
-        double deltaChangePerSample = 0.0;
+        //first layer impulse state (the rest is in hot)
         double level;
-        float timingOffset = 0.0f;
-
-        //second layer impulse state
-        double pipPhase = 0.0;
-        double pipPhaseDelta = 0.0;
-        double pipPhaseDeltaChangePerSample = 0.0;
 
-        //pattern state
-        std::vector <uint8_t> beatPattern = { 1 };
-        int patternIndex = 0;
-        int patternPhaseDivisor = 1;
-        int clicksRemainingInBeat = 1;
+        //pattern state. a view of the song's current pattern, in its program or its cursor (see SongStep), so
+        //nothing's copied. the cursor's reference keeps the program alive for as long as the song plays
+        const uint8_t* beatPattern = defaultBeatPattern;
+        int beatPatternLength = 1;
 
         std::vector<Click> activeClicks;
         std::vector<SubClick> activeSubClicks;
 
         //spatialization
-        std::unique_ptr<Spatializer> spatializer;
+        Spatializer* spatializer = nullptr;    //from spatializerPool, only while this is a chorus voice
         float distance = 1.0f;
         float angle = 0.0f; //in radians
+        float anchorDistance = 1.0f;    //where the voice was placed. distance/angle move around this
+        float anchorAngle = 0.0f;
+        ChorusTrajectory trajectory;
         float distanceScalar = 1.0f; //scale the max distance param by this to get true distance
         float angleScalar = 0.0f;
         bool hasBeenInitialized = false;    //used for location persistence between playbacks
+        int index = 0;  //where this voice sits in voices. the wake scheduler refers to voices by it
+
+        //which species this voice is. an index into speciesSet, so it survives the set being swapped
+        int speciesIndex = 0;
+
+        //randomness. each song a voice sings gets its own stream, see beginSongInstance
+        CounterRng rng;
+        uint32_t songInstance = 0;
 
         //chorus mode state
+        double songLengthSamples = 0.0; //the last finished song, for the phase coupled timing model. songs aren't measured until they're sung
+
         enum class VoiceStateState {
             Playing,        //currently making sound
             CoolingDown,    //cooling down in chorus mode
             Dormant         //unused voice, or playback has ended and voices are being culled so we can clear note
         };
         VoiceStateState state = VoiceStateState::Dormant; //zzz zz
-        int chorusCooldownSamples = 0;  //time until this voice starts playing again
+        int chorusCooldownSamples = 0;  //cooldown length, at a rate of 1. the wake scheduler counts it down
+        double cooldownLeft = 0.0;      //with a hearing range, each voice counts its own cooldown down instead. see updateNeighbourListening
+    };
+
+
+    //a voice's click lists and song cursors, reserved bigger, for when a new species set needs more than
+    //the voices were built with. the audio thread swaps them in (see GrowVoice) and sends the old ones back
+    struct VoiceBuffers {
+        std::vector<Click> activeClicks;
+        std::vector<SubClick> activeSubClicks;
+        SongCursor song;        //never started, only their storage goes to the voice's cursors
+        SongCursor resSong;
+    };
+
+
+    //structural changes from the message thread. these are the only way the message thread touches
+    //voice state: they get queued, and the audio thread applies them at the top of renderNextBlock
+    struct VoiceCommand {
+        enum class Type {
+            AddVoice,           //voice: a preconstructed voice. ownership passes to the audio thread
+            AddResonator,       //resonator: goes into resonatorPool
+            AddSpatializer,     //spatializer: goes into spatializerPool
+            PlaceVoice,         //index, values: new distance/angle scalars and trajectory randoms
+            SetSpatialParams,   //values[0]: max distance, values[1]: stereo spread
+            SetSpecies,         //species: carries one reference
+            GrowVoice,          //index, buffers: bigger click lists and song cursors for that voice. ownership passes to the audio thread
+            TrimIdle            //values: the voices/resonators/spatializers the current params need. see trimIdleSlots
+        };
+        Type type = Type::AddVoice;
+        VoiceState* voice = nullptr;
+        HarmonicResonator* resonator = nullptr;
+        Spatializer* spatializer = nullptr;
+        ChorusSpeciesSet* species = nullptr;
+        VoiceBuffers* buffers = nullptr;
+        int index = 0;
+        std::array<float, 5> values{};
+    };
+
+
+    //things the audio thread is done with, sent back so they get freed on the message thread
+    struct RetiredObject {
+        ChorusSpeciesSet* species = nullptr;    //carries one reference
+        VoiceState* voice = nullptr;    //trimmed slots. the message thread frees them and lowers its counts
+        HarmonicResonator* resonator = nullptr;
+        Spatializer* spatializer = nullptr;
+        SongProgram* program = nullptr;         //carries one reference. a song cursor let go of it
+        VoiceBuffers* buffers = nullptr;        //what a GrowVoice swapped out
     };
 
 
+    //chorus positions, copied out by the audio thread for the position readout
+    struct PositionSnapshot {
+        struct Voice { float distance, angle; bool isPlaying, isMoving; };
+        std::array<Voice, DopplerDelayBank::maxLanes> voices;
+        int numVoices = 0;
+    };
+
+
+    //owned by the audio thread. grows through AddVoice commands, never past voiceCapacity,
+    //and shrinks from the back when idle slots get trimmed
     std::vector<std::unique_ptr<VoiceState>> voices;
+    static constexpr int maxChorusVoices = DopplerDelayBank::maxLanes;
+
+    //maxVoices is the most voice slots (mono voice included) this will ever build, up to maxChorusVoices
+    explicit SynthVoice(int maxVoices = maxChorusVoices);
+    ~SynthVoice() override;
 
     //================================= Synthvoice default functions ===================================
     bool canPlaySound(juce::SynthesiserSound* sound) override;
@@ -115,56 +215,168 @@ public:
     void pitchWheelMoved(int /*newPitchWheelValue*/) override { return; }
     void controllerMoved(int /*controllerNumber*/, int /*newControllerValue*/) override { return; }
     void renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples) override;
+    void prepareToPlay(double sampleRate, int samplesPerBlock, const juce::AudioChannelSet& outputLayout);
+    void setControlInterval(int samples);
+    int getLatencySamples() const;
 
 
 
     //====================================== setters ===================================================
 
-    void setSongScript(juce::ReferenceCountedObjectPtr<ScriptNode> script) { compiledSongScript = script;}
-    void setResScript(juce::ReferenceCountedObjectPtr<ScriptNode> script) { compiledResonatorScript = script; }
-    void setPipSequence(std::vector<Pip> pips) {
-        pipSequence = pips;
-        juce::Logger::writeToLog("Pips received. First freq: " + juce::String(pipSequence[0].frequency));
-    }
+    //these are all called from the message thread, and get passed to the audio thread as commands
+    void setSpecies(ChorusSpeciesSet::Ptr species);
     void setAPVTS(juce::AudioProcessorValueTreeState* apvtsPtr) { apvts = apvtsPtr; }
     void setOwner(BugsoundsAudioProcessor& procPtr) { audioProcessor = &procPtr; }
+    void setGovernor(const CpuGovernor* governorPtr) { governor = governorPtr; }
+    void setMasterSeed(uint64_t seed);
     void randomizeChorusPositions();
     void beginPeriodicChorusUpdates();
     void pushChorusPositionsToUI();
 
 private:
     //================================= helper functions ===============================================
-    void processFirstLayerClicks(VoiceState& voice, double sampleRate, float timingRandomParam);
+    void processFirstLayerClicks(VoiceState& voice, double sampleRate);
     void processSecondLayerClicks(VoiceState& voice);
-    float generateAudioOutput(VoiceState& voice, float clickVolumeParam);
+    float generateAudioOutput(VoiceState& voice);
     void updateSongProgress(VoiceState& voice);
-    void updateResonatorProgress(VoiceState& voice);
+    void updateResonatorProgress(VoiceState& voice, int numSamples);
+    void renderVoiceSpan(VoiceState& voice, float* out, int numSamples, double sampleRate);
     float getBaseAngle(float angleScalar, float maxAngle);
     void reinitializeChorusModeVoice(VoiceState* voice);
+    void sitOutSong(VoiceState& voice);
     void loadResonatorParams();
-    void initializeVoiceState(VoiceState* voice, float vel,
-        const std::vector<SongElement>& mainSong,
-        const std::vector<SongElement>& resSong,
-        bool resonatorEnabled);
-    void setupNextResNote(VoiceState& voice, const SongElement& note);
-    void setupNextNote(VoiceState& voice, const SongElement& note);
+    bool initializeVoiceState(VoiceState* voice, float vel, const ChorusSpecies& species, bool resonatorEnabled);
+    bool advanceSong(VoiceState& voice);
+    void advanceResSong(VoiceState& voice);
+    CounterRng getSongCodeRng(const VoiceState& voice, int layer) const;
+    void retireProgram(SongProgram* program);
+    void setupNextResNote(VoiceState& voice, const SongStep& note);
+    void setupNextPattern(VoiceState& voice, const SongStep& pattern);
+    void setupNextNote(VoiceState& voice, const SongStep& note);
     void startNewClick(VoiceState& voice, float clickGenerationFreq);
     void startNewSubClick(VoiceState& voice, float baseFreq, int samples, float vol);
     void updateVoiceSpatialization(VoiceState* voice, float maxDistance, float stereoSpread);
     void initializeChorusVoice(VoiceState* voice, bool resonatorOn);
-    //using this to update the chorus positions continuously whenever something changes
+    void releaseColdState(VoiceState& voice);
+    void beginSongInstance(VoiceState& voice);
+    const ChorusSpecies& getSpecies(const VoiceState& voice) const { return speciesSet->get(voice.speciesIndex); }
+    //message thread: preconstructs voices, watches the spatial params, frees retired objects,
+    //and forwards position snapshots to the UI
     void timerCallback() override;
+    void sendCommand(const VoiceCommand& command);
+    void flushPendingCommands();
+    void freeRetiredObjects();
+    std::unique_ptr<VoiceState> createVoiceState();
+    void growVoices(const VoiceLoad& load, const SongCursorSize& cursors);
+    Spatializer* createSpatializer();
+
+    //audio thread side of the command queue
+    void drainCommands();
+    void applyCommand(const VoiceCommand& command);
+    void growVoice(VoiceState& voice, VoiceBuffers& buffers);
+    void retire(const RetiredObject& object);
+    void trimIdleSlots(int voicesNeeded, int resonatorsNeeded, int spatializersNeeded);
+    void updateChorusVoiceCount();
+    int getUsableChorusCount();
+    void publishChorusPositions(int numSamples);
+
     void updateInternalSpatialization(float maxDistance, float stereoSpread);
+    void updateChorusMotion(const std::vector<VoiceState*>& activeVoices, int numSamples);
+    void applyDoppler(const std::vector<VoiceState*>& activeVoices, std::vector<juce::AudioBuffer<float>>& tempBuffers,
+        int startSample, int numSamples);
+    void updateDopplerTargets(const std::vector<VoiceState*>& activeVoices);
+    void renderSwarmField(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples, SpatialMode spatialMode);
+    float getCooldownRate();
+    float getCooldownRate(float playingProportion);
+    void updateNeighbourListening(const std::vector<VoiceState*>& activeVoices, float hearingRange);
+    void scheduleCooldown(VoiceState& voice);
+    void wakeDueVoices();
+    void updateSynchrony(const std::vector<VoiceState*>& activeVoices);
+    void controlTick(const std::vector<VoiceState*>& activeVoices);
+    void updateQualityCuts(const std::vector<VoiceState*>& activeVoices);
     
 
     //=================================== data and references ==============================================
     juce::AudioProcessorValueTreeState* apvts = nullptr;
     BugsoundsAudioProcessor* audioProcessor = nullptr;
-    juce::Random rng;
-
-    std::vector<Pip> pipSequence;
-    juce::ReferenceCountedObjectPtr<ScriptNode> compiledSongScript;
-    juce::ReferenceCountedObjectPtr<ScriptNode> compiledResonatorScript;
+    const CpuGovernor* governor = nullptr;
+    //every random number comes from a stream of the master seed (stored in presets).
+    //streams are picked per voice and per song, so the same seed always renders the same
+    enum RngStream : uint8_t {
+        SongStream = 1,     //one per voice per song instance. the song's clicks, and the cooldown after it
+        PlacementStream,    //one per voice. where it first sits
+        SwarmStream,        //the far field
+        RerollStream,       //position rerolls from the UI
+        SongCodeStream      //one per voice per song instance per layer (main, resonator). the songcode's rands
+    };
+    static constexpr uint64_t defaultSeed = 1;
+    std::atomic<uint64_t> masterSeed{ defaultSeed };
+    uint64_t noteSeed = defaultSeed;    //audio thread. the master seed when the current note started
+    CounterRng messageThreadRng{ defaultSeed, CounterRng::makeStream(RerollStream, 0, 0) };  //for rerolls, which are rolled on the message thread
+
+    //message thread -> audio thread
+    LockFreeQueue<VoiceCommand, 512> commandQueue;
+    std::vector<VoiceCommand> pendingCommands;  //message thread only. commands that didn't fit in the queue yet
+    int voicesSent = 0;                         //message thread only. voices created so far
+    int resonatorsSent = 0;                     //message thread only
+    int spatializersSent = 0;                   //message thread only
+    int voiceCapacity = maxChorusVoices;        //set once in the constructor
+    int clickCapacity = minClickCapacity;       //message thread only. what new voices reserve, see growVoices
+    int subClickCapacity = minSubClickCapacity; //message thread only
+    SongCursorSize cursorSize;                  //message thread only. what new voices' song cursors reserve
+    int ticksUntilTrim = idleTrimTicks;         //message thread only
+    int voiceHighWaterMark = 1;                 //audio thread. most voices in use since the last trim
+    std::atomic<double> spatializerSampleRate{ 44100.0 };   //what new spatializers get prepared at
+
+    //per voice state. hot is indexed like voices, the pools are borrowed from (audio thread)
+    std::array<VoiceHot, maxChorusVoices> hotVoices;
+    ColdPool<HarmonicResonator> resonatorPool;
+    ColdPool<Spatializer> spatializerPool;
+
+    //audio thread -> message thread
+    LockFreeQueue<RetiredObject, 64> retiredQueue;
+    std::vector<RetiredObject> pendingRetired;  //audio thread only. reserved up front, so pushing never allocates
+    LockFreeQueue<PositionSnapshot, 4> positionQueue;
+    PositionSnapshot audioPositionSnapshot;     //audio thread only. scratch for building a snapshot
+    PositionSnapshot uiPositionSnapshot;        //message thread only. scratch for reading one
+    int samplesSincePositionSnapshot = 0;
+    BinauralRenderer binauralRenderer; //shared by every chorus voice in binaural mode
+    bool binauralActive = false;       //audio thread. the last block went through binauralRenderer
+    AmbisonicBus ambisonicBus;         //shared by every chorus voice in ambisonic mode
+    DopplerDelayBank dopplerBank;      //propagation delay for moving chorus voices, one lane per voice
+    EarlyReflections earlyReflections; //the environment every chorus voice shares
+    SwarmField swarmField;             //every insect past the chorus voices, rendered statistically
+    std::array<float*, DopplerDelayBank::maxLanes> dopplerLanes{};
+
+    //renderNextBlock's scratch, sized in prepareToPlay so a block never allocates. audio thread
+    std::vector<VoiceState*> activeVoices;              //reserved for voiceCapacity
+    std::vector<juce::AudioBuffer<float>> tempBuffers;  //one mono buffer per voice slot, maxBlockSize long
+    int maxBlockSize = 0;
+    ChorusMotion chorusMotion = ChorusMotion::Static;
+    bool dopplerActive = false;
+
+    //control rate. see controlTick
+    int controlInterval = 32;
+    int samplesUntilControlTick = 0;
+    juce::SmoothedValue<float> clickGain;
+    float currentClickGain = 1.0f;
+
+    //chorus wakeups. see getCooldownRate
+    ChorusWakeScheduler wakeScheduler;
+    float cooldownRate = 1.0f;  //for the current span
+    int spanOffset = 0;         //where in the current span a voice is, while its song advances
+    ChorusTimingModel timingModel = ChorusTimingModel::Cooldown;    //loaded every control tick
+    ChorusSynchrony synchrony;  //voice phases for the phase coupled model. indexed like voices
+    SpatialGrid neighbourGrid;  //chorus voice positions, for who can hear who
+    bool listeningLocally = false;  //cooldown model with a hearing range. loaded every control tick
+
+    //quality cuts from the cpu governor. see updateQualityCuts
+    CpuGovernor::Tier qualityTier = CpuGovernor::Tier::Full;    //loaded every block
+    float cullDistance = std::numeric_limits<float>::max();     //voices this far or farther don't start new songs
+    std::vector<float> cullScratch;                             //audio thread. reserved, for finding cullDistance
+
+    //songs and clicks for every species. shared by all the voices, never edited, only swapped (audio thread)
+    ChorusSpeciesSet::Ptr speciesSet = new ChorusSpeciesSet({});
 
     bool isChorusEnabled = false;
 
@@ -173,10 +385,10 @@ private:
     bool playing = false;
     bool stopChorusRefresh = false;
 
-    //used to detect when the positioning parameters have changed
+    //used to detect when the positioning parameters have changed (message thread)
     float lastMaxDistance = -1.0f;
     float lastStereoSpread = -1.0f;
-    int lastChorusCount = -1;
+    int lastChorusCount = -1;   //how many chorus voices are active (audio thread)
     
 
 	//========================= CONSTANTS =========================
@@ -185,5 +397,16 @@ private:
 	const float boostFactor = 0.2f; //handoff boost factor for correlation algorithm
 	const float fillFactor = 0.2f; //how much extra cluster when all voices play
     const float minDist = 5.0f; //prevents voices from spawning on top of the listener
+    static constexpr int minControlInterval = 16; //samples between control ticks
+    static constexpr int maxControlInterval = 64;
+    static constexpr double controlIntervalSeconds = 32.0 / 48000.0;
+    static constexpr float minHearingRange = 1.0f; //meters. below this, everyone hears everyone
+    static constexpr float resonatorBypassDistance = 10.0f; //meters. past this, resonators go first under load
+    static constexpr int timerHz = 30;
+    static constexpr int idleTrimTicks = timerHz * 10; //slots nobody used for this long get freed
+    static constexpr int maxSongSteps = 100000;     //songcode instructions a voice runs looking for its next note, before giving up on the song
+    static constexpr int maxPatternsInARow = 64;    //same, for patterns with no notes between them
+    static constexpr int minClickCapacity = 16;     //click lists reserved per voice at least, whatever the songs' bounds say
+    static constexpr int minSubClickCapacity = 64;
 };
 
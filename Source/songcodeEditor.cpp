@@ -22,18 +22,15 @@ SongcodeEditor::SongcodeEditor(const juce::String& title, const juce::String& he
     titleLabel.setText(title, juce::dontSendNotification);
     addAndMakeVisible(titleLabel);
 
-    //set up main editor. This is where all the code goes
-    mainEditor.setMultiLine(true);
-    mainEditor.setReturnKeyStartsNewLine(true);
+    //set up main editor. This is where all the code goes. the token cache colours it
     mainEditor.setReadOnly(false);
-    mainEditor.setScrollbarsShown(true);
-    mainEditor.setCaretVisible(true);
-    mainEditor.setPopupMenuEnabled(true);
-    mainEditor.setTextToShowWhenEmpty("Enter your songcode here...", juce::Colours::beige);
-    mainEditor.setColour(juce::TextEditor::outlineColourId, juce::Colours::white);
+    mainEditor.setLineNumbersShown(false);
+    mainEditor.setColourScheme(tokeniser.getDefaultColourScheme());
+    mainEditor.setColour(juce::CodeEditorComponent::backgroundColourId, getLookAndFeel().findColour(juce::TextEditor::backgroundColourId));
+    mainEditor.setColour(juce::CodeEditorComponent::defaultTextColourId, juce::Colours::white);
 
-    //enable text editor listeners
-    mainEditor.addListener(this);
+    //enable document listeners
+    document.addListener(this);
 
     addAndMakeVisible(mainEditor);
 
@@ -42,7 +39,7 @@ SongcodeEditor::SongcodeEditor(const juce::String& title, const juce::String& he
     errorLabel.setJustificationType(juce::Justification::centred);
     addAndMakeVisible(errorLabel);
 
-    defaultEditorColour = mainEditor.findColour(juce::TextEditor::backgroundColourId);
+    defaultEditorColour = mainEditor.findColour(juce::CodeEditorComponent::backgroundColourId);
     defaultBackgroundColour = getLookAndFeel().findColour(juce::ResizableWindow::backgroundColourId);
 
     //i have a feeling this will cause problems laters
@@ -68,6 +65,9 @@ SongcodeEditor::SongcodeEditor(const juce::String& title, const juce::String& he
 
 
 SongcodeEditor::~SongcodeEditor(){
+    //don't lose an edit that was still waiting
+    if (isTimerRunning()) audioProcessor.setUserSongcode(getText(), title);
+    document.removeListener(this);
     audioProcessor.getPresetManager().removeChangeListener(this);
 }
 
@@ -93,6 +93,11 @@ void SongcodeEditor::paint(juce::Graphics& g)
 }
 
 void SongcodeEditor::paintOverChildren(juce::Graphics& g) {
+    if (showingPlaceholder) {
+        g.setColour(juce::Colours::beige);
+        g.drawText("Enter your songcode here...", mainEditor.getBounds().reduced(4), juce::Justification::topLeft, true);
+    }
+    paintErrorSquiggle(g);
     if (isDisabled) {
         paintOverlay(g);
     }
@@ -123,21 +128,27 @@ void SongcodeEditor::resized()
 
 juce::String SongcodeEditor::getText() const
 {
-    return mainEditor.getText();
+    return document.getAllContent();
 }
 
 void SongcodeEditor::setText(const juce::String& newText)
 {
-    mainEditor.setText(newText);
+    document.replaceAllContent(newText);
+    document.clearUndoHistory();
+}
+
+
+bool SongcodeEditor::getTokens(std::vector<Token>& tokens) const {
+    return tokenCache.getTokens(tokens);
 }
 
 
 //error handling
 void SongcodeEditor::clearErrorHighlight() {
-    currentErrorRange = juce::Range<int>(0, 0);
     hasActiveError = false;
-    
-    mainEditor.setTemporaryUnderlining(currentErrorRange);
+    errorStart.setPositionMaintained(false);
+    errorEnd.setPositionMaintained(false);
+    repaint();
 }
 
 
@@ -157,41 +168,94 @@ void SongcodeEditor::setError(ErrorInfo* error) {
     if (error == nullptr) {
         errorLabel.setColour(juce::Label::textColourId, juce::Colours::darkgreen);
         errorLabel.setText(juce::String("Compiled successfully"), juce::NotificationType::dontSendNotification);
+        if (hasActiveError) clearErrorHighlight();
     }
     else {
         //set message
         errorLabel.setColour(juce::Label::textColourId, juce::Colours::maroon);
         errorLabel.setText(juce::String(error->message), juce::NotificationType::dontSendNotification);
 
-        //highlight error
-        currentErrorRange = juce::Range<int>(error->errorStart, error->errorEnd + 1);
+        //highlight error. the positions move with edits before them
+        errorStart = juce::CodeDocument::Position(document, (int)error->errorStart);
+        errorEnd = juce::CodeDocument::Position(document, (int)error->errorEnd + 1);
+        errorStart.setPositionMaintained(true);
+        errorEnd.setPositionMaintained(true);
         hasActiveError = true;
-        mainEditor.setTemporaryUnderlining(currentErrorRange);
-        
-        oldTextLength = mainEditor.getText().length();
+        repaint();
     }
 }
 
 
-void SongcodeEditor::textEditorTextChanged(juce::TextEditor&) {
-    audioProcessor.setUserSongcode(mainEditor.getText(), title);
-    if (isDisabled) return;
+void SongcodeEditor::setWarning(const std::string& warning) {
+    errorLabel.setColour(juce::Label::textColourId, juce::Colours::darkorange);
+    errorLabel.setText(juce::String(warning), juce::NotificationType::dontSendNotification);
+}
 
-    if (hasActiveError) {
-        auto caretPos = mainEditor.getCaretPosition();
-        if (caretPos > currentErrorRange.getStart() && caretPos < currentErrorRange.getEnd()) {
-            clearErrorHighlight();
-        }
-        else if( caretPos < currentErrorRange.getStart()) {
-            //recalculate error position
-            int newLength = mainEditor.getText().length();
-            int lendiff = oldTextLength - newLength;
-            oldTextLength = newLength;
-   
-            currentErrorRange = juce::Range<int>(currentErrorRange.getStart() - lendiff, currentErrorRange.getEnd() - lendiff);
-            //juce::Logger::writeToLog("Old length: " + juce::String(oldTextLength) + ", newlength: " + juce::String(newLength));
-            mainEditor.setTemporaryUnderlining(currentErrorRange);
+
+void SongcodeEditor::codeDocumentTextInserted(const juce::String&, int insertIndex) {
+    linesChanged(insertIndex);
+}
+
+
+void SongcodeEditor::codeDocumentTextDeleted(int startIndex, int) {
+    linesChanged(startIndex);
+}
+
+
+//the document tells us where an edit was, but not how many lines it replaced. the difference in line
+//count says that: an edit that adds n lines turned one line into n + 1, and one that removes n turned n + 1 into one
+void SongcodeEditor::linesChanged(int index) {
+    const int firstLine = juce::CodeDocument::Position(document, index).getLineNumber();
+    const int lineDifference = document.getNumLines() - tokenCache.getNumLines();
+    const int numOldLines = lineDifference >= 0 ? 1 : 1 - lineDifference;
+    const int numNewLines = juce::jmin(numOldLines + lineDifference, document.getNumLines() - firstLine);
+
+    std::vector<std::string> newLines;
+    newLines.reserve((size_t)juce::jmax(0, numNewLines));
+    for (int i = 0; i < numNewLines; i++) newLines.push_back(SongcodeTokenCache::toLineText(document.getLine(firstLine + i)));
+    tokenCache.replaceLines(firstLine, numOldLines, std::move(newLines));
+
+    //the placeholder text comes and goes
+    const bool isEmpty = document.getNumCharacters() == 0;
+    if (isEmpty != showingPlaceholder) repaint();
+    showingPlaceholder = isEmpty;
+
+    //editing the error itself clears it
+    if (hasActiveError && index >= errorStart.getPosition() && index <= errorEnd.getPosition()) clearErrorHighlight();
+
+    //saving and compiling wait for typing to stop
+    startTimer(compileDelayMs);
+}
+
+
+void SongcodeEditor::timerCallback() {
+    stopTimer();
+    audioProcessor.setUserSongcode(getText(), title);
+    if (!isDisabled) audioEditor.songcodeHasChanged();
+}
+
+
+void SongcodeEditor::paintErrorSquiggle(juce::Graphics& g) {
+    if (!hasActiveError) return;
+
+    juce::Graphics::ScopedSaveState state(g);
+    g.reduceClipRegion(mainEditor.getBounds());
+    g.setColour(juce::Colours::red);
+
+    //only so much of a long error gets a squiggle
+    const int end = juce::jmin(errorEnd.getPosition(), errorStart.getPosition() + 256);
+    for (int i = errorStart.getPosition(); i < juce::jmax(end, errorStart.getPosition() + 1); i++) {
+        juce::CodeDocument::Position position(document, i);
+        if (position.getCharacter() == '\n' || position.getCharacter() == '\r') continue;
+        auto bounds = mainEditor.getCharacterBounds(position).translated(mainEditor.getX(), mainEditor.getY()).toFloat();
+
+        juce::Path squiggle;
+        const float y = bounds.getBottom() - 1.5f;
+        squiggle.startNewSubPath(bounds.getX(), y);
+        for (float x = bounds.getX() + 2.0f; x <= bounds.getRight(); x += 2.0f) {
+            squiggle.lineTo(x, y + (((int)(x - bounds.getX()) / 2) % 2 == 0 ? 0.0f : 1.5f));
         }
+        g.strokePath(squiggle, juce::PathStrokeType(1.0f));
     }
 }
 
@@ -213,7 +277,6 @@ void SongcodeEditor::paintOverlay(juce::Graphics& g)
 void SongcodeEditor::disableEditor() {
     isDisabled = true;
     mainEditor.setReadOnly(true);
-    mainEditor.setCaretVisible(false);
 
     repaint();
 }
@@ -222,7 +285,6 @@ void SongcodeEditor::disableEditor() {
 void SongcodeEditor::enableEditor() {
     isDisabled = false;
     mainEditor.setReadOnly(false);
-    mainEditor.setCaretVisible(true);
 
     repaint();
 }
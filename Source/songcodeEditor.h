@@ -13,6 +13,7 @@
 #include <JuceHeader.h>
 #include "Evaluator.h"
 #include "HelpButton.h"
+#include "SongcodeTokenCache.h"
 
 struct ErrorInfo;
 
@@ -21,8 +22,9 @@ class BugsoundsAudioProcessor;
 class BugsoundsAudioProcessorEditor;
 
 class SongcodeEditor : public juce::Component,
-                       public juce::TextEditor::Listener,
-                       public juce::ChangeListener
+                       public juce::CodeDocument::Listener,
+                       public juce::ChangeListener,
+                       private juce::Timer
 {
     public:
         SongcodeEditor(const juce::String& title, const juce::String& helpPage, BugsoundsAudioProcessor& p, BugsoundsAudioProcessorEditor& e);
@@ -35,8 +37,13 @@ class SongcodeEditor : public juce::Component,
         juce::String getText() const;
         void setText(const juce::String& newText);
 
+        //the cached tokens for getText(), for generateAST. false if they'd give a lexer error, so lex the text normally
+        bool getTokens(std::vector<Token>& tokens) const;
+
         //if error is null, then successfully compiled.
         void SongcodeEditor::setError(ErrorInfo* error = nullptr);
+        //compiled, but with something worth knowing. replaces the success message until the next compile
+        void setWarning(const std::string& warning);
         void clearErrorHighlight();
         void changeListenerCallback(juce::ChangeBroadcaster* source) override;
 
@@ -44,16 +51,28 @@ class SongcodeEditor : public juce::Component,
         void enableEditor();
 
     private:
-        void textEditorTextChanged(juce::TextEditor&) override;
+        void codeDocumentTextInserted(const juce::String& newText, int insertIndex) override;
+        void codeDocumentTextDeleted(int startIndex, int endIndex) override;
+        void linesChanged(int index);
+        void timerCallback() override;
         void paintOverlay(juce::Graphics& g);
+        void paintErrorSquiggle(juce::Graphics& g);
+
+        //edits wait this long for typing to stop before they're saved and compiled
+        static constexpr int compileDelayMs = 300;
 
         juce::Label titleLabel;
-        juce::TextEditor mainEditor;
+        juce::CodeDocument document;
+        SongcodeTokenCache tokenCache;
+        SongcodeTokeniser tokeniser{ tokenCache };
+        juce::CodeEditorComponent mainEditor{ document, &tokeniser };
         juce::Label errorLabel;
 
-        juce::Range<int> currentErrorRange;
-        int oldTextLength = 0;
+        //follow the text through edits
+        juce::CodeDocument::Position errorStart;
+        juce::CodeDocument::Position errorEnd;
         bool hasActiveError = false;
+        bool showingPlaceholder = true;
         juce::LookAndFeel_V4 errorLookAndFeel;
         juce::LookAndFeel_V4* normalLookAndFeel;
 